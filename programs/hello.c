@@ -0,0 +1,17 @@
+// hello.c - Sample program for the ELF loader (Example 4 in main)
+//
+// Linked at 0x400000 by the Makefile and copied onto the disk image as
+// PROGRAM.ELF. Returns 42 if the loader copied .data and cleared .bss.
+
+static int zeroed[1024];            // .bss, must be cleared by the loader
+static int answer = 40;             // .data, must be read from the file
+
+int program_main(void) {
+    for (int i = 0; i < 1024; i++) {
+        if (zeroed[i] != 0) {
+            return -1;
+        }
+    }
+
+    return answer + 2;
+}
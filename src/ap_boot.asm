@@ -0,0 +1,73 @@
+; ap_boot.asm - Real-mode entry point for application processors
+;
+; smp.c copies the code between ap_trampoline_start and ap_trampoline_end
+; to AP_TRAMPOLINE_BASE and points the startup IPI at it. Each AP switches
+; to protected mode with a temporary flat GDT, takes the next CPU index
+; from ap_next_index, loads the stack smp.c set aside for that index and
+; calls ap_main(index). Everything here runs from the copy, so addresses
+; inside the trampoline go through TRAMP() and calls into the kernel are
+; absolute.
+
+AP_TRAMPOLINE_BASE equ 0x8000
+MAX_CPUS equ 8
+KERNEL_CODE_SEL equ 0x08
+KERNEL_DATA_SEL equ 0x10
+
+%define TRAMP(label) (AP_TRAMPOLINE_BASE + (label) - ap_trampoline_start)
+
+extern ap_main
+extern ap_next_index
+extern ap_stacks
+
+section .text
+
+bits 16
+global ap_trampoline_start
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMP(ap_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1                       ; PE
+    mov cr0, eax
+    jmp dword KERNEL_CODE_SEL:TRAMP(ap_protected)
+
+bits 32
+ap_protected:
+    mov ax, KERNEL_DATA_SEL
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, 1
+    lock xadd [ap_next_index], eax
+    cmp eax, MAX_CPUS
+    jae .park                       ; More CPUs than cpus[] has room for
+    mov esp, [ap_stacks + eax * 4]
+    test esp, esp
+    jz .park
+
+    push eax
+    mov ecx, ap_main
+    call ecx
+
+.park:
+    cli
+    hlt
+    jmp .park
+
+align 8
+ap_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF           ; Same flat code/data as gdt.c
+    dq 0x00CF92000000FFFF
+ap_gdt_ptr:
+    dw ap_gdt_ptr - ap_gdt - 1
+    dd TRAMP(ap_gdt)
+
+global ap_trampoline_end
+ap_trampoline_end:
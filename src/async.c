@@ -0,0 +1,123 @@
+// async.c - Cooperative executor for stackless tasks
+//
+// Everything here runs on the boot CPU. The ready queue is shared with
+// IRQ handlers that signal events, so it is only touched with interrupts
+// disabled.
+#include "async.h"
+#include "idt.h"
+
+void executor_init(executor_t *ex) {
+    ex->ready_head = 0;
+    ex->ready_tail = 0;
+    ex->live_tasks = 0;
+    ex->idle.head = ex->idle.tail = 0;
+    ex->sleeps = 0;
+}
+
+void task_init(task_t *task, const char *name, task_status_t (*poll)(task_t *task), void *ctx) {
+    task->poll = poll;
+    task->state = 0;
+    task->ctx = ctx;
+    task->name = name;
+    task->executor = 0;
+    task->next = 0;
+    task->queued = 0;
+    task->polls = 0;
+}
+
+// Interrupts must be disabled
+static void ready_push(executor_t *ex, task_t *task) {
+    if (task->queued) {
+        return;
+    }
+
+    task->queued = 1;
+    task->next = 0;
+    if (ex->ready_tail) {
+        ex->ready_tail->next = task;
+    } else {
+        ex->ready_head = task;
+    }
+    ex->ready_tail = task;
+}
+
+void executor_spawn(executor_t *ex, task_t *task) {
+    uint32_t flags = irq_save();
+    task->executor = ex;
+    ex->live_tasks++;
+    ready_push(ex, task);
+    irq_restore(flags);
+}
+
+void task_wake(task_t *task) {
+    uint32_t flags = irq_save();
+    ready_push(task->executor, task);
+    wake_up(&task->executor->idle);
+    irq_restore(flags);
+}
+
+void executor_run(executor_t *ex) {
+    for (;;) {
+        uint32_t flags = irq_save();
+
+        task_t *task = ex->ready_head;
+        if (!task) {
+            if (ex->live_tasks == 0) {
+                irq_restore(flags);
+                return;
+            }
+            // Nothing to poll until an event fires
+            ex->sleeps++;
+            thread_sleep(&ex->idle, 0);
+            irq_restore(flags);
+            continue;
+        }
+
+        ex->ready_head = task->next;
+        if (!ex->ready_head) {
+            ex->ready_tail = 0;
+        }
+        task->queued = 0;
+        irq_restore(flags);
+
+        task->polls++;
+        if (task->poll(task) == TASK_DONE) {
+            flags = irq_save();
+            ex->live_tasks--;
+            irq_restore(flags);
+        }
+    }
+}
+
+void event_init(async_event_t *event) {
+    event->signaled = 0;
+    event->waiter = 0;
+}
+
+void event_signal(async_event_t *event) {
+    uint32_t flags = irq_save();
+
+    event->signaled = 1;
+    task_t *task = event->waiter;
+    if (task) {
+        event->waiter = 0;
+        ready_push(task->executor, task);
+        wake_up(&task->executor->idle);
+    }
+
+    irq_restore(flags);
+}
+
+int task_await(task_t *task, async_event_t *event) {
+    uint32_t flags = irq_save();
+
+    int signaled = event->signaled;
+    if (signaled) {
+        event->signaled = 0;
+    } else {
+        event->waiter = task;
+    }
+
+    irq_restore(flags);
+    return signaled;
+}
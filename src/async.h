@@ -0,0 +1,62 @@
+// async.h - Cooperative executor for stackless tasks
+//
+// A task is a poll function plus a resume point (state) in a task_t. The
+// executor calls poll() whenever the task is ready; poll runs until it
+// has to wait for an event, registers with task_await() and returns
+// TASK_PENDING, or finishes and returns TASK_DONE. Tasks keep anything
+// that must survive across waits in their own context, not on the stack.
+//
+// Events are one-shot flags: event_signal() sets one and readies its
+// waiter, task_await() consumes it. Signals may come from IRQ handlers,
+// which is how disk completions reach tasks (see disk_read_async()).
+#include <stdint.h>
+#include "thread.h"
+#ifndef ASYNC_H
+#define ASYNC_H
+
+typedef enum {
+    TASK_PENDING,
+    TASK_DONE
+} task_status_t;
+
+struct executor;
+
+typedef struct task {
+    task_status_t (*poll)(struct task *task);
+    int state;                      // Resume point, owned by poll()
+    void *ctx;
+    const char *name;
+    struct executor *executor;
+    struct task *next;              // Ready queue link
+    int queued;
+    uint32_t polls;
+} task_t;
+
+typedef struct {
+    volatile int signaled;
+    task_t *waiter;
+} async_event_t;
+
+typedef struct executor {
+    task_t *ready_head;
+    task_t *ready_tail;
+    uint32_t live_tasks;
+    wait_queue_t idle;              // The running thread sleeps here when nothing is ready
+    uint32_t sleeps;
+} executor_t;
+
+void executor_init(executor_t *ex);
+void task_init(task_t *task, const char *name, task_status_t (*poll)(task_t *task), void *ctx);
+void executor_spawn(executor_t *ex, task_t *task);
+// Poll tasks until all of them are done; sleeps the calling thread while none is ready
+void executor_run(executor_t *ex);
+
+void event_init(async_event_t *event);
+void event_signal(async_event_t *event);
+// Returns 1 if @event was signaled (and clears it); otherwise makes @event
+// wake @task and returns 0, and poll() should return TASK_PENDING
+int task_await(task_t *task, async_event_t *event);
+// Ready @task again without an event
+void task_wake(task_t *task);
+
+#endif // ASYNC_H
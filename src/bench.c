@@ -0,0 +1,225 @@
+// bench.c - Boot-time storage benchmarks (kernel command line "bench")
+//
+// Runs against the files that "make bench.img" puts on the FAT volume.
+// Every result is one comma-separated line:
+//
+//   BENCH,<test>,<param>,<ops>,<bytes>,<total_us>,<avg_ns>,<kib_per_s>
+//
+// so the table can be grepped out of a "-serial stdio" log. Lines that
+// start with '#' are comments.
+#include "bench.h"
+#include "fat.h"
+#include "thread.h"
+#include "timer.h"
+#include "vga_output.h"
+
+#define BENCH_FILE          "BENCH.DAT"
+#define BENCH_DIR_FILES     256         // F000.DAT .. F255.DAT in the root
+#define BENCH_OPEN_REPEAT   16
+#define BENCH_RANDOM_OPS    64
+#define BENCH_RANDOM_SIZE   4096
+#define BENCH_RANDOM_SEED   12345
+#define BENCH_DISK_SECTORS  1024        // Sectors read per disk_read size
+#define BENCH_MAX_CHUNK     16384
+#define BENCH_BATCH_BYTES   16          // Enough for each "bench file N" line
+
+static const uint32_t chunk_sizes[] = { 256, 512, 1024, 4096, BENCH_MAX_CHUNK };
+
+static void bench_report(const char *test, uint32_t param, uint32_t ops,
+                         uint32_t bytes, uint64_t ns) {
+    uint32_t us = (uint32_t)udiv64(ns, 1000, 0);
+    uint32_t avg_ns = ops ? (uint32_t)udiv64(ns, ops, 0) : 0;
+    uint32_t kib_per_s = 0;
+
+    if (bytes) {
+        kib_per_s = (uint32_t)(udiv64((uint64_t)bytes * 1000000, us ? us : 1, 0) >> 10);
+    }
+
+    kprintf("BENCH,%s,%u,%u,%u,%u,%u,%u\n", test, param, ops, bytes, us, avg_ns, kib_per_s);
+}
+
+// Fixed-seed LCG so every run issues the same offsets
+static uint32_t bench_rand(uint32_t *state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 16;
+}
+
+// Builds "Fnnn.DAT" for directory slot @index
+static void bench_dir_name(char *name, uint32_t index) {
+    name[0] = 'F';
+    name[1] = '0' + (index / 100) % 10;
+    name[2] = '0' + (index / 10) % 10;
+    name[3] = '0' + index % 10;
+    name[4] = '.';
+    name[5] = 'D';
+    name[6] = 'A';
+    name[7] = 'T';
+    name[8] = '\0';
+}
+
+// Sequential fatRead of the whole file, like Example 3, per chunk size
+static void bench_sequential(uint8_t *buffer) {
+    for (uint32_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+        FAT_FileHandle file;
+        if (fatOpen(BENCH_FILE, &file) != 0) {
+            return;
+        }
+
+        uint32_t ops = 0;
+        uint32_t total = 0;
+        uint64_t start = ktime_ns();
+
+        int n;
+        while ((n = fatRead(&file, buffer, chunk_sizes[i])) > 0) {
+            total += n;
+            ops++;
+        }
+
+        bench_report("seq_read", chunk_sizes[i], ops, total, ktime_ns() - start);
+    }
+}
+
+static void bench_random(uint8_t *buffer) {
+    FAT_FileHandle file;
+    if (fatOpen(BENCH_FILE, &file) != 0) {
+        return;
+    }
+
+    uint32_t blocks = file.file_size / BENCH_RANDOM_SIZE;
+    if (blocks == 0) {
+        return;
+    }
+
+    uint32_t seed = BENCH_RANDOM_SEED;
+    uint32_t total = 0;
+    uint64_t start = ktime_ns();
+
+    for (uint32_t i = 0; i < BENCH_RANDOM_OPS; i++) {
+        uint32_t block = bench_rand(&seed) % blocks;
+        fatSeek(&file, block * BENCH_RANDOM_SIZE);
+
+        int n = fatRead(&file, buffer, BENCH_RANDOM_SIZE);
+        if (n > 0) {
+            total += n;
+        }
+    }
+
+    bench_report("rand_read", BENCH_RANDOM_SIZE, BENCH_RANDOM_OPS, total, ktime_ns() - start);
+}
+
+// fatOpen cost by directory position; the last slot is a miss
+static void bench_open(void) {
+    static const uint32_t slots[] = { 0, BENCH_DIR_FILES / 2, BENCH_DIR_FILES - 1, BENCH_DIR_FILES };
+    char name[9];
+
+    for (uint32_t i = 0; i < sizeof(slots) / sizeof(slots[0]); i++) {
+        bench_dir_name(name, slots[i]);
+
+        FAT_FileHandle file;
+        uint64_t start = ktime_ns();
+        for (int r = 0; r < BENCH_OPEN_REPEAT; r++) {
+            fatOpen(name, &file);
+        }
+
+        bench_report(slots[i] < BENCH_DIR_FILES ? "fat_open" : "fat_open_miss",
+                     slots[i], BENCH_OPEN_REPEAT, 0, ktime_ns() - start);
+    }
+}
+
+// The F*.DAT files read one fatOpen+fatRead at a time, then as one
+// fatReadBatch; the comment line gives the disk_reads the batch took
+static void bench_batch(uint8_t *buffer) {
+    FAT_ReadRequest *reqs = (FAT_ReadRequest*)kmalloc(BENCH_DIR_FILES * sizeof(FAT_ReadRequest));
+    char *names = (char*)kmalloc(BENCH_DIR_FILES * 9);
+    if (!reqs || !names) {
+        print_string("# bench_batch: out of memory\n");
+        kfree(names);
+        kfree(reqs);
+        return;
+    }
+
+    uint32_t total = 0;
+    uint64_t start = ktime_ns();
+    for (uint32_t i = 0; i < BENCH_DIR_FILES; i++) {
+        bench_dir_name(names + i * 9, i);
+        FAT_FileHandle file;
+        if (fatOpen(names + i * 9, &file) == 0) {
+            int n = fatRead(&file, buffer + i * BENCH_BATCH_BYTES, BENCH_BATCH_BYTES);
+            total += n > 0 ? n : 0;
+        }
+    }
+    bench_report("batch_serial", BENCH_DIR_FILES, BENCH_DIR_FILES, total, ktime_ns() - start);
+
+    for (uint32_t i = 0; i < BENCH_DIR_FILES; i++) {
+        reqs[i].filename = names + i * 9;
+        reqs[i].offset = 0;
+        reqs[i].length = BENCH_BATCH_BYTES;
+        reqs[i].buffer = buffer + i * BENCH_BATCH_BYTES;
+    }
+    start = ktime_ns();
+    int reads = fatReadBatch(reqs, BENCH_DIR_FILES);
+    uint64_t ns = ktime_ns() - start;
+    total = 0;
+    for (uint32_t i = 0; i < BENCH_DIR_FILES; i++) {
+        total += reqs[i].result > 0 ? reqs[i].result : 0;
+    }
+    bench_report("batch_read", BENCH_DIR_FILES, 1, total, ns);
+    kprintf("# batch_read,%u,disk_reads,%d\n", BENCH_DIR_FILES, reads);
+
+    kfree(names);
+    kfree(reqs);
+}
+
+// Raw disk_read throughput for 1..256 sectors per call, followed by how
+// much of that time the CPU sat in the idle thread
+static void bench_disk(uint8_t *buffer) {
+    for (uint32_t count = 1; count <= 256; count *= 2) {
+        uint32_t ops = 0;
+        uint64_t idle_start = sched_idle_cycles();
+        uint64_t start = ktime_ns();
+
+        for (uint32_t lba = 0; lba < BENCH_DISK_SECTORS; lba += count) {
+            if (disk_read(lba, count, buffer) != 0) {
+                kprintf("# disk_read failed at LBA %u\n", lba);
+                return;
+            }
+            ops++;
+        }
+
+        bench_report("disk_read", count, ops, BENCH_DISK_SECTORS * 512, ktime_ns() - start);
+        kprintf("# disk_read,%u,idle_us,%u\n", count,
+                (uint32_t)udiv64(cycles_to_ns(sched_idle_cycles() - idle_start), 1000, 0));
+    }
+}
+
+/**
+ * bench_run - Run the storage benchmark suite
+ *
+ * Expects fatInit() to have succeeded. Tests whose files are missing
+ * are skipped with a comment line.
+ */
+void bench_run(void) {
+    uint8_t *buffer = (uint8_t*)kmalloc(256 * 512);
+    if (!buffer) {
+        print_string("# bench: out of memory\n");
+        return;
+    }
+
+    kprintf("# TSC %u kHz\n", tsc_khz);
+    print_string("BENCH,test,param,ops,bytes,total_us,avg_ns,kib_per_s\n");
+
+    FAT_FileHandle probe;
+    if (fatOpen(BENCH_FILE, &probe) == 0) {
+        bench_sequential(buffer);
+        bench_random(buffer);
+    } else {
+        print_string("# " BENCH_FILE " not found, skipping read tests\n");
+    }
+
+    bench_open();
+    bench_batch(buffer);
+    bench_disk(buffer);
+
+    print_string("# bench done\n");
+    kfree(buffer);
+}
@@ -0,0 +1,7 @@
+// bench.h - Boot-time storage benchmarks
+#ifndef BENCH_H
+#define BENCH_H
+
+void bench_run(void);
+
+#endif // BENCH_H
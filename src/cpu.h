@@ -0,0 +1,59 @@
+// cpu.h - CPUID and model-specific register helpers
+#include <stdint.h>
+#ifndef CPU_H
+#define CPU_H
+
+#define EFLAGS_ID           (1 << 21)
+#define CPUID_EDX_APIC      (1 << 9)
+#define CPUID_EDX_FXSR      (1 << 24)
+#define CPUID_EDX_SSE2      (1 << 26)
+#define CPUID_ECX_SSE42     (1 << 20)
+
+// CPUID only exists if EFLAGS.ID can be toggled
+static inline int cpuid_supported(void) {
+    uint32_t before, after;
+    __asm__ volatile (
+        "pushfl\n\t"
+        "pushfl\n\t"
+        "popl %0\n\t"
+        "movl %0, %1\n\t"
+        "xorl %2, %1\n\t"
+        "pushl %1\n\t"
+        "popfl\n\t"
+        "pushfl\n\t"
+        "popl %1\n\t"
+        "popfl"
+        : "=&r"(before), "=&r"(after)
+        : "i"(EFLAGS_ID));
+    return ((before ^ after) & EFLAGS_ID) != 0;
+}
+
+// EDX feature flags of CPUID leaf 1, or 0 without CPUID
+static inline uint32_t cpuid_features_edx(void) {
+    if (!cpuid_supported()) {
+        return 0;
+    }
+
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return edx;
+}
+
+// ECX feature flags of CPUID leaf 1, or 0 without CPUID
+static inline uint32_t cpuid_features_ecx(void) {
+    if (!cpuid_supported()) {
+        return 0;
+    }
+
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return ecx;
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif // CPU_H
@@ -0,0 +1,111 @@
+// crc32c.c - CRC-32C with slicing-by-8 tables or the SSE4.2 instruction
+//
+// Built into the kernel and into the host tools, so it uses nothing but
+// plain C and, behind crc32c_sse42, the crc32 instruction. That works on
+// general registers, so it is fine outside simd.c.
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78      // Reversed Castagnoli polynomial
+
+int crc32c_sse42 = 0;
+
+// crc32c_table[k][b]: CRC of byte b followed by k zero bytes
+static uint32_t crc32c_table[8][256];
+static int crc32c_tables_ready = 0;
+
+static void crc32c_build_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+
+    crc32c_tables_ready = 1;
+}
+
+void crc32c_init(int use_sse42) {
+    if (!crc32c_tables_ready) {
+        crc32c_build_tables();
+    }
+#if defined(__i386__) || defined(__x86_64__)
+    crc32c_sse42 = use_sse42;
+#else
+    (void)use_sse42;
+#endif
+}
+
+// 32-bit word at @p, any alignment, without breaking the aliasing rules;
+// the __builtin_ form is still inlined under -ffreestanding
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Eight bytes per step: each byte indexes the table for its distance
+// from the end of the step, and the results are XORed together
+static uint32_t crc32c_sliced(uint32_t crc, const uint8_t *p, size_t n) {
+    while (n && ((uintptr_t)p & 3)) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        n--;
+    }
+
+    while (n >= 8) {
+        uint32_t lo = load32(p) ^ crc;
+        uint32_t hi = load32(p + 4);
+        crc = crc32c_table[7][lo & 0xFF] ^
+              crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^
+              crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^
+              crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^
+              crc32c_table[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+
+    while (n--) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t n) {
+    while (n >= 4) {
+        __asm__ ("crc32l %1, %0" : "+r"(crc) : "rm"(load32(p)));
+        p += 4;
+        n -= 4;
+    }
+    while (n--) {
+        __asm__ ("crc32b %1, %0" : "+r"(crc) : "rm"(*p++));
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t n) {
+    const uint8_t *p = (const uint8_t*)buf;
+    crc = ~crc;
+
+#if defined(__i386__) || defined(__x86_64__)
+    if (crc32c_sse42) {
+        return ~crc32c_hw(crc, p, n);
+    }
+#endif
+
+    if (!crc32c_tables_ready) {
+        crc32c_build_tables();
+    }
+    return ~crc32c_sliced(crc, p, n);
+}
@@ -0,0 +1,20 @@
+// crc32c.h - CRC-32C (Castagnoli), as used by iSCSI, ext4 and SSE4.2
+#include <stdint.h>
+#include <stddef.h>
+#ifndef CRC32C_H
+#define CRC32C_H
+
+// Select the kernel: the SSE4.2 crc32 instruction if @use_sse42 is set
+// (the caller checks CPUID), slicing-by-8 tables otherwise. The tables
+// are built on first use either way.
+void crc32c_init(int use_sse42);
+
+// Nonzero once crc32c_init picked the SSE4.2 kernel
+extern int crc32c_sse42;
+
+// Continue a CRC over @n more bytes. Start with 0; the result of one call
+// can be passed to the next, so crc32c(crc32c(0, a, x), a + x, y) equals
+// crc32c(0, a, x + y).
+uint32_t crc32c(uint32_t crc, const void *buf, size_t n);
+
+#endif // CRC32C_H
@@ -0,0 +1,33 @@
+// disk.h - Disk access (implemented in kernel_main.c): the ATA PIO drive,
+// or the RAM disk from ramdisk.c when one is attached
+#include <stdint.h>
+#include "async.h"
+#ifndef DISK_H
+#define DISK_H
+
+// An asynchronous read, filled in by disk_read_async() and the IRQ14
+// handler. Only one request is on the drive at a time.
+typedef struct {
+    uint8_t *buffer;
+    uint32_t count;                 // Sectors requested
+    volatile uint32_t sectors_done;
+    volatile int in_flight;
+    int result;                     // 0 or -1, valid once done is signaled
+    uint64_t submit_cycles;
+    uint64_t complete_cycles;
+    async_event_t done;
+} disk_request_t;
+
+int disk_read(uint32_t sector, uint32_t count, void *buffer);
+
+// Pointer to the sectors in memory when the disk is a RAM disk
+// Returns: The pointer, or 0 for the ATA drive or an out-of-range request
+const void *disk_map(uint32_t sector, uint32_t count);
+
+// Start reading @count sectors into @buffer and return; @req->done is
+// signaled from the interrupt handler when the data is in. Blocks only
+// while another request holds the drive.
+// Returns: 0 if the request was issued, -1 otherwise
+int disk_read_async(uint32_t sector, uint32_t count, void *buffer, disk_request_t *req);
+
+#endif // DISK_H
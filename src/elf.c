@@ -0,0 +1,112 @@
+// elf.c - ELF32 loader that streams PT_LOAD segments from the FAT volume
+//
+// Only the ELF header and program header table are read into local
+// buffers. Each segment is then read by fatRead directly to its load
+// address, so no buffer the size of the file is ever needed. fatRead
+// moves whole clusters straight into the destination.
+#include <string.h>
+#include "elf.h"
+#include "fat.h"
+#include "page.h"
+
+// From kernel.ld; programs must load above the kernel image
+extern char _end_kernel[];
+
+static int elf_read_at(FAT_FileHandle *file, uint32_t offset, void *dest, uint32_t size) {
+    if (fatSeek(file, offset) != 0) {
+        return -1;
+    }
+    return fatRead(file, dest, size) == (int)size ? 0 : -1;
+}
+
+/**
+ * elf_load - Load a static ELF32 i386 executable from the FAT volume
+ * 
+ * Validates the header, reads every PT_LOAD segment to its virtual address
+ * (identity mapped) and zero-fills the .bss part (memsz beyond filesz).
+ * Segments must lie above _end_kernel and may not wrap around.
+ * 
+ * @filename: 8.3 name of the executable
+ * @image: Filled in with the entry point and loaded segments
+ * 
+ * Returns: 0 on success, -1 on failure
+ */
+int elf_load(const char *filename, ELF_Image *image) {
+    FAT_FileHandle file;
+    Elf32_Ehdr ehdr;
+    Elf32_Phdr phdrs[ELF_MAX_SEGMENTS];
+
+    if (!image || fatOpen(filename, &file) != 0) {
+        return -1;
+    }
+
+    if (elf_read_at(&file, 0, &ehdr, sizeof(ehdr)) != 0) {
+        return -1;
+    }
+
+    if (ehdr.magic != ELF_MAGIC || ehdr.class != ELF_CLASS_32 ||
+        ehdr.data != ELF_DATA_LSB || ehdr.type != ELF_TYPE_EXEC ||
+        ehdr.machine != ELF_MACHINE_386 ||
+        ehdr.phentsize != sizeof(Elf32_Phdr) ||
+        ehdr.phnum == 0 || ehdr.phnum > ELF_MAX_SEGMENTS) {
+        return -1;
+    }
+
+    if (elf_read_at(&file, ehdr.phoff, phdrs, ehdr.phnum * sizeof(Elf32_Phdr)) != 0) {
+        return -1;
+    }
+
+    image->entry = ehdr.entry;
+    image->num_segments = 0;
+
+    for (uint32_t i = 0; i < ehdr.phnum; i++) {
+        Elf32_Phdr *ph = &phdrs[i];
+
+        if (ph->type != ELF_PT_LOAD || ph->memsz == 0) {
+            continue;
+        }
+
+        if (ph->filesz > ph->memsz ||
+            ph->vaddr < (uint32_t)_end_kernel ||
+            ph->vaddr + ph->memsz < ph->vaddr ||
+            ph->offset + ph->filesz < ph->offset ||
+            ph->offset + ph->filesz > file.file_size) {
+            return -1;
+        }
+
+        // The frames must not also be handed out by the page allocator
+        if (page_reserve(ph->vaddr & ~(PAGE_SIZE - 1), ph->vaddr + ph->memsz) != 0) {
+            return -1;
+        }
+
+        // File-backed part, read in place
+        if (ph->filesz && elf_read_at(&file, ph->offset, (void*)ph->vaddr, ph->filesz) != 0) {
+            return -1;
+        }
+
+        // .bss; memset fills whole dwords with rep stosd
+        if (ph->memsz > ph->filesz) {
+            memset((uint8_t*)ph->vaddr + ph->filesz, 0, ph->memsz - ph->filesz);
+        }
+
+        image->segments[image->num_segments].vaddr = ph->vaddr;
+        image->segments[image->num_segments].filesz = ph->filesz;
+        image->segments[image->num_segments].memsz = ph->memsz;
+        image->num_segments++;
+    }
+
+    return image->num_segments ? 0 : -1;
+}
+
+/**
+ * elf_exec - Call the entry point of a loaded image
+ * 
+ * The program runs on the kernel stack as a plain function call,
+ * int entry(void).
+ * 
+ * Returns: The program's return value
+ */
+int elf_exec(const ELF_Image *image) {
+    int (*entry)(void) = (int (*)(void))image->entry;
+    return entry();
+}
@@ -0,0 +1,86 @@
+// elf.h - ELF32 program loader
+#include <stdint.h>
+#ifndef ELF_H
+#define ELF_H
+
+#define ELF_MAGIC       0x464C457F  // "\x7FELF" read as a little-endian word
+#define ELF_CLASS_32    1
+#define ELF_DATA_LSB    1
+#define ELF_TYPE_EXEC   2
+#define ELF_MACHINE_386 3
+#define ELF_PT_LOAD     1
+#define ELF_SHT_SYMTAB  2
+#define ELF_STT_FUNC    2
+#define ELF_ST_TYPE(info) ((info) & 0xF)
+
+#define ELF_MAX_SEGMENTS 16
+
+typedef struct {
+    uint32_t magic;
+    uint8_t  class;
+    uint8_t  data;
+    uint8_t  version;
+    uint8_t  pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version2;
+    uint32_t entry;
+    uint32_t phoff;                 // Offset of the program header table
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed)) Elf32_Ehdr;
+
+typedef struct {
+    uint32_t type;
+    uint32_t offset;                // Segment data in the file
+    uint32_t vaddr;                 // Load address
+    uint32_t paddr;
+    uint32_t filesz;                // Bytes backed by the file
+    uint32_t memsz;                 // Bytes in memory; the rest is .bss
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed)) Elf32_Phdr;
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;                  // ELF_SHT_*
+    uint32_t flags;
+    uint32_t addr;                  // Where the section is in memory, 0 if not loaded
+    uint32_t offset;
+    uint32_t size;
+    uint32_t link;                  // For a symbol table: its string table section
+    uint32_t info;
+    uint32_t addralign;
+    uint32_t entsize;
+} __attribute__((packed)) Elf32_Shdr;
+
+typedef struct {
+    uint32_t name;                  // Offset in the string table
+    uint32_t value;
+    uint32_t size;
+    uint8_t  info;                  // Type in the low 4 bits
+    uint8_t  other;
+    uint16_t shndx;
+} __attribute__((packed)) Elf32_Sym;
+
+// What elf_load placed in memory
+typedef struct {
+    uint32_t entry;
+    uint32_t num_segments;
+    struct {
+        uint32_t vaddr;
+        uint32_t filesz;
+        uint32_t memsz;
+    } segments[ELF_MAX_SEGMENTS];
+} ELF_Image;
+
+int elf_load(const char *filename, ELF_Image *image);
+int elf_exec(const ELF_Image *image);
+
+#endif // ELF_H
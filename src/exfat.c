@@ -0,0 +1,799 @@
+// exfat.c - Read-only exFAT filesystem driver
+//
+// Like fat.c, only depends on disk_read/disk_map, kmalloc/kfree and the
+// string functions, so the host test harness in tests/ builds it as is.
+// Files are opened from the root directory by name; names are compared
+// through the volume's up-case table, as exFAT requires.
+#include <string.h>
+#include "exfat.h"
+#include "prof.h"
+
+// MBR partition table entry, used to find the volume on a partitioned disk
+typedef struct {
+    uint8_t  status;                // 0x80 = bootable
+    uint8_t  chs_first[3];
+    uint8_t  type;                  // Partition type, 0 = unused
+    uint8_t  chs_last[3];
+    uint32_t lba_start;             // First sector of the partition
+    uint32_t sector_count;
+} __attribute__((packed)) MBR_PartitionEntry;
+
+#define MBR_PARTITION_TABLE 446
+
+// Directories are at most 256 MiB; a looping chain stops there
+#define EXFAT_DIR_MAX_BYTES     (256u << 20)
+#define EXFAT_ATTR_DIRECTORY    0x10
+
+static EXFAT_State g_exfat_state = {0};
+
+static bool is_exfat_boot_sector(const EXFAT_BootSector *bs) {
+    return memcmp(bs->fs_name, "EXFAT   ", 8) == 0;
+}
+
+// Checksum of the boot region: a rotate right and add over every byte but
+// VolumeFlags and PercentInUse in the boot sector
+static uint32_t boot_checksum(uint32_t sum, const uint8_t *data, uint32_t len, bool boot_sector) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (boot_sector && (i == 106 || i == 107 || i == 112)) {
+            continue;
+        }
+        sum = ((sum & 1) ? 0x80000000 : 0) + (sum >> 1) + data[i];
+    }
+    return sum;
+}
+
+/**
+ * check_boot_region - Verify the checksum sector of the main boot region
+ *
+ * @sector: Scratch buffer of 512 bytes
+ * @unit_shift: log2(512-byte sectors per exFAT sector)
+ *
+ * Sector 11 of the boot region repeats the checksum of sectors 0-10, so
+ * a torn or corrupt boot region is caught before any field is trusted.
+ *
+ * Returns: 0 if the checksum matches, -1 otherwise
+ */
+static int check_boot_region(uint8_t *sector, uint32_t unit_shift) {
+    uint32_t lba = g_exfat_state.partition_lba;
+    uint32_t summed = EXFAT_BOOT_CHECKSUM_SECTORS << unit_shift;
+    uint32_t total = EXFAT_BOOT_REGION_SECTORS << unit_shift;
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < total; i++) {
+        if (disk_read(lba + i, 1, sector) != 0) {
+            return -1;
+        }
+        if (i < summed) {
+            sum = boot_checksum(sum, sector, 512, i == 0);
+            continue;
+        }
+        const uint32_t *stored = (const uint32_t*)sector;
+        for (uint32_t j = 0; j < 512 / 4; j++) {
+            if (stored[j] != sum) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Helper function: Sanity-check the fields the driver relies on
+static bool boot_sector_valid(const EXFAT_BootSector *bs) {
+    for (uint32_t i = 0; i < sizeof(bs->must_be_zero); i++) {
+        if (bs->must_be_zero[i] != 0) {
+            return false;
+        }
+    }
+
+    uint32_t bps_shift = bs->bytes_per_sector_shift;
+    if (bps_shift < 9 || bps_shift > 12 || bs->sectors_per_cluster_shift > 25 - bps_shift) {
+        return false;
+    }
+    // Whole clusters must fit one disk_read
+    if ((1u << (bps_shift - 9 + bs->sectors_per_cluster_shift)) > EXFAT_MAX_READ_SECTORS) {
+        return false;
+    }
+    if (bs->num_fats != 1 && bs->num_fats != 2) {
+        return false;
+    }
+    if (bs->cluster_count == 0 || bs->cluster_count > 0xFFFFFFF5 ||
+        bs->root_cluster < 2 || bs->root_cluster - 2 >= bs->cluster_count) {
+        return false;
+    }
+    // The FAT has an entry for every cluster, plus the two reserved ones
+    return ((uint64_t)bs->fat_length << bps_shift) >= ((uint64_t)bs->cluster_count + 2) * 4;
+}
+
+/**
+ * fat_window_load - Bring a FAT sector into the window
+ *
+ * @sector: 512-byte sector of the FAT, counted from its start
+ *
+ * The window covers EXFAT_WINDOW_SECTORS aligned sectors around @sector.
+ * On a RAM disk it points into the image instead of copying.
+ *
+ * Returns: 0 on success, -1 on a read error or past the end of the FAT
+ */
+static int fat_window_load(uint32_t sector) {
+    if (sector >= g_exfat_state.fat_sectors) {
+        return -1;
+    }
+
+    uint32_t first = sector & ~(EXFAT_WINDOW_SECTORS - 1);
+    uint32_t count = g_exfat_state.fat_sectors - first;
+    if (count > EXFAT_WINDOW_SECTORS) {
+        count = EXFAT_WINDOW_SECTORS;
+    }
+
+    uint32_t lba = g_exfat_state.fat_start_sector + first;
+    const uint8_t *window = (const uint8_t*)disk_map(lba, count);
+    if (!window) {
+        if (disk_read(lba, count, g_exfat_state.fat_window_buf) != 0) {
+            g_exfat_state.fat_window_count = 0;
+            return -1;
+        }
+        window = g_exfat_state.fat_window_buf;
+    }
+
+    g_exfat_state.fat_window = window;
+    g_exfat_state.fat_window_first = first;
+    g_exfat_state.fat_window_count = count;
+    return 0;
+}
+
+// Next cluster in a FAT chain. End-of-chain, bad-cluster, free and
+// out-of-range entries, and unreadable FAT sectors, all end the chain.
+static uint32_t get_next_cluster(uint32_t cluster) {
+    if (cluster < 2 || cluster - 2 >= g_exfat_state.cluster_count) {
+        return EXFAT_CHAIN_END;
+    }
+
+    uint32_t sector = cluster / (512 / 4);
+    if (sector - g_exfat_state.fat_window_first >= g_exfat_state.fat_window_count &&
+        fat_window_load(sector) != 0) {
+        return EXFAT_CHAIN_END;
+    }
+    uint32_t next = ((const uint32_t*)g_exfat_state.fat_window)[cluster - g_exfat_state.fat_window_first * (512 / 4)];
+    return (next < 2 || next - 2 >= g_exfat_state.cluster_count) ? EXFAT_CHAIN_END : next;
+}
+
+// Helper function: Get first sector of a cluster
+static inline uint32_t cluster_to_sector(uint32_t cluster) {
+    return ((cluster - 2) << g_exfat_state.cluster_shift) + g_exfat_state.heap_start_sector;
+}
+
+// The cluster after @cluster in @handle's data. A NoFatChain stream
+// continues with the next cluster on disk and never touches the FAT.
+static inline uint32_t next_in_file(const EXFAT_FileHandle *handle, uint32_t cluster) {
+    if (handle->contiguous) {
+        return cluster - 2 + 1 < g_exfat_state.cluster_count ? cluster + 1 : EXFAT_CHAIN_END;
+    }
+    return get_next_cluster(cluster);
+}
+
+// A whole cluster for a partial read: in place on a RAM disk, otherwise
+// through the one-cluster cache. Returns NULL on a read error.
+static const uint8_t *cluster_data(uint32_t cluster) {
+    uint32_t sector = cluster_to_sector(cluster);
+    uint32_t count = 1u << g_exfat_state.cluster_shift;
+    const uint8_t *data = (const uint8_t*)disk_map(sector, count);
+    if (data) {
+        return data;
+    }
+
+    if (g_exfat_state.cached_cluster != cluster) {
+        if (disk_read(sector, count, g_exfat_state.cluster_cache) != 0) {
+            g_exfat_state.cached_cluster = 0;
+            return 0;
+        }
+        g_exfat_state.cached_cluster = cluster;
+    }
+    return g_exfat_state.cluster_cache;
+}
+
+static void handle_init(EXFAT_FileHandle *handle, uint32_t first_cluster, uint32_t size,
+                        uint32_t valid_size, bool contiguous) {
+    handle->first_cluster = first_cluster;
+    handle->current_cluster = first_cluster >= 2 ? first_cluster : EXFAT_CHAIN_END;
+    handle->file_size = size;
+    handle->valid_size = valid_size < size ? valid_size : size;
+    handle->position = 0;
+    handle->contiguous = contiguous;
+    handle->is_open = true;
+}
+
+/**
+ * exfat_read_locked - Read data from an open file
+ *
+ * Reads up to @size bytes from the current position and advances it.
+ * Whole clusters go straight into @buffer; a NoFatChain file is one
+ * extent, so those are read EXFAT_MAX_READ_SECTORS at a time without a
+ * single FAT lookup. Chained files read runs of adjacent clusters like
+ * fat.c. Bytes between ValidDataLength and DataLength read as zeros.
+ *
+ * The current cluster always belongs to the position, or to the valid
+ * size once the position is past it; exfat_seek_locked relies on that.
+ *
+ * Returns: Number of bytes read, or -1 on error
+ */
+static int exfat_read_locked(EXFAT_FileHandle *handle, void *buffer, uint32_t size) {
+    if (!g_exfat_state.initialized || !handle || !handle->is_open || !buffer) {
+        return -1;
+    }
+
+    if (handle->position >= handle->file_size) {
+        return 0;
+    }
+    if (size > handle->file_size - handle->position) {
+        size = handle->file_size - handle->position;
+    }
+
+    uint8_t *out = (uint8_t*)buffer;
+    uint32_t bytes_read = 0;
+    uint32_t cluster_size = g_exfat_state.cluster_size;
+    uint32_t size_shift = g_exfat_state.cluster_shift + 9;
+
+    while (bytes_read < size) {
+        uint32_t remaining = size - bytes_read;
+
+        // Past ValidDataLength nothing was ever written: zeros, no I/O
+        if (handle->position >= handle->valid_size) {
+            memset(out + bytes_read, 0, remaining);
+            bytes_read += remaining;
+            handle->position += remaining;
+            break;
+        }
+        if (remaining > handle->valid_size - handle->position) {
+            remaining = handle->valid_size - handle->position;
+        }
+        if (handle->current_cluster == EXFAT_CHAIN_END) {
+            break;
+        }
+
+        uint32_t cluster_offset = handle->position & (cluster_size - 1);
+        if (cluster_offset == 0 && remaining >= cluster_size) {
+            uint32_t first = handle->current_cluster;
+            uint32_t want = remaining >> size_shift;
+            if (want > EXFAT_MAX_READ_SECTORS >> g_exfat_state.cluster_shift) {
+                want = EXFAT_MAX_READ_SECTORS >> g_exfat_state.cluster_shift;
+            }
+
+            uint32_t run = 1;
+            if (handle->contiguous) {
+                // exfat_open_locked checked the extent fits the heap
+                run = want;
+            } else {
+                for (uint32_t last = first; run < want; run++) {
+                    uint32_t next = get_next_cluster(last);
+                    if (next != last + 1) break;
+                    last = next;
+                }
+            }
+
+            if (disk_read(cluster_to_sector(first), run << g_exfat_state.cluster_shift, out + bytes_read) != 0) {
+                return -1;
+            }
+
+            bytes_read += run << size_shift;
+            handle->position += run << size_shift;
+            handle->current_cluster = next_in_file(handle, first + run - 1);
+            continue;
+        }
+
+        // Partial cluster
+        uint32_t bytes_to_read = cluster_size - cluster_offset;
+        if (bytes_to_read > remaining) {
+            bytes_to_read = remaining;
+        }
+
+        const uint8_t *data = cluster_data(handle->current_cluster);
+        if (!data) {
+            return -1;
+        }
+        memcpy(out + bytes_read, data + cluster_offset, bytes_to_read);
+
+        bytes_read += bytes_to_read;
+        handle->position += bytes_to_read;
+        if ((handle->position & (cluster_size - 1)) == 0) {
+            handle->current_cluster = next_in_file(handle, handle->current_cluster);
+        }
+    }
+
+    return bytes_read;
+}
+
+/**
+ * exfat_seek_locked - Move the file position of an open file
+ *
+ * A NoFatChain file finds the cluster by arithmetic. A chained file walks
+ * the chain, from the current cluster when seeking forward. Offsets past
+ * the end of the file are clamped to the file size.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+static int exfat_seek_locked(EXFAT_FileHandle *handle, uint32_t offset) {
+    if (!g_exfat_state.initialized || !handle || !handle->is_open) {
+        return -1;
+    }
+
+    if (offset > handle->file_size) {
+        offset = handle->file_size;
+    }
+
+    uint32_t size_shift = g_exfat_state.cluster_shift + 9;
+    uint32_t valid = handle->valid_size;
+    uint32_t target_index = (offset < valid ? offset : valid) >> size_shift;
+
+    if (handle->first_cluster < 2) {
+        handle->current_cluster = EXFAT_CHAIN_END;
+    } else if (handle->contiguous) {
+        handle->current_cluster = handle->first_cluster + target_index;
+    } else {
+        uint32_t current_index = (handle->position < valid ? handle->position : valid) >> size_shift;
+
+        // Chains only go forward; restart from the first cluster otherwise
+        if (target_index < current_index || handle->current_cluster == EXFAT_CHAIN_END) {
+            handle->current_cluster = handle->first_cluster;
+            current_index = 0;
+        }
+        while (current_index < target_index && handle->current_cluster != EXFAT_CHAIN_END) {
+            handle->current_cluster = get_next_cluster(handle->current_cluster);
+            current_index++;
+        }
+    }
+
+    handle->position = offset;
+    return 0;
+}
+
+// Open the allocation bitmap of the active FAT as a file
+static void bitmap_open(EXFAT_FileHandle *bitmap) {
+    handle_init(bitmap, g_exfat_state.bitmap_cluster, g_exfat_state.bitmap_length,
+                g_exfat_state.bitmap_length, false);
+}
+
+// NoFatChain data has no chain to cross-check, so the allocation bitmap
+// must agree that every cluster of the extent is in use
+static bool extent_allocated(uint32_t first_cluster, uint32_t clusters) {
+    EXFAT_FileHandle bitmap;
+    bitmap_open(&bitmap);
+
+    uint32_t start = first_cluster - 2;
+    if (exfat_seek_locked(&bitmap, start / 8) != 0) {
+        return false;
+    }
+
+    uint8_t byte = 0;
+    for (uint32_t bit = start; bit < start + clusters; bit++) {
+        if ((bit == start || (bit & 7) == 0) && exfat_read_locked(&bitmap, &byte, 1) != 1) {
+            return false;
+        }
+        if (!(byte & (1 << (bit & 7)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline uint16_t upcase(uint16_t c) {
+    return c < EXFAT_UPCASE_CHARS ? g_exfat_state.upcase[c] : c;
+}
+
+// Identity plus a-z, for a volume without an up-case table
+static void upcase_default(void) {
+    for (uint32_t c = 0; c < EXFAT_UPCASE_CHARS; c++) {
+        g_exfat_state.upcase[c] = c;
+    }
+    for (uint32_t c = 'a'; c <= 'z'; c++) {
+        g_exfat_state.upcase[c] = c - 'a' + 'A';
+    }
+}
+
+/**
+ * load_upcase - Read the volume's up-case table
+ *
+ * @entry: The up-case table directory entry
+ *
+ * The table is usually stored compressed: 0xFFFF followed by a count
+ * stands for that many characters that map to themselves. The whole table
+ * is checksummed, but only the first EXFAT_UPCASE_CHARS are kept.
+ *
+ * Returns: 0 on success, -1 on a read error or a bad checksum
+ */
+static int load_upcase(const EXFAT_DirEntry *entry) {
+    // 65536 characters of two bytes each at most
+    if (entry->system.data_length > 0x20000) {
+        return -1;
+    }
+
+    EXFAT_FileHandle table;
+    uint32_t length = (uint32_t)entry->system.data_length;
+    handle_init(&table, entry->system.first_cluster, length, length, false);
+
+    for (uint32_t c = 0; c < EXFAT_UPCASE_CHARS; c++) {
+        g_exfat_state.upcase[c] = c;
+    }
+
+    uint32_t checksum = 0;
+    uint32_t index = 0;
+    bool identity_run = false;
+    uint8_t chunk[256];
+    int n;
+    while ((n = exfat_read_locked(&table, chunk, sizeof(chunk))) > 0) {
+        checksum = boot_checksum(checksum, chunk, n, false);
+        for (int i = 0; i + 1 < n; i += 2) {
+            uint16_t c = chunk[i] | (chunk[i + 1] << 8);
+            if (identity_run) {
+                // upcase[] already maps these to themselves
+                index += c;
+                identity_run = false;
+            } else if (c == 0xFFFF) {
+                identity_run = true;
+            } else {
+                if (index < EXFAT_UPCASE_CHARS) {
+                    g_exfat_state.upcase[index] = c;
+                }
+                index++;
+            }
+        }
+    }
+
+    if (n < 0 || table.position != length || checksum != entry->system.checksum) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * next_entry_set - Read the next entry set of a directory
+ *
+ * @dir: Directory opened as a file
+ * @set: Receives up to EXFAT_MAX_SET entries
+ *
+ * A file entry is read together with its secondary entries; any other
+ * entry, such as the bitmap, up-case table, volume label or a deleted
+ * entry, comes back alone.
+ *
+ * Returns: Number of entries in @set, 0 at the end of the directory,
+ *          -1 on a read error
+ */
+static int next_entry_set(EXFAT_FileHandle *dir, EXFAT_DirEntry *set) {
+    int n = exfat_read_locked(dir, &set[0], sizeof(EXFAT_DirEntry));
+    if (n != sizeof(EXFAT_DirEntry)) {
+        return n < 0 ? -1 : 0;
+    }
+    if (set[0].entry_type == EXFAT_ENTRY_END) {
+        return 0;
+    }
+    if (set[0].entry_type != EXFAT_ENTRY_FILE ||
+        set[0].file.secondary_count < 2 || set[0].file.secondary_count >= EXFAT_MAX_SET) {
+        return 1;
+    }
+
+    uint32_t bytes = set[0].file.secondary_count * sizeof(EXFAT_DirEntry);
+    n = exfat_read_locked(dir, &set[1], bytes);
+    if (n != (int)bytes) {
+        return n < 0 ? -1 : 0;
+    }
+    return set[0].file.secondary_count + 1;
+}
+
+// Checksum of an entry set, leaving out the checksum field itself
+static uint16_t set_checksum(const EXFAT_DirEntry *set, int count) {
+    const uint8_t *bytes = (const uint8_t*)set;
+    uint16_t sum = 0;
+    for (uint32_t i = 0; i < count * sizeof(EXFAT_DirEntry); i++) {
+        if (i == 2 || i == 3) {
+            continue;
+        }
+        sum = ((sum & 1) ? 0x8000 : 0) + (sum >> 1) + bytes[i];
+    }
+    return sum;
+}
+
+// Hash of the up-cased name, as stored in the stream extension
+static uint16_t name_hash(const char *name, uint32_t len) {
+    uint16_t hash = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        uint16_t c = upcase((uint8_t)name[i]);
+        hash = ((hash & 1) ? 0x8000 : 0) + (hash >> 1) + (c & 0xFF);
+        hash = ((hash & 1) ? 0x8000 : 0) + (hash >> 1) + (c >> 8);
+    }
+    return hash;
+}
+
+// Does the file entry set @set name the file @name? The hash rules out
+// nearly every other name before the characters are compared.
+static bool set_matches(const EXFAT_DirEntry *set, int count, const char *name, uint32_t len, uint16_t hash) {
+    if (set[0].entry_type != EXFAT_ENTRY_FILE || count < 3 ||
+        (set[0].file.attributes & EXFAT_ATTR_DIRECTORY)) {
+        return false;
+    }
+
+    const EXFAT_DirEntry *stream = &set[1];
+    if (stream->entry_type != EXFAT_ENTRY_STREAM ||
+        stream->stream.name_length != len || stream->stream.name_hash != hash ||
+        (len + EXFAT_NAME_CHARS - 1) / EXFAT_NAME_CHARS > (uint32_t)count - 2 ||
+        set_checksum(set, count) != set[0].file.set_checksum) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        const EXFAT_DirEntry *part = &set[2 + i / EXFAT_NAME_CHARS];
+        if (part->entry_type != EXFAT_ENTRY_NAME ||
+            upcase(part->name.name[i % EXFAT_NAME_CHARS]) != upcase((uint8_t)name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Open the root directory as a file
+static void root_open(EXFAT_FileHandle *dir) {
+    handle_init(dir, g_exfat_state.boot_sector.root_cluster, EXFAT_DIR_MAX_BYTES,
+                EXFAT_DIR_MAX_BYTES, false);
+}
+
+/**
+ * exfatInit - Initialize the exFAT filesystem driver
+ *
+ * Finds the volume (sector 0, or the first partition of an MBR), checks
+ * the boot region checksum, and reads the allocation bitmap location and
+ * the up-case table from the root directory. The FAT itself is read on
+ * demand through a window of EXFAT_WINDOW_SECTORS.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int exfatInit(void) {
+    uint8_t sector[512];
+    const EXFAT_BootSector *bs = (const EXFAT_BootSector*)sector;
+
+    g_exfat_state.initialized = false;
+
+    if (disk_read(0, 1, sector) != 0 || sector[510] != 0x55 || sector[511] != 0xAA) {
+        return -1;
+    }
+
+    // Partitioned disk: sector 0 is an MBR, mount the first partition
+    g_exfat_state.partition_lba = 0;
+    if (!is_exfat_boot_sector(bs)) {
+        const MBR_PartitionEntry *part = (const MBR_PartitionEntry*)(sector + MBR_PARTITION_TABLE);
+        for (int i = 0; i < 4; i++) {
+            if (part[i].type != 0 && part[i].lba_start != 0) {
+                g_exfat_state.partition_lba = part[i].lba_start;
+                break;
+            }
+        }
+
+        if (g_exfat_state.partition_lba == 0 ||
+            disk_read(g_exfat_state.partition_lba, 1, sector) != 0 ||
+            sector[510] != 0x55 || sector[511] != 0xAA || !is_exfat_boot_sector(bs)) {
+            return -1;
+        }
+    }
+
+    if (!boot_sector_valid(bs)) {
+        return -1;
+    }
+    memcpy(&g_exfat_state.boot_sector, sector, sizeof(EXFAT_BootSector));
+    bs = &g_exfat_state.boot_sector;
+
+    uint32_t unit_shift = bs->bytes_per_sector_shift - 9;
+    if (check_boot_region(sector, unit_shift) != 0) {
+        return -1;
+    }
+
+    // With two FATs, VolumeFlags says which FAT and bitmap are current
+    uint32_t active = (bs->num_fats == 2 && (bs->volume_flags & EXFAT_VOLUME_ACTIVE_FAT)) ? 1 : 0;
+    g_exfat_state.fat_sectors = bs->fat_length << unit_shift;
+    g_exfat_state.fat_start_sector = g_exfat_state.partition_lba + (bs->fat_offset << unit_shift) +
+                                     active * g_exfat_state.fat_sectors;
+    g_exfat_state.heap_start_sector = g_exfat_state.partition_lba + (bs->cluster_heap_offset << unit_shift);
+    g_exfat_state.cluster_shift = unit_shift + bs->sectors_per_cluster_shift;
+    g_exfat_state.cluster_size = 512u << g_exfat_state.cluster_shift;
+    g_exfat_state.cluster_count = bs->cluster_count;
+    g_exfat_state.fat_window_first = EXFAT_CHAIN_END;
+    g_exfat_state.fat_window_count = 0;
+    g_exfat_state.bitmap_cluster = 0;
+    g_exfat_state.bitmap_length = 0;
+
+    // Buffers are kept across remounts since the bump allocator cannot
+    // give them back
+    if (!g_exfat_state.fat_window_buf) {
+        g_exfat_state.fat_window_buf = (uint8_t*)kmalloc(EXFAT_WINDOW_SECTORS * 512);
+        g_exfat_state.upcase = (uint16_t*)kmalloc(EXFAT_UPCASE_CHARS * sizeof(uint16_t));
+        if (!g_exfat_state.fat_window_buf || !g_exfat_state.upcase) {
+            g_exfat_state.fat_window_buf = 0;
+            return -1;
+        }
+    }
+    if (g_exfat_state.cluster_cache_size < g_exfat_state.cluster_size) {
+        g_exfat_state.cluster_cache = (uint8_t*)kmalloc(g_exfat_state.cluster_size);
+        if (!g_exfat_state.cluster_cache) {
+            g_exfat_state.cluster_cache_size = 0;
+            return -1;
+        }
+        g_exfat_state.cluster_cache_size = g_exfat_state.cluster_size;
+    }
+    g_exfat_state.cached_cluster = 0;
+
+    // exfat_read_locked is needed to walk the root directory
+    g_exfat_state.initialized = true;
+    upcase_default();
+
+    EXFAT_FileHandle dir;
+    root_open(&dir);
+    EXFAT_DirEntry set[EXFAT_MAX_SET];
+    bool have_upcase = false;
+    while ((g_exfat_state.bitmap_cluster == 0 || !have_upcase) && next_entry_set(&dir, set) > 0) {
+        if (set[0].entry_type == EXFAT_ENTRY_BITMAP && (set[0].system.flags & 1) == active) {
+            g_exfat_state.bitmap_cluster = set[0].system.first_cluster;
+            g_exfat_state.bitmap_length = (uint32_t)set[0].system.data_length;
+        } else if (set[0].entry_type == EXFAT_ENTRY_UPCASE && !have_upcase) {
+            if (load_upcase(&set[0]) != 0) {
+                break;
+            }
+            have_upcase = true;
+        }
+    }
+
+    // Every volume has a bitmap with a bit per cluster and an up-case table
+    if (!have_upcase || g_exfat_state.bitmap_length < (g_exfat_state.cluster_count + 7) / 8) {
+        g_exfat_state.initialized = false;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * exfat_open_locked - Open a file in the root directory
+ *
+ * @filename: Name of the file, compared without regard to case
+ * @handle: Pointer to file handle structure to initialize
+ *
+ * Files of 4 GiB or more are refused, as the handle is 32-bit like
+ * FAT_FileHandle. A NoFatChain extent must lie within the cluster heap
+ * and be marked in use in the allocation bitmap.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+static int exfat_open_locked(const char *filename, EXFAT_FileHandle *handle) {
+    PROF_SCOPE(exfatOpen);
+
+    if (!g_exfat_state.initialized || !filename || !handle) {
+        return -1;
+    }
+
+    uint32_t len = strlen(filename);
+    if (len == 0 || len > EXFAT_NAME_MAX) {
+        return -1;
+    }
+    uint16_t hash = name_hash(filename, len);
+
+    EXFAT_FileHandle dir;
+    root_open(&dir);
+    EXFAT_DirEntry set[EXFAT_MAX_SET];
+    int n;
+    while ((n = next_entry_set(&dir, set)) > 0) {
+        if (!set_matches(set, n, filename, len, hash)) {
+            continue;
+        }
+
+        const EXFAT_DirEntry *stream = &set[1];
+        uint64_t length = stream->stream.data_length;
+        uint32_t first = stream->stream.first_cluster;
+        bool contiguous = (stream->stream.flags & EXFAT_STREAM_NO_FAT_CHAIN) != 0;
+        if (length > 0xFFFFFFFF) {
+            return -1;
+        }
+        if (length != 0) {
+            if (first < 2 || first - 2 >= g_exfat_state.cluster_count) {
+                return -1;
+            }
+            uint32_t clusters = (((uint32_t)length - 1) >> (g_exfat_state.cluster_shift + 9)) + 1;
+            if (contiguous && (clusters > g_exfat_state.cluster_count - (first - 2) ||
+                               !extent_allocated(first, clusters))) {
+                return -1;
+            }
+        }
+
+        uint64_t valid = stream->stream.valid_data_length;
+        handle_init(handle, first, (uint32_t)length, valid < length ? (uint32_t)valid : (uint32_t)length,
+                    contiguous);
+        return 0;
+    }
+
+    return -1;
+}
+
+// Public entry points: the state, FAT window and cluster cache are shared,
+// so every call runs under the kernel's FAT lock like fat.c's
+
+int exfatOpen(const char *filename, EXFAT_FileHandle *handle) {
+    fat_lock();
+    int ret = exfat_open_locked(filename, handle);
+    fat_unlock();
+    return ret;
+}
+
+int exfatRead(EXFAT_FileHandle *handle, void *buffer, uint32_t size) {
+    PROF_SCOPE(exfatRead);
+    fat_lock();
+    int ret = exfat_read_locked(handle, buffer, size);
+    fat_unlock();
+    return ret;
+}
+
+int exfatSeek(EXFAT_FileHandle *handle, uint32_t offset) {
+    fat_lock();
+    int ret = exfat_seek_locked(handle, offset);
+    fat_unlock();
+    return ret;
+}
+
+/**
+ * exfatVolumeInfo - Report the size and free space of the mounted volume
+ *
+ * The free cluster count comes from the allocation bitmap, which holds a
+ * bit per cluster, so it costs a read of cluster_count / 8 bytes.
+ *
+ * Returns: 0 on success, -1 before exfatInit or on a read error
+ */
+int exfatVolumeInfo(EXFAT_VolumeInfo *info) {
+    if (!g_exfat_state.initialized || !info) {
+        return -1;
+    }
+
+    fat_lock();
+    EXFAT_FileHandle bitmap;
+    bitmap_open(&bitmap);
+    uint32_t count = g_exfat_state.cluster_count;
+    uint32_t used = 0;
+    uint32_t bit = 0;
+    uint8_t chunk[256];
+    int n;
+    while (bit < count && (n = exfat_read_locked(&bitmap, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < n && bit < count; i++, bit += 8) {
+            uint32_t byte = chunk[i];
+            // Bits past the last cluster are not clusters
+            if (count - bit < 8) {
+                byte &= (1u << (count - bit)) - 1;
+            }
+            for (; byte; byte &= byte - 1) {
+                used++;
+            }
+        }
+    }
+    fat_unlock();
+
+    if (bit < count) {
+        return -1;
+    }
+    info->cluster_size = g_exfat_state.cluster_size;
+    info->total_clusters = count;
+    info->free_clusters = count - used;
+    info->serial = g_exfat_state.boot_sector.volume_serial;
+    return 0;
+}
+
+// VFS backend: each inode keeps an EXFAT_FileHandle, as fat.c does
+_Static_assert(sizeof(EXFAT_FileHandle) <= VFS_FS_DATA, "EXFAT_FileHandle does not fit an inode");
+
+static int exfat_vfs_lookup(const char *path, vfs_inode_t *inode) {
+    EXFAT_FileHandle *handle = (EXFAT_FileHandle*)inode->fs_data;
+    if (exfatOpen(path, handle) != 0) {
+        return -1;
+    }
+    inode->size = handle->file_size;
+    return 0;
+}
+
+static int exfat_vfs_read(vfs_inode_t *inode, uint32_t offset, void *buffer, uint32_t size) {
+    EXFAT_FileHandle *handle = (EXFAT_FileHandle*)inode->fs_data;
+    if (handle->position != offset && exfatSeek(handle, offset) != 0) {
+        return -1;
+    }
+    return exfatRead(handle, buffer, size);
+}
+
+const vfs_fs_ops_t exfat_vfs_ops = { "exfat", exfat_vfs_lookup, exfat_vfs_read };
@@ -0,0 +1,174 @@
+// exfat.h - Read-only exFAT filesystem driver
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef EXFAT_H
+#define EXFAT_H
+
+#include "vfs.h"
+
+// exFAT Boot Sector structure (main and backup boot region, sector 0)
+typedef struct {
+    uint8_t  jmp[3];                // Jump instruction
+    char     fs_name[8];            // "EXFAT   "
+    uint8_t  must_be_zero[53];      // Where a FAT BPB would be
+    uint64_t partition_offset;      // Sectors, informational only
+    uint64_t volume_length;         // Sectors
+    uint32_t fat_offset;            // Sectors from the boot sector
+    uint32_t fat_length;            // Sectors per FAT
+    uint32_t cluster_heap_offset;   // Sectors from the boot sector to cluster 2
+    uint32_t cluster_count;         // Clusters in the heap, numbered from 2
+    uint32_t root_cluster;          // First cluster of the root directory
+    uint32_t volume_serial;
+    uint16_t fs_revision;           // 0x0100 for exFAT 1.00
+    uint16_t volume_flags;          // EXFAT_VOLUME_*
+    uint8_t  bytes_per_sector_shift;
+    uint8_t  sectors_per_cluster_shift;
+    uint8_t  num_fats;              // 1, or 2 for TexFAT
+    uint8_t  drive_select;
+    uint8_t  percent_in_use;        // 0xFF if not known
+    uint8_t  reserved[7];
+    uint8_t  boot_code[390];
+    uint16_t signature;             // 0xAA55
+} __attribute__((packed)) EXFAT_BootSector;
+
+#define EXFAT_VOLUME_ACTIVE_FAT     0x0001  // Second FAT and bitmap in use
+
+// The boot checksum covers the first 11 sectors of the boot region and
+// fills sector 11; these bytes change at run time and are left out of it
+#define EXFAT_BOOT_CHECKSUM_SECTORS 11
+#define EXFAT_BOOT_REGION_SECTORS   12
+
+// Directory entry types. Bit 7 marks an entry in use; clearing it deletes
+// the entry, so deleted entries are simply types this driver ignores.
+#define EXFAT_ENTRY_END             0x00
+#define EXFAT_ENTRY_BITMAP          0x81
+#define EXFAT_ENTRY_UPCASE          0x82
+#define EXFAT_ENTRY_LABEL           0x83
+#define EXFAT_ENTRY_FILE            0x85
+#define EXFAT_ENTRY_STREAM          0xC0
+#define EXFAT_ENTRY_NAME            0xC1
+
+// Stream extension flags
+#define EXFAT_STREAM_ALLOC_POSSIBLE 0x01
+#define EXFAT_STREAM_NO_FAT_CHAIN   0x02    // Data is one contiguous extent
+
+// A file entry set is the file entry, a stream extension and 1-17 name
+// entries of 15 UTF-16 characters each (names are at most 255 characters)
+#define EXFAT_NAME_CHARS            15
+#define EXFAT_MAX_SET               19
+#define EXFAT_NAME_MAX              255
+
+// Only this much of the up-case table is kept; file names the kernel asks
+// for are ASCII/Latin-1, anything above maps to itself
+#define EXFAT_UPCASE_CHARS          0x200
+
+// Largest request disk_read accepts
+#define EXFAT_MAX_READ_SECTORS      256
+// Returned for end-of-chain markers
+#define EXFAT_CHAIN_END             0xFFFFFFFF
+// Sectors of the FAT kept in memory; the FAT is never loaded whole
+#define EXFAT_WINDOW_SECTORS        8
+
+// Directory entry, 32 bytes, viewed as whichever type entry_type says
+typedef union {
+    uint8_t entry_type;
+    struct {
+        uint8_t  entry_type;        // EXFAT_ENTRY_FILE
+        uint8_t  secondary_count;   // Entries that follow in the set
+        uint16_t set_checksum;      // Over the whole set but this field
+        uint16_t attributes;        // FAT_ATTR_* bits
+        uint8_t  reserved[26];      // Timestamps, unused here
+    } __attribute__((packed)) file;
+    struct {
+        uint8_t  entry_type;        // EXFAT_ENTRY_STREAM
+        uint8_t  flags;             // EXFAT_STREAM_*
+        uint8_t  reserved1;
+        uint8_t  name_length;       // Characters
+        uint16_t name_hash;         // Over the up-cased name
+        uint16_t reserved2;
+        uint64_t valid_data_length; // Bytes written; the rest reads as zero
+        uint32_t reserved3;
+        uint32_t first_cluster;
+        uint64_t data_length;       // Bytes allocated
+    } __attribute__((packed)) stream;
+    struct {
+        uint8_t  entry_type;        // EXFAT_ENTRY_NAME
+        uint8_t  flags;
+        uint16_t name[EXFAT_NAME_CHARS];
+    } __attribute__((packed)) name;
+    struct {
+        uint8_t  entry_type;        // EXFAT_ENTRY_BITMAP or EXFAT_ENTRY_UPCASE
+        uint8_t  flags;             // Bitmap: bit 0 selects the FAT it goes with
+        uint8_t  reserved1[2];
+        uint32_t checksum;          // Up-case table only
+        uint8_t  reserved2[12];
+        uint32_t first_cluster;
+        uint64_t data_length;
+    } __attribute__((packed)) system;
+} EXFAT_DirEntry;
+
+// Global exFAT driver state
+typedef struct {
+    EXFAT_BootSector boot_sector;
+    uint32_t partition_lba;         // Disk LBA of the boot sector
+    uint32_t fat_start_sector;      // Disk LBA of the active FAT
+    uint32_t fat_sectors;           // 512-byte sectors per FAT
+    uint32_t heap_start_sector;     // Disk LBA of cluster 2
+    uint8_t cluster_shift;          // log2(512-byte sectors per cluster)
+    uint32_t cluster_size;          // Bytes
+    uint32_t cluster_count;
+    const uint8_t *fat_window;      // FAT sectors from fat_window_first
+    uint8_t *fat_window_buf;        // Backing store for fat_window off a RAM disk
+    uint32_t fat_window_first;      // FAT sector at fat_window, EXFAT_CHAIN_END = none
+    uint32_t fat_window_count;      // Sectors valid at fat_window
+    uint32_t bitmap_cluster;        // Allocation bitmap of the active FAT
+    uint32_t bitmap_length;         // Bytes
+    uint16_t *upcase;               // First EXFAT_UPCASE_CHARS of the up-case table
+    uint8_t *cluster_cache;         // Last cluster read for a partial exfatRead
+    uint32_t cluster_cache_size;    // Allocated size of cluster_cache
+    uint32_t cached_cluster;        // Cluster held in cluster_cache, 0 = none
+    bool initialized;
+} EXFAT_State;
+
+// File handle structure
+typedef struct {
+    uint32_t first_cluster;         // First cluster of file
+    uint32_t current_cluster;       // Current cluster being read
+    uint32_t file_size;             // DataLength of the stream
+    uint32_t valid_size;            // ValidDataLength; bytes past it read as zero
+    uint32_t position;              // Current position in file
+    bool contiguous;                // NoFatChain: clusters follow first_cluster
+    bool is_open;
+} EXFAT_FileHandle;
+
+// Size and free space of the mounted volume, from exfatVolumeInfo
+typedef struct {
+    uint32_t cluster_size;          // Bytes
+    uint32_t total_clusters;
+    uint32_t free_clusters;         // Counted in the allocation bitmap
+    uint32_t serial;
+} EXFAT_VolumeInfo;
+
+// Provided by the kernel, as for fat.c:
+// - disk_read(sector, count, buffer): Read 512-byte sectors from disk
+// - disk_map(sector, count): Sectors of a disk held in memory, or NULL
+// - kmalloc(size)/kfree(ptr): Kernel memory
+// - fat_lock()/fat_unlock(): Serialize calls from multiple threads
+extern int disk_read(uint32_t sector, uint32_t count, void *buffer);
+extern const void *disk_map(uint32_t sector, uint32_t count);
+extern void* kmalloc(size_t size);
+extern void kfree(void *ptr);
+extern void fat_lock(void);
+extern void fat_unlock(void);
+
+int exfatInit(void);
+int exfatOpen(const char *filename, EXFAT_FileHandle *handle);
+int exfatRead(EXFAT_FileHandle *handle, void *buffer, uint32_t size);
+int exfatSeek(EXFAT_FileHandle *handle, uint32_t offset);
+int exfatVolumeInfo(EXFAT_VolumeInfo *info);
+
+// For vfs_mount once exfatInit has succeeded
+extern const vfs_fs_ops_t exfat_vfs_ops;
+
+#endif // EXFAT_H
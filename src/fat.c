@@ -0,0 +1,1410 @@
+// fat.c - FAT12/16/32 filesystem driver
+//
+// Only depends on disk_read/disk_map, kmalloc/kfree, crc32c.c and the
+// string functions, so the same file is built into the kernel and into the host
+// test harness in tests/.
+#include <string.h>
+#include "crc32c.h"
+#include "fat.h"
+#include "prof.h"
+#include "trace.h"
+
+// MBR partition table entry, used to find the FAT volume on a partitioned disk
+typedef struct {
+    uint8_t  status;                // 0x80 = bootable
+    uint8_t  chs_first[3];
+    uint8_t  type;                  // Partition type, 0 = unused
+    uint8_t  chs_last[3];
+    uint32_t lba_start;             // First sector of the partition
+    uint32_t sector_count;
+} __attribute__((packed)) MBR_PartitionEntry;
+
+#define MBR_PARTITION_TABLE 446
+
+static FAT_State g_fat_state = {0};
+
+// Helper function: Get total sectors
+static uint32_t get_total_sectors(FAT_BootSector *bs) {
+    return (bs->total_sectors_16 != 0) ? bs->total_sectors_16 : bs->total_sectors_32;
+}
+
+// Helper function: Get sectors per FAT
+static uint32_t get_sectors_per_fat(FAT_BootSector *bs) {
+    return (bs->sectors_per_fat_16 != 0) ? bs->sectors_per_fat_16 : bs->sectors_per_fat_32;
+}
+
+// Helper function: Determine FAT type
+static FAT_Type determine_fat_type(FAT_BootSector *bs) {
+    uint32_t total_sectors = get_total_sectors(bs);
+    uint32_t fat_size = get_sectors_per_fat(bs);
+    uint32_t root_dir_sectors = ((bs->root_entries * 32) + (bs->bytes_per_sector - 1)) / bs->bytes_per_sector;
+    uint32_t data_sectors = total_sectors - (bs->reserved_sectors + (bs->num_fats * fat_size) + root_dir_sectors);
+    uint32_t total_clusters = data_sectors / bs->sectors_per_cluster;
+    
+    if (total_clusters < 4085) {
+        return FAT_TYPE_12;
+    } else if (total_clusters < 65525) {
+        return FAT_TYPE_16;
+    } else {
+        return FAT_TYPE_32;
+    }
+}
+
+// Cluster chain walkers, one set per FAT type, generated by FAT_CHAIN_OPS.
+// fatInit picks the set once, so following a chain costs no switch on
+// the FAT type per link. End-of-chain markers come back as FAT_CHAIN_END.
+typedef struct {
+    uint32_t (*next)(uint32_t cluster);
+    // Store up to @max successors of @cluster; fewer means the chain ended
+    uint32_t (*chain)(uint32_t cluster, uint32_t *links, uint32_t max);
+} FAT_ChainOps;
+
+// FAT12 entries are 12 bits at cluster * 1.5 bytes. Two byte loads
+// replace the unaligned 16-bit one; odd clusters use the upper 12 bits.
+#define FAT12_ENTRY(table, c) \
+    ((((uint32_t)(table)[(c) + ((c) >> 1)] | \
+       ((uint32_t)(table)[(c) + ((c) >> 1) + 1] << 8)) >> (((c) & 1) << 2)) & 0x0FFF)
+// fat_table comes from kmalloc, so these loads are aligned
+#define FAT16_ENTRY(table, c)   ((uint32_t)((const uint16_t*)(table))[c])
+// A FAT32 FAT can be megabytes, so it is read through a window instead
+#define FAT32_ENTRY(table, c)   ((void)(table), fat32_entry(c))
+
+/**
+ * fat_window_load - Bring a FAT32 FAT sector into the window
+ *
+ * @sector: Sector of the FAT, counted from its start
+ *
+ * The window covers FAT_WINDOW_SECTORS aligned sectors around @sector.
+ * On a RAM disk it points into the image instead of copying.
+ *
+ * Returns: 0 on success, -1 on a read error or past the end of the FAT
+ */
+static int fat_window_load(uint32_t sector) {
+    uint32_t fat_sectors = g_fat_state.fat_size / g_fat_state.boot_sector.bytes_per_sector;
+    if (sector >= fat_sectors) {
+        return -1;
+    }
+
+    uint32_t first = sector & ~(FAT_WINDOW_SECTORS - 1);
+    uint32_t count = fat_sectors - first;
+    if (count > FAT_WINDOW_SECTORS) {
+        count = FAT_WINDOW_SECTORS;
+    }
+
+    uint32_t lba = g_fat_state.fat_start_sector + first;
+    const uint8_t *window = (const uint8_t*)disk_map(lba, count);
+    if (!window) {
+        if (disk_read(lba, count, g_fat_state.fat_window_buf) != 0) {
+            g_fat_state.fat_window_count = 0;
+            return -1;
+        }
+        window = g_fat_state.fat_window_buf;
+    }
+
+    g_fat_state.fat_window = window;
+    g_fat_state.fat_window_first = first;
+    g_fat_state.fat_window_count = count;
+    return 0;
+}
+
+// FAT32 entry for @cluster; an unreadable one ends the chain
+static inline uint32_t fat32_entry(uint32_t cluster) {
+    uint32_t sector = cluster / (512 / 4);
+    if (sector - g_fat_state.fat_window_first >= g_fat_state.fat_window_count &&
+        fat_window_load(sector) != 0) {
+        return 0x0FFFFFFF;
+    }
+    uint32_t index = cluster - g_fat_state.fat_window_first * (512 / 4);
+    return ((const uint32_t*)g_fat_state.fat_window)[index] & 0x0FFFFFFF;
+}
+
+#define FAT_CHAIN_OPS(bits, eoc) \
+static uint32_t fat##bits##_next(uint32_t cluster) { \
+    uint32_t next = FAT##bits##_ENTRY(g_fat_state.fat_table, cluster); \
+    return next >= (eoc) ? FAT_CHAIN_END : next; \
+} \
+static uint32_t fat##bits##_chain(uint32_t cluster, uint32_t *links, uint32_t max) { \
+    const uint8_t *table = g_fat_state.fat_table; \
+    uint32_t n = 0; \
+    while (n < max) { \
+        uint32_t next = FAT##bits##_ENTRY(table, cluster); \
+        /* The same tracepoint as get_next_cluster, once per link */ \
+        TRACE_INSTANT(FAT_NEXT_CLUSTER, cluster, next >= (eoc) ? FAT_CHAIN_END : next); \
+        if (next >= (eoc)) { \
+            break; \
+        } \
+        links[n++] = cluster = next; \
+    } \
+    return n; \
+}
+
+FAT_CHAIN_OPS(12, 0x0FF8)
+FAT_CHAIN_OPS(16, 0xFFF8)
+FAT_CHAIN_OPS(32, 0x0FFFFFF8)
+
+static const FAT_ChainOps fat_chain_ops[] = {
+    [FAT_TYPE_12] = { fat12_next, fat12_chain },
+    [FAT_TYPE_16] = { fat16_next, fat16_chain },
+    [FAT_TYPE_32] = { fat32_next, fat32_chain },
+};
+
+// Set by fatInit
+static const FAT_ChainOps *g_chain_ops = &fat_chain_ops[FAT_TYPE_12];
+
+// Helper function: Get next cluster from FAT
+static inline uint32_t get_next_cluster(uint32_t cluster) {
+    uint32_t next_cluster = g_chain_ops->next(cluster);
+    TRACE_INSTANT(FAT_NEXT_CLUSTER, cluster, next_cluster);
+    return next_cluster;
+}
+
+// Helper function: Sanity-check a sector as a FAT boot sector (vs. an MBR)
+static bool is_fat_boot_sector(FAT_BootSector *bs) {
+    uint8_t spc = bs->sectors_per_cluster;
+
+    return bs->bytes_per_sector == 512 &&
+           spc != 0 && (spc & (spc - 1)) == 0 &&
+           bs->reserved_sectors != 0 &&
+           (bs->num_fats == 1 || bs->num_fats == 2);
+}
+
+// Take the free cluster count and next free hint from the FSInfo sector,
+// if it has valid ones; @buf is a scratch sector
+static void fat_read_fsinfo(uint8_t *buf) {
+    uint16_t fsinfo = g_fat_state.boot_sector.fsinfo_sector;
+    if (fsinfo == 0 || fsinfo == 0xFFFF ||
+        disk_read(g_fat_state.partition_lba + fsinfo, 1, buf) != 0) {
+        return;
+    }
+
+    const FAT_FSInfo *info = (const FAT_FSInfo*)buf;
+    if (info->lead_sig != FAT_FSINFO_LEAD_SIG || info->struct_sig != FAT_FSINFO_STRUCT_SIG ||
+        info->trail_sig != FAT_FSINFO_TRAIL_SIG) {
+        return;
+    }
+
+    // Both are only hints and may be stale or garbage
+    if (info->free_count <= g_fat_state.total_clusters) {
+        g_fat_state.free_clusters = info->free_count;
+    }
+    if (info->next_free >= 2 && info->next_free < g_fat_state.total_clusters + 2) {
+        g_fat_state.next_free = info->next_free;
+    }
+}
+
+// Helper function: Get first sector of a cluster
+static inline uint32_t cluster_to_sector(uint32_t cluster) {
+    return ((cluster - 2) << g_fat_state.cluster_shift) + g_fat_state.first_data_sector;
+}
+
+// Cluster after @cluster in @handle's file. Files opened through a
+// snapshot take it from their extents and never look at the FAT.
+static uint32_t file_next_cluster(const FAT_FileHandle *handle, uint32_t cluster) {
+    for (uint32_t i = 0; i < handle->extent_count; i++) {
+        const FAT_Extent *e = &handle->extents[i];
+        if (cluster - e->cluster < e->count) {
+            if (cluster - e->cluster + 1 < e->count) {
+                return cluster + 1;
+            }
+            return i + 1 < handle->extent_count ? handle->extents[i + 1].cluster : FAT_CHAIN_END;
+        }
+    }
+    return handle->extents ? FAT_CHAIN_END : get_next_cluster(cluster);
+}
+
+// Cluster number @index of a file with extents
+static uint32_t extent_cluster(const FAT_FileHandle *handle, uint32_t index) {
+    for (uint32_t i = 0; i < handle->extent_count; i++) {
+        if (index < handle->extents[i].count) {
+            return handle->extents[i].cluster + index;
+        }
+        index -= handle->extents[i].count;
+    }
+    return FAT_CHAIN_END;
+}
+
+/**
+ * fatInit - Initialize the FAT filesystem driver
+ * 
+ * Reads the boot sector, and the FAT table into memory for FAT12/16.
+ * FAT32 reads the FSInfo sector instead and loads the FAT on demand.
+ * Must be called before using fatOpen or fatRead.
+ * 
+ * Returns: 0 on success, -1 on failure
+ */
+int fatInit(void) {
+    uint8_t sector[512];
+
+    // A manifest or snapshot belongs to the volume it was loaded from
+    g_fat_state.manifest = 0;
+    g_fat_state.manifest_count = 0;
+    g_fat_state.snapshot = 0;
+    g_fat_state.snapshot_count = 0;
+
+    // Read boot sector
+    if (disk_read(0, 1, sector) != 0) {
+        return -1;
+    }
+    
+    // Validate boot sector signature
+    if (sector[510] != 0x55 || sector[511] != 0xAA) {
+        return -1;
+    }
+
+    // Partitioned disk: sector 0 is an MBR, mount the first partition
+    g_fat_state.partition_lba = 0;
+    if (!is_fat_boot_sector((FAT_BootSector*)sector)) {
+        MBR_PartitionEntry *part = (MBR_PartitionEntry*)(sector + MBR_PARTITION_TABLE);
+        for (int i = 0; i < 4; i++) {
+            if (part[i].type != 0 && part[i].lba_start != 0) {
+                g_fat_state.partition_lba = part[i].lba_start;
+                break;
+            }
+        }
+
+        if (g_fat_state.partition_lba == 0 ||
+            disk_read(g_fat_state.partition_lba, 1, sector) != 0 ||
+            sector[510] != 0x55 || sector[511] != 0xAA ||
+            !is_fat_boot_sector((FAT_BootSector*)sector)) {
+            return -1;
+        }
+    }
+
+    memcpy(&g_fat_state.boot_sector, sector, sizeof(FAT_BootSector));
+    
+    // Calculate filesystem parameters
+    g_fat_state.fat_type = determine_fat_type(&g_fat_state.boot_sector);
+    g_chain_ops = &fat_chain_ops[g_fat_state.fat_type];
+    // is_fat_boot_sector checked that this is a power of two
+    g_fat_state.cluster_shift = __builtin_ctz(g_fat_state.boot_sector.sectors_per_cluster);
+    
+    uint32_t fat_size = get_sectors_per_fat(&g_fat_state.boot_sector);
+    g_fat_state.root_dir_sectors = ((g_fat_state.boot_sector.root_entries * 32) + 
+                                    (g_fat_state.boot_sector.bytes_per_sector - 1)) / 
+                                    g_fat_state.boot_sector.bytes_per_sector;
+    
+    g_fat_state.first_data_sector = g_fat_state.partition_lba +
+                                    g_fat_state.boot_sector.reserved_sectors + 
+                                    (g_fat_state.boot_sector.num_fats * fat_size) + 
+                                    g_fat_state.root_dir_sectors;
+    g_fat_state.total_clusters = (get_total_sectors(&g_fat_state.boot_sector) -
+                                  (g_fat_state.first_data_sector - g_fat_state.partition_lba)) >>
+                                 g_fat_state.cluster_shift;
+    g_fat_state.fat_start_sector = g_fat_state.partition_lba + g_fat_state.boot_sector.reserved_sectors;
+    g_fat_state.fat_size = fat_size * g_fat_state.boot_sector.bytes_per_sector;
+    g_fat_state.free_clusters = FAT_UNKNOWN;
+    g_fat_state.next_free = FAT_UNKNOWN;
+    
+    if (g_fat_state.fat_type == FAT_TYPE_32) {
+        // Mounting reads no more of the FAT than the window needs later
+        g_fat_state.fat_table = 0;
+        g_fat_state.root_cluster = g_fat_state.boot_sector.root_cluster;
+        if (!g_fat_state.fat_window_buf) {
+            g_fat_state.fat_window_buf = (uint8_t*)kmalloc(FAT_WINDOW_SECTORS * g_fat_state.boot_sector.bytes_per_sector);
+            if (!g_fat_state.fat_window_buf) {
+                return -1;
+            }
+        }
+        g_fat_state.fat_window_first = FAT_UNKNOWN;
+        g_fat_state.fat_window_count = 0;
+        fat_read_fsinfo(sector);
+    } else {
+        // Allocate memory for FAT table
+        g_fat_state.root_cluster = 0;
+        g_fat_state.fat_table = (uint8_t*)kmalloc(g_fat_state.fat_size);
+        if (!g_fat_state.fat_table) {
+            return -1;
+        }
+        
+        // Read FAT table into memory
+        if (disk_read(g_fat_state.fat_start_sector, fat_size, g_fat_state.fat_table) != 0) {
+            kfree(g_fat_state.fat_table);
+            return -1;
+        }
+    }
+    
+    // Cluster cache for partial reads; kept across remounts since the
+    // bump allocator cannot give it back
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    if (g_fat_state.cluster_cache_size < cluster_size) {
+        g_fat_state.cluster_cache = (uint8_t*)kmalloc(cluster_size);
+        if (!g_fat_state.cluster_cache) {
+            g_fat_state.cluster_cache_size = 0;
+            return -1;
+        }
+        g_fat_state.cluster_cache_size = cluster_size;
+    }
+    g_fat_state.cached_cluster = 0;
+    
+    g_fat_state.initialized = true;
+    return 0;
+}
+
+// Split "file.txt" into the blank-padded, upper-case name and extension
+// fields of a directory entry
+static void to_short_name(const char *filename, char name[8], char ext[3]) {
+    memcpy(name, "        ", 8);
+    memcpy(ext, "   ", 3);
+    
+    const char *dot = strchr(filename, '.');
+    if (dot) {
+        int name_len = dot - filename;
+        if (name_len > 8) name_len = 8;
+        memcpy(name, filename, name_len);
+        
+        int ext_len = strlen(dot + 1);
+        if (ext_len > 3) ext_len = 3;
+        memcpy(ext, dot + 1, ext_len);
+    } else {
+        int name_len = strlen(filename);
+        if (name_len > 8) name_len = 8;
+        memcpy(name, filename, name_len);
+    }
+    
+    // Convert to uppercase
+    for (int i = 0; i < 8; i++) {
+        if (name[i] >= 'a' && name[i] <= 'z') name[i] -= 32;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (ext[i] >= 'a' && ext[i] <= 'z') ext[i] -= 32;
+    }
+}
+
+// Set up @handle for the file @name/@ext found in the directory or snapshot
+static void open_handle(FAT_FileHandle *handle, uint32_t cluster, uint32_t size,
+                        const char name[8], const char ext[3]) {
+    handle->first_cluster = cluster;
+    handle->current_cluster = cluster;
+    handle->file_size = size;
+    handle->position = 0;
+    handle->is_open = true;
+    handle->verify = false;
+    handle->checked = false;
+    handle->crc = 0;
+    handle->extents = 0;
+    handle->extent_count = 0;
+
+    // Files listed in the manifest are checked as they are read
+    for (uint32_t m = 0; m < g_fat_state.manifest_count; m++) {
+        FAT_ManifestEntry *me = &g_fat_state.manifest[m];
+        if (memcmp(me->name, name, 8) == 0 && memcmp(me->name + 8, ext, 3) == 0) {
+            handle->verify = true;
+            handle->checked = true;
+            handle->expected_crc = me->crc;
+            handle->expected_size = me->size;
+            break;
+        }
+    }
+}
+
+// Look for @name/@ext among @count directory entries and fill in @handle
+// Returns: 1 if found, -1 at the end-of-directory marker, 0 to keep looking
+static int search_dir(const FAT_DirEntry *entries, uint32_t count,
+                      const char name[8], const char ext[3], FAT_FileHandle *handle) {
+    for (uint32_t i = 0; i < count; i++) {
+        const FAT_DirEntry *entry = &entries[i];
+        
+        // Check for end of directory
+        if (entry->name[0] == 0x00) return -1;
+        
+        // Skip deleted entries and LFN entries
+        if ((uint8_t)entry->name[0] == 0xE5 || entry->attr == FAT_ATTR_LFN) continue;
+        
+        // Skip directories and volume labels
+        if (entry->attr & (FAT_ATTR_DIRECTORY | FAT_ATTR_VOLUME_ID)) continue;
+        
+        // Compare filename
+        if (memcmp(entry->name, name, 8) == 0 && memcmp(entry->ext, ext, 3) == 0) {
+            // File found!
+            uint32_t cluster = entry->cluster_low | ((uint32_t)entry->cluster_high << 16);
+            open_handle(handle, cluster, entry->file_size, name, ext);
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+// FAT32: the root directory is a cluster chain like any file. Each
+// cluster is searched in place on a RAM disk, or through the cluster cache.
+static int search_root_chain(const char name[8], const char ext[3], FAT_FileHandle *handle) {
+    uint32_t spc = g_fat_state.boot_sector.sectors_per_cluster;
+    uint32_t entries_per_cluster = (spc * g_fat_state.boot_sector.bytes_per_sector) / sizeof(FAT_DirEntry);
+    uint32_t cluster = g_fat_state.root_cluster;
+    
+    // A chain cannot be longer than the volume, even a corrupt one
+    for (uint32_t n = 0; n < g_fat_state.total_clusters && cluster >= 2 && cluster != FAT_CHAIN_END; n++) {
+        const FAT_DirEntry *entries = (const FAT_DirEntry*)disk_map(cluster_to_sector(cluster), spc);
+        if (!entries) {
+            if (g_fat_state.cached_cluster != cluster) {
+                if (disk_read(cluster_to_sector(cluster), spc, g_fat_state.cluster_cache) != 0) {
+                    g_fat_state.cached_cluster = 0;
+                    return -1;
+                }
+                g_fat_state.cached_cluster = cluster;
+            }
+            entries = (const FAT_DirEntry*)g_fat_state.cluster_cache;
+        }
+        
+        int ret = search_dir(entries, entries_per_cluster, name, ext, handle);
+        if (ret != 0) {
+            return ret;
+        }
+        cluster = get_next_cluster(cluster);
+    }
+    
+    return -1;
+}
+
+// Binary search of the snapshot's directory index
+static int snapshot_open(const char name[8], const char ext[3], FAT_FileHandle *handle) {
+    char key[11];
+    memcpy(key, name, 8);
+    memcpy(key + 8, ext, 3);
+
+    uint32_t lo = 0, hi = g_fat_state.snapshot_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const FAT_SnapshotEntry *se = &g_fat_state.snapshot[mid];
+        int cmp = memcmp(key, se->name, 11);
+        if (cmp == 0) {
+            open_handle(handle, se->first_cluster, se->size, name, ext);
+            if (se->extent_count) {
+                handle->extents = &g_fat_state.extents[se->extent];
+                handle->extent_count = se->extent_count;
+            }
+            return 0;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * fat_open_locked - Open a file in the FAT filesystem
+ * 
+ * Searches for the file in the root directory and initializes a file handle.
+ * Currently only supports files in the root directory. With a snapshot
+ * loaded, its directory index is searched instead.
+ * 
+ * @filename: Name of the file to open (8.3 format, e.g., "FILE.TXT")
+ * @handle: Pointer to file handle structure to initialize
+ * 
+ * Returns: 0 on success, -1 on failure
+ */
+static int fat_open_locked(const char *filename, FAT_FileHandle *handle) {
+    PROF_SCOPE(fatOpen);
+
+    if (!g_fat_state.initialized || !filename || !handle) {
+        return -1;
+    }
+    
+    char name[8], ext[3];
+    to_short_name(filename, name, ext);
+    
+    // A loaded snapshot lists every file of the root directory
+    if (g_fat_state.snapshot) {
+        return snapshot_open(name, ext, handle);
+    }
+    
+    if (g_fat_state.fat_type == FAT_TYPE_32) {
+        return search_root_chain(name, ext, handle) == 1 ? 0 : -1;
+    }
+    
+    // Read root directory
+    uint32_t root_dir_sector = g_fat_state.fat_start_sector +
+                               (g_fat_state.boot_sector.num_fats * get_sectors_per_fat(&g_fat_state.boot_sector));
+    
+    // On a RAM disk the directory is searched where it is
+    const FAT_DirEntry *mapped = (const FAT_DirEntry*)disk_map(root_dir_sector, g_fat_state.root_dir_sectors);
+    FAT_DirEntry *dir_entries = 0;
+    if (!mapped) {
+        dir_entries = (FAT_DirEntry*)kmalloc(g_fat_state.root_dir_sectors * g_fat_state.boot_sector.bytes_per_sector);
+        if (!dir_entries) {
+            return -1;
+        }
+        
+        if (disk_read(root_dir_sector, g_fat_state.root_dir_sectors, dir_entries) != 0) {
+            kfree(dir_entries);
+            return -1;
+        }
+        mapped = dir_entries;
+    }
+    
+    // Search for file
+    uint32_t num_entries = (g_fat_state.root_dir_sectors * g_fat_state.boot_sector.bytes_per_sector) / sizeof(FAT_DirEntry);
+    bool found = search_dir(mapped, num_entries, name, ext, handle) == 1;
+    
+    kfree(dir_entries);
+    return found ? 0 : -1;
+}
+
+/**
+ * fat_read_locked - Read data from an open file
+ * 
+ * Reads up to 'size' bytes from the current position in the file.
+ * Advances the file position by the number of bytes read.
+ * 
+ * @handle: Pointer to open file handle
+ * @buffer: Buffer to read data into
+ * @size: Maximum number of bytes to read
+ * 
+ * If the file is being verified (see fatVerify), the data is hashed as
+ * it is copied, and the read that reaches the end of the file returns -1
+ * if the CRC does not match.
+ * 
+ * Returns: Number of bytes read, or -1 on error
+ */
+static int fat_read_locked(FAT_FileHandle *handle, void *buffer, uint32_t size) {
+    PROF_SCOPE(fatRead);
+
+    if (!g_fat_state.initialized || !handle || !handle->is_open || !buffer) {
+        return -1;
+    }
+    
+    // A file whose size changed is corrupt whatever its data, even if empty
+    if (handle->verify && handle->file_size != handle->expected_size) {
+        return -1;
+    }
+    
+    // Check if we're at end of file
+    if (handle->position >= handle->file_size) {
+        return 0;
+    }
+    
+    // Limit read size to remaining file size
+    if (handle->position + size > handle->file_size) {
+        size = handle->file_size - handle->position;
+    }
+    
+    uint8_t *out = (uint8_t*)buffer;
+    uint32_t bytes_read = 0;
+    uint32_t spc = g_fat_state.boot_sector.sectors_per_cluster;
+    uint32_t cluster_size = spc * g_fat_state.boot_sector.bytes_per_sector;
+    
+    while (bytes_read < size && handle->current_cluster != FAT_CHAIN_END) {
+        // Calculate offset within current cluster
+        uint32_t cluster_offset = handle->position % cluster_size;
+        uint32_t remaining = size - bytes_read;
+        
+        if (cluster_offset == 0 && remaining >= cluster_size) {
+            // Whole clusters go straight into the caller's buffer. Clusters
+            // that are also contiguous on disk share one disk_read.
+            uint32_t first = handle->current_cluster;
+            uint32_t last = first;
+            uint32_t run = 1;
+            
+            while ((run + 1) * cluster_size <= remaining && (run + 1) * spc <= FAT_MAX_READ_SECTORS) {
+                uint32_t next = file_next_cluster(handle, last);
+                if (next != last + 1) break;
+                last = next;
+                run++;
+            }
+            
+            if (disk_read(cluster_to_sector(first), run * spc, out + bytes_read) != 0) {
+                return -1;
+            }
+            if (handle->verify) {
+                handle->crc = crc32c(handle->crc, out + bytes_read, run * cluster_size);
+            }
+            
+            bytes_read += run * cluster_size;
+            handle->position += run * cluster_size;
+            handle->current_cluster = file_next_cluster(handle, last);
+            continue;
+        }
+        
+        // Partial cluster: go through the one-cluster cache, so a file read
+        // in small chunks fetches each cluster from disk only once
+        uint32_t bytes_to_read = cluster_size - cluster_offset;
+        if (bytes_to_read > remaining) {
+            bytes_to_read = remaining;
+        }
+        
+        // A RAM disk needs no cache: copy straight out of the image
+        const uint8_t *data = (const uint8_t*)disk_map(cluster_to_sector(handle->current_cluster), spc);
+        if (!data) {
+            if (g_fat_state.cached_cluster != handle->current_cluster) {
+                uint32_t sector = cluster_to_sector(handle->current_cluster);
+                if (disk_read(sector, spc, g_fat_state.cluster_cache) != 0) {
+                    g_fat_state.cached_cluster = 0;
+                    return -1;
+                }
+                g_fat_state.cached_cluster = handle->current_cluster;
+            }
+            data = g_fat_state.cluster_cache;
+        }
+        
+        // Copy data to output buffer
+        memcpy(out + bytes_read, data + cluster_offset, bytes_to_read);
+        if (handle->verify) {
+            handle->crc = crc32c(handle->crc, out + bytes_read, bytes_to_read);
+        }
+        
+        bytes_read += bytes_to_read;
+        handle->position += bytes_to_read;
+        
+        // Move to next cluster once this one is used up, so that the next
+        // call starts from the right cluster even if this read ended on
+        // the boundary
+        if ((handle->position % cluster_size) == 0) {
+            handle->current_cluster = file_next_cluster(handle, handle->current_cluster);
+        }
+    }
+    
+    // The read that reaches the end fails if the file was corrupted
+    if (handle->verify && handle->position == handle->file_size) {
+        handle->verify = false;
+        if (handle->crc != handle->expected_crc) {
+            return -1;
+        }
+    }
+    
+    return bytes_read;
+}
+
+/**
+ * fat_seek_locked - Move the file position of an open file
+ * 
+ * Walks the cluster chain to the cluster holding @offset, starting from
+ * the current cluster when seeking forward. Offsets past the end of the
+ * file are clamped to the file size.
+ * 
+ * @handle: Pointer to open file handle
+ * @offset: New position in bytes from the start of the file
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+static int fat_seek_locked(FAT_FileHandle *handle, uint32_t offset) {
+    if (!g_fat_state.initialized || !handle || !handle->is_open) {
+        return -1;
+    }
+
+    if (offset > handle->file_size) {
+        offset = handle->file_size;
+    }
+
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    uint32_t target_index = offset / cluster_size;
+    uint32_t current_index = handle->position / cluster_size;
+
+    // Extents from a snapshot locate the cluster without the FAT
+    if (handle->extents) {
+        handle->current_cluster = extent_cluster(handle, target_index);
+        current_index = target_index;
+    } else if (target_index < current_index || handle->current_cluster == FAT_CHAIN_END) {
+        // Chains only go forward; restart from the first cluster otherwise
+        handle->current_cluster = handle->first_cluster;
+        current_index = 0;
+    }
+
+    // Decode the links in batches rather than one call per cluster
+    uint32_t links[FAT_CHAIN_BATCH];
+    while (current_index < target_index && handle->current_cluster != FAT_CHAIN_END) {
+        uint32_t want = target_index - current_index;
+        if (want > FAT_CHAIN_BATCH) {
+            want = FAT_CHAIN_BATCH;
+        }
+        uint32_t n = g_chain_ops->chain(handle->current_cluster, links, want);
+        if (n < want) {
+            handle->current_cluster = FAT_CHAIN_END;
+            break;
+        }
+        handle->current_cluster = links[n - 1];
+        current_index += n;
+    }
+
+    // The running CRC only covers reads from the start of the file
+    if (offset == 0) {
+        handle->verify = handle->checked;
+        handle->crc = 0;
+    } else if (offset != handle->position) {
+        handle->verify = false;
+    }
+
+    handle->position = offset;
+    return 0;
+}
+
+/**
+ * fat_map_locked - Map the file data at the current position to disk
+ *
+ * For callers that do their own disk I/O, such as the asynchronous
+ * loader in kernel_main.c. Finds the sectors from the current position to
+ * the end of its cluster, stopping at the end of the file, and advances
+ * the position past them.
+ *
+ * @handle: Open file handle, positioned on a sector boundary
+ * @sector: Receives the first sector of the run
+ * @count: Receives the number of sectors to read
+ * @bytes: Receives the number of file bytes in those sectors
+ *
+ * Returns: 1 if a run was mapped, 0 at end of file, -1 on error
+ */
+static int fat_map_locked(FAT_FileHandle *handle, uint32_t *sector, uint32_t *count, uint32_t *bytes) {
+    if (!g_fat_state.initialized || !handle || !handle->is_open || !sector || !count || !bytes) {
+        return -1;
+    }
+
+    if (handle->position >= handle->file_size) {
+        return 0;
+    }
+
+    uint32_t bps = g_fat_state.boot_sector.bytes_per_sector;
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * bps;
+    uint32_t cluster_offset = handle->position % cluster_size;
+
+    if ((cluster_offset % bps) != 0 || handle->current_cluster == FAT_CHAIN_END) {
+        return -1;
+    }
+
+    // The caller reads the data, so fatRead cannot hash it
+    handle->verify = false;
+
+    uint32_t run = cluster_size - cluster_offset;
+    if (run > handle->file_size - handle->position) {
+        run = handle->file_size - handle->position;
+    }
+
+    *sector = cluster_to_sector(handle->current_cluster) + cluster_offset / bps;
+    *count = (run + bps - 1) / bps;
+    *bytes = run;
+
+    handle->position += run;
+    if ((handle->position % cluster_size) == 0) {
+        handle->current_cluster = file_next_cluster(handle, handle->current_cluster);
+    }
+
+    return 1;
+}
+
+static uint32_t parse_hex(const char **p) {
+    uint32_t value = 0;
+    for (;; (*p)++) {
+        char c = **p;
+        if (c >= '0' && c <= '9') value = (value << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f') value = (value << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value = (value << 4) | (c - 'A' + 10);
+        else return value;
+    }
+}
+
+static uint32_t parse_dec(const char **p) {
+    uint32_t value = 0;
+    while (**p >= '0' && **p <= '9') {
+        value = value * 10 + (*(*p)++ - '0');
+    }
+    return value;
+}
+
+// Adds the manifest entry on one line, if it is well formed
+static void parse_manifest_line(const char *line) {
+    const char *p = line;
+    char filename[13];
+    uint32_t len = 0;
+    while (*p && *p != ' ' && len < sizeof(filename) - 1) {
+        filename[len++] = *p++;
+    }
+    filename[len] = '\0';
+    if (len == 0 || *p != ' ') {
+        return;
+    }
+
+    while (*p == ' ') p++;
+    const char *crc_start = p;
+    uint32_t crc = parse_hex(&p);
+    if (p == crc_start || *p != ' ') {
+        return;
+    }
+    while (*p == ' ') p++;
+    uint32_t size = parse_dec(&p);
+
+    FAT_ManifestEntry *me = &g_fat_state.manifest[g_fat_state.manifest_count++];
+    to_short_name(filename, me->name, me->name + 8);
+    me->crc = crc;
+    me->size = size;
+}
+
+/**
+ * fat_load_manifest_locked - Read the checksum manifest of the volume
+ * 
+ * The manifest is a text file, made by the Makefile, with one line per
+ * file: the 8.3 name, its CRC-32C in hex and its size in decimal. Files
+ * opened afterwards that are listed there are verified as they are read.
+ * 
+ * @filename: Name of the manifest, e.g. "MANIFEST.CRC"
+ * 
+ * Returns: Number of entries loaded, or -1 on error
+ */
+static int fat_load_manifest_locked(const char *filename) {
+    FAT_FileHandle handle;
+    if (fat_open_locked(filename, &handle) != 0) {
+        return -1;
+    }
+    handle.verify = false;
+
+    // The shortest line is "A 0 0\n"
+    uint32_t capacity = handle.file_size / 6 + 1;
+    FAT_ManifestEntry *entries = (FAT_ManifestEntry*)kmalloc(capacity * sizeof(FAT_ManifestEntry));
+    if (!entries) {
+        return -1;
+    }
+    g_fat_state.manifest = entries;
+    g_fat_state.manifest_count = 0;
+
+    char line[64];
+    uint32_t len = 0;
+    char chunk[256];
+    int n;
+    while ((n = fat_read_locked(&handle, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (chunk[i] == '\n' || chunk[i] == '\r') {
+                line[len] = '\0';
+                if (len > 0 && g_fat_state.manifest_count < capacity) {
+                    parse_manifest_line(line);
+                }
+                len = 0;
+            } else if (len < sizeof(line) - 1) {
+                line[len++] = chunk[i];
+            }
+        }
+    }
+    line[len] = '\0';
+    if (len > 0 && g_fat_state.manifest_count < capacity) {
+        parse_manifest_line(line);
+    }
+
+    if (n < 0) {
+        g_fat_state.manifest_count = 0;
+        return -1;
+    }
+    return g_fat_state.manifest_count;
+}
+
+// Hand the root directory to @fn in blocks of entries: the whole region
+// on FAT12/16, one cluster at a time on FAT32. A nonzero return from @fn
+// stops the walk.
+// Returns: 0, or -1 on a read error
+static int root_dir_walk(int (*fn)(const FAT_DirEntry *entries, uint32_t count, void *ctx), void *ctx) {
+    uint32_t bps = g_fat_state.boot_sector.bytes_per_sector;
+
+    if (g_fat_state.fat_type != FAT_TYPE_32) {
+        uint32_t lba = g_fat_state.fat_start_sector +
+                       g_fat_state.boot_sector.num_fats * get_sectors_per_fat(&g_fat_state.boot_sector);
+        const FAT_DirEntry *entries = (const FAT_DirEntry*)disk_map(lba, g_fat_state.root_dir_sectors);
+        FAT_DirEntry *buf = 0;
+        if (!entries) {
+            buf = (FAT_DirEntry*)kmalloc(g_fat_state.root_dir_sectors * bps);
+            if (!buf || disk_read(lba, g_fat_state.root_dir_sectors, buf) != 0) {
+                kfree(buf);
+                return -1;
+            }
+            entries = buf;
+        }
+        fn(entries, g_fat_state.root_dir_sectors * bps / sizeof(FAT_DirEntry), ctx);
+        kfree(buf);
+        return 0;
+    }
+
+    uint32_t spc = g_fat_state.boot_sector.sectors_per_cluster;
+    uint32_t cluster = g_fat_state.root_cluster;
+    for (uint32_t n = 0; n < g_fat_state.total_clusters && cluster >= 2 && cluster != FAT_CHAIN_END; n++) {
+        const FAT_DirEntry *entries = (const FAT_DirEntry*)disk_map(cluster_to_sector(cluster), spc);
+        if (!entries) {
+            if (g_fat_state.cached_cluster != cluster) {
+                if (disk_read(cluster_to_sector(cluster), spc, g_fat_state.cluster_cache) != 0) {
+                    g_fat_state.cached_cluster = 0;
+                    return -1;
+                }
+                g_fat_state.cached_cluster = cluster;
+            }
+            entries = (const FAT_DirEntry*)g_fat_state.cluster_cache;
+        }
+        if (fn(entries, spc * bps / sizeof(FAT_DirEntry), ctx) != 0) {
+            break;
+        }
+        cluster = get_next_cluster(cluster);
+    }
+    return 0;
+}
+
+static int crc_dir_block(const FAT_DirEntry *entries, uint32_t count, void *ctx) {
+    *(uint32_t*)ctx = crc32c(*(uint32_t*)ctx, entries, count * sizeof(FAT_DirEntry));
+    return 0;
+}
+
+// CRC-32C of the first @sectors sectors of the FAT: from memory on
+// FAT12/16, through the window on FAT32
+static int fat_crc(uint32_t sectors, uint32_t *crc) {
+    uint32_t bps = g_fat_state.boot_sector.bytes_per_sector;
+    *crc = 0;
+    if (sectors > g_fat_state.fat_size / bps) {
+        return -1;
+    }
+    if (g_fat_state.fat_table) {
+        *crc = crc32c(0, g_fat_state.fat_table, sectors * bps);
+        return 0;
+    }
+
+    for (uint32_t sector = 0; sector < sectors; ) {
+        if (fat_window_load(sector) != 0) {
+            return -1;
+        }
+        uint32_t n = g_fat_state.fat_window_first + g_fat_state.fat_window_count - sector;
+        if (n > sectors - sector) {
+            n = sectors - sector;
+        }
+        *crc = crc32c(*crc, g_fat_state.fat_window + (sector - g_fat_state.fat_window_first) * bps, n * bps);
+        sector += n;
+    }
+    return 0;
+}
+
+// Serial number of the volume; FAT12/16 keep it earlier in the boot
+// sector than FAT32 does
+static uint32_t volume_serial(void) {
+    if (g_fat_state.fat_type == FAT_TYPE_32) {
+        return g_fat_state.boot_sector.volume_id;
+    }
+    uint32_t id;
+    memcpy(&id, (const uint8_t*)&g_fat_state.boot_sector + 39, sizeof(id));
+    return id;
+}
+
+// Whether the @size bytes at @data are a well-formed snapshot of the
+// mounted volume as it is now
+static bool snapshot_valid(const uint8_t *data, uint32_t size) {
+    const FAT_SnapshotHeader *hdr = (const FAT_SnapshotHeader*)data;
+    if (size < sizeof(*hdr) || hdr->magic != FAT_SNAPSHOT_MAGIC ||
+        hdr->version != FAT_SNAPSHOT_VERSION || hdr->header_size != sizeof(*hdr) ||
+        hdr->total_size > size || hdr->entry_count > size / sizeof(FAT_SnapshotEntry) ||
+        hdr->extent_count > size / sizeof(FAT_Extent) ||
+        hdr->total_size != sizeof(*hdr) + hdr->entry_count * sizeof(FAT_SnapshotEntry) +
+                           hdr->extent_count * sizeof(FAT_Extent)) {
+        return false;
+    }
+
+    FAT_SnapshotHeader copy = *hdr;
+    copy.crc = 0;
+    uint32_t crc = crc32c(0, &copy, sizeof(copy));
+    if (crc32c(crc, data + sizeof(copy), hdr->total_size - sizeof(copy)) != hdr->crc) {
+        return false;
+    }
+
+    // Made from this volume, with this geometry
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    if (hdr->volume_id != volume_serial() ||
+        hdr->first_data_sector != g_fat_state.first_data_sector - g_fat_state.partition_lba ||
+        hdr->total_clusters != g_fat_state.total_clusters || hdr->cluster_size != cluster_size) {
+        return false;
+    }
+
+    // Sorted names, extents inside the table and inside the volume
+    const FAT_SnapshotEntry *entries = (const FAT_SnapshotEntry*)(data + sizeof(*hdr));
+    const FAT_Extent *extents = (const FAT_Extent*)(entries + hdr->entry_count);
+    for (uint32_t i = 0; i < hdr->entry_count; i++) {
+        const FAT_SnapshotEntry *se = &entries[i];
+        if ((i > 0 && memcmp(entries[i - 1].name, se->name, 11) >= 0) ||
+            se->extent > hdr->extent_count || se->extent_count > hdr->extent_count - se->extent) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < hdr->extent_count; i++) {
+        if (extents[i].cluster < 2 || extents[i].count == 0 || extents[i].count > g_fat_state.total_clusters ||
+            extents[i].cluster - 2 > g_fat_state.total_clusters - extents[i].count) {
+            return false;
+        }
+    }
+
+    // Nothing changed since: the FAT as far as the extents reach, and the
+    // root directory the index was taken from
+    uint32_t fat_hash, dir_hash = 0;
+    if (fat_crc(hdr->fat_sectors, &fat_hash) != 0 || fat_hash != hdr->fat_crc ||
+        root_dir_walk(crc_dir_block, &dir_hash) != 0 || dir_hash != hdr->root_dir_crc) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * fat_load_snapshot_locked - Use a boot snapshot of the volume, if it fits
+ * 
+ * The snapshot, written into @filename by tools/mksnapshot, holds the
+ * root directory as a sorted index and the cluster extents of the files
+ * it was made for. It is checked against the volume serial number and
+ * geometry, a CRC-32C of the root directory and one of the FAT up to the
+ * last cluster of those extents. If it passes, fatOpen searches the index
+ * instead of the directory, and files with extents are read and seeked
+ * in without the FAT. Otherwise nothing changes.
+ * 
+ * @filename: Name of the snapshot, e.g. "BOOT.SNP"
+ * 
+ * Returns: Number of files in the index, or -1 if there is no usable
+ *          snapshot
+ */
+static int fat_load_snapshot_locked(const char *filename) {
+    g_fat_state.snapshot = 0;
+    g_fat_state.snapshot_count = 0;
+
+    FAT_FileHandle handle;
+    if (fat_open_locked(filename, &handle) != 0 || handle.file_size > FAT_SNAPSHOT_MAX) {
+        return -1;
+    }
+    handle.verify = false;
+
+    uint8_t *data = (uint8_t*)kmalloc(handle.file_size);
+    if (!data) {
+        return -1;
+    }
+    if (fat_read_locked(&handle, data, handle.file_size) != (int)handle.file_size ||
+        !snapshot_valid(data, handle.file_size)) {
+        kfree(data);
+        return -1;
+    }
+
+    const FAT_SnapshotHeader *hdr = (const FAT_SnapshotHeader*)data;
+    g_fat_state.snapshot = (const FAT_SnapshotEntry*)(data + sizeof(*hdr));
+    g_fat_state.snapshot_count = hdr->entry_count;
+    g_fat_state.extents = (const FAT_Extent*)(g_fat_state.snapshot + hdr->entry_count);
+    g_fat_state.extent_count = hdr->extent_count;
+    return g_fat_state.snapshot_count;
+}
+
+// A run of file data on disk, for fatReadBatch
+typedef struct {
+    uint32_t sector;                // First disk sector
+    uint32_t skip;                  // Bytes of that sector before the data
+    uint32_t bytes;
+    uint8_t *dest;
+    uint32_t request;               // Index of the request it belongs to
+} FAT_BatchSegment;
+
+static inline uint32_t segment_end(const FAT_BatchSegment *seg) {
+    return seg->sector + (seg->skip + seg->bytes + 511) / 512;
+}
+
+// Append the disk runs that hold the next @length bytes of @handle to
+// @segs, one per run of adjacent clusters small enough for one
+// disk_read. Returns the number appended,
+// or -1 if the chain ends before the file does.
+static int batch_map(FAT_FileHandle *handle, uint32_t length, uint8_t *dest,
+                     uint32_t request, FAT_BatchSegment *segs) {
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    int n = 0;
+
+    while (length > 0) {
+        if (handle->current_cluster == FAT_CHAIN_END) {
+            return -1;
+        }
+
+        uint32_t first = handle->current_cluster;
+        uint32_t last = first;
+        uint32_t cluster_offset = handle->position % cluster_size;
+        uint32_t span = cluster_size - cluster_offset;
+        uint32_t next = file_next_cluster(handle, last);
+        // Whole clusters only, and never more than one disk_read takes
+        while (span < length && next == last + 1 && (span + cluster_size) / 512 + 1 <= FAT_MAX_READ_SECTORS) {
+            last = next;
+            span += cluster_size;
+            next = file_next_cluster(handle, last);
+        }
+        if (span > length) {
+            span = length;
+        }
+
+        FAT_BatchSegment *seg = &segs[n++];
+        seg->sector = cluster_to_sector(first) + cluster_offset / 512;
+        seg->skip = cluster_offset % 512;
+        seg->bytes = span;
+        seg->dest = dest;
+        seg->request = request;
+
+        dest += span;
+        length -= span;
+        handle->position += span;
+        handle->current_cluster = next;
+    }
+    return n;
+}
+
+/**
+ * fat_read_batch_locked - Read ranges of many files in one sweep
+ *
+ * @requests: Files, ranges and destinations; result is set in each
+ * @count: Number of requests
+ *
+ * Opens every file and maps each range to its runs of clusters on disk.
+ * The runs of all requests are then sorted by sector and merged: runs
+ * that touch, overlap or are at most FAT_BATCH_GAP_SECTORS apart share
+ * one disk_read of up to FAT_MAX_READ_SECTORS. A merged read goes through
+ * a bounce buffer; a lone run of whole sectors goes straight into its
+ * destination, and a RAM disk is copied from in place.
+ *
+ * Like fatMap, this bypasses the manifest check of fatRead.
+ *
+ * Returns: Number of disk_read calls made, or -1 if out of memory
+ */
+static int fat_read_batch_locked(FAT_ReadRequest *requests, uint32_t count) {
+    if (!g_fat_state.initialized || (!requests && count)) {
+        return -1;
+    }
+
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    FAT_FileHandle *handles = (FAT_FileHandle*)kmalloc(count * sizeof(FAT_FileHandle));
+    if (!handles) {
+        return -1;
+    }
+
+    // Open everything first, to bound the number of runs
+    uint32_t max_segs = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        FAT_ReadRequest *req = &requests[i];
+        req->result = -1;
+        if (!req->buffer || fat_open_locked(req->filename, &handles[i]) != 0) {
+            continue;
+        }
+
+        uint32_t size = handles[i].file_size;
+        uint32_t offset = req->offset < size ? req->offset : size;
+        uint32_t length = req->length < size - offset ? req->length : size - offset;
+        req->result = length;
+        if (length > 0) {
+            max_segs += (offset % cluster_size + length + cluster_size - 1) / cluster_size;
+            fat_seek_locked(&handles[i], offset);
+        }
+    }
+
+    FAT_BatchSegment *segs = (FAT_BatchSegment*)kmalloc(max_segs * sizeof(FAT_BatchSegment));
+    if (!segs) {
+        kfree(handles);
+        return -1;
+    }
+
+    uint32_t nsegs = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (requests[i].result <= 0) {
+            continue;
+        }
+        int n = batch_map(&handles[i], requests[i].result, (uint8_t*)requests[i].buffer, i, segs + nsegs);
+        if (n < 0) {
+            requests[i].result = -1;
+        } else {
+            nsegs += n;
+        }
+    }
+
+    // Insertion sort by sector: batches are small, and files written one
+    // after the other are nearly in order already
+    for (uint32_t i = 1; i < nsegs; i++) {
+        FAT_BatchSegment seg = segs[i];
+        uint32_t j = i;
+        while (j > 0 && segs[j - 1].sector > seg.sector) {
+            segs[j] = segs[j - 1];
+            j--;
+        }
+        segs[j] = seg;
+    }
+
+    uint8_t *bounce = 0;
+    int reads = 0;
+    uint32_t next;
+    for (uint32_t i = 0; i < nsegs; i = next) {
+        uint32_t start = segs[i].sector;
+        uint32_t end = segment_end(&segs[i]);
+        for (next = i + 1; next < nsegs && segs[next].sector <= end + FAT_BATCH_GAP_SECTORS; next++) {
+            uint32_t seg_end = segment_end(&segs[next]);
+            if (seg_end > end) {
+                if (seg_end - start > FAT_MAX_READ_SECTORS) break;
+                end = seg_end;
+            }
+        }
+
+        const uint8_t *data = (const uint8_t*)disk_map(start, end - start);
+        if (!data) {
+            int ret;
+            if (next == i + 1 && segs[i].skip == 0 && segs[i].bytes % 512 == 0) {
+                ret = disk_read(start, end - start, segs[i].dest);
+            } else {
+                if (!bounce) {
+                    bounce = (uint8_t*)kmalloc(FAT_MAX_READ_SECTORS * 512);
+                }
+                ret = bounce ? disk_read(start, end - start, bounce) : -1;
+                data = bounce;
+            }
+            reads++;
+            if (ret != 0) {
+                for (uint32_t k = i; k < next; k++) {
+                    requests[segs[k].request].result = -1;
+                }
+                continue;
+            }
+        }
+
+        for (uint32_t k = i; k < next && data; k++) {
+            memcpy(segs[k].dest, data + (segs[k].sector - start) * 512 + segs[k].skip, segs[k].bytes);
+        }
+    }
+
+    kfree(bounce);
+    kfree(segs);
+    kfree(handles);
+    return reads;
+}
+
+// Public entry points: the implementations above share g_fat_state and the
+// cluster cache, so every call runs under the kernel's FAT lock
+
+int fatOpen(const char *filename, FAT_FileHandle *handle) {
+    TRACE_BEGIN(FAT_OPEN, 0, 0);
+    fat_lock();
+    int ret = fat_open_locked(filename, handle);
+    fat_unlock();
+    TRACE_END(FAT_OPEN, ret, 0);
+    return ret;
+}
+
+int fatRead(FAT_FileHandle *handle, void *buffer, uint32_t size) {
+    TRACE_BEGIN(FAT_READ, size, 0);
+    fat_lock();
+    int ret = fat_read_locked(handle, buffer, size);
+    fat_unlock();
+    TRACE_END(FAT_READ, ret, 0);
+    return ret;
+}
+
+int fatSeek(FAT_FileHandle *handle, uint32_t offset) {
+    fat_lock();
+    int ret = fat_seek_locked(handle, offset);
+    fat_unlock();
+    return ret;
+}
+
+int fatMap(FAT_FileHandle *handle, uint32_t *sector, uint32_t *count, uint32_t *bytes) {
+    fat_lock();
+    int ret = fat_map_locked(handle, sector, count, bytes);
+    fat_unlock();
+    return ret;
+}
+
+/**
+ * fatChain - Decode the cluster chain that follows @cluster
+ *
+ * @cluster: Cluster to start from, e.g. a file's first_cluster
+ * @links: Receives the clusters after @cluster, in chain order
+ * @max: Size of @links
+ *
+ * Returns: Number of clusters stored, fewer than @max if the chain ended,
+ *          or -1 before fatInit
+ */
+int fatChain(uint32_t cluster, uint32_t *links, uint32_t max) {
+    if (!g_fat_state.initialized || !links || cluster < 2) {
+        return -1;
+    }
+
+    fat_lock();
+    int ret = g_chain_ops->chain(cluster, links, max);
+    fat_unlock();
+    return ret;
+}
+
+int fatReadBatch(FAT_ReadRequest *requests, uint32_t count) {
+    fat_lock();
+    int ret = fat_read_batch_locked(requests, count);
+    fat_unlock();
+    return ret;
+}
+
+/**
+ * fatVolumeInfo - Report the size and free space of the mounted volume
+ *
+ * FAT32 free space comes from the FSInfo hints, so mounting never has to
+ * scan the FAT. FAT12/16 keep the whole FAT in memory and count it.
+ *
+ * Returns: 0 on success, -1 before fatInit
+ */
+int fatVolumeInfo(FAT_VolumeInfo *info) {
+    if (!g_fat_state.initialized || !info) {
+        return -1;
+    }
+
+    fat_lock();
+    info->type = g_fat_state.fat_type;
+    info->cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    info->total_clusters = g_fat_state.total_clusters;
+    info->free_clusters = g_fat_state.free_clusters;
+    info->next_free = g_fat_state.next_free;
+    if (g_fat_state.fat_table) {
+        info->free_clusters = 0;
+        for (uint32_t c = g_fat_state.total_clusters + 1; c >= 2; c--) {
+            if (g_chain_ops->next(c) == 0) {
+                info->free_clusters++;
+                info->next_free = c;
+            }
+        }
+    }
+    fat_unlock();
+    return 0;
+}
+
+int fatLoadManifest(const char *filename) {
+    fat_lock();
+    int ret = fat_load_manifest_locked(filename);
+    fat_unlock();
+    return ret;
+}
+
+int fatLoadSnapshot(const char *filename) {
+    fat_lock();
+    int ret = fat_load_snapshot_locked(filename);
+    fat_unlock();
+    return ret;
+}
+
+// Check @handle against @crc from here on; it must be at the start of the file
+int fatVerify(FAT_FileHandle *handle, uint32_t crc) {
+    if (!handle || !handle->is_open || handle->position != 0) {
+        return -1;
+    }
+
+    handle->verify = true;
+    handle->checked = true;
+    handle->crc = 0;
+    handle->expected_crc = crc;
+    handle->expected_size = handle->file_size;
+    return 0;
+}
+
+uint32_t fatManifestCount(void) {
+    return g_fat_state.manifest_count;
+}
+
+const FAT_ManifestEntry *fatManifestEntry(uint32_t index) {
+    return index < g_fat_state.manifest_count ? &g_fat_state.manifest[index] : 0;
+}
+
+// VFS backend: each inode keeps a FAT_FileHandle. The page cache fills
+// pages mostly in file order, so the seek before a read rarely moves.
+_Static_assert(sizeof(FAT_FileHandle) <= VFS_FS_DATA, "FAT_FileHandle does not fit an inode");
+
+static int fat_vfs_lookup(const char *path, vfs_inode_t *inode) {
+    FAT_FileHandle *handle = (FAT_FileHandle*)inode->fs_data;
+    if (fatOpen(path, handle) != 0) {
+        return -1;
+    }
+    inode->size = handle->file_size;
+    return 0;
+}
+
+static int fat_vfs_read(vfs_inode_t *inode, uint32_t offset, void *buffer, uint32_t size) {
+    FAT_FileHandle *handle = (FAT_FileHandle*)inode->fs_data;
+    if (handle->position != offset && fatSeek(handle, offset) != 0) {
+        return -1;
+    }
+    return fatRead(handle, buffer, size);
+}
+
+const vfs_fs_ops_t fat_vfs_ops = { "fat", fat_vfs_lookup, fat_vfs_read };
@@ -0,0 +1,248 @@
+// fat.h - FAT12/16/32 filesystem driver
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef FAT_H
+#define FAT_H
+
+#include "vfs.h"
+
+// FAT Boot Sector structure (FAT12/16/32)
+typedef struct {
+    uint8_t  jmp[3];                // Jump instruction
+    char     oem[8];                // OEM name
+    uint16_t bytes_per_sector;      // Bytes per sector
+    uint8_t  sectors_per_cluster;   // Sectors per cluster
+    uint16_t reserved_sectors;      // Reserved sectors
+    uint8_t  num_fats;              // Number of FATs
+    uint16_t root_entries;          // Root directory entries (FAT12/16)
+    uint16_t total_sectors_16;      // Total sectors (if < 65536)
+    uint8_t  media_type;            // Media descriptor
+    uint16_t sectors_per_fat_16;    // Sectors per FAT (FAT12/16)
+    uint16_t sectors_per_track;     // Sectors per track
+    uint16_t num_heads;             // Number of heads
+    uint32_t hidden_sectors;        // Hidden sectors
+    uint32_t total_sectors_32;      // Total sectors (if >= 65536)
+    
+    // FAT32 specific fields
+    uint32_t sectors_per_fat_32;    // Sectors per FAT (FAT32)
+    uint16_t flags;                 // Flags
+    uint16_t version;               // Version
+    uint32_t root_cluster;          // Root directory cluster (FAT32)
+    uint16_t fsinfo_sector;         // FSInfo sector
+    uint16_t backup_boot_sector;    // Backup boot sector
+    uint8_t  reserved[12];          // Reserved
+    uint8_t  drive_num;             // Drive number
+    uint8_t  reserved1;             // Reserved
+    uint8_t  boot_sig;              // Boot signature
+    uint32_t volume_id;             // Volume ID
+    char     volume_label[11];      // Volume label
+    char     fs_type[8];            // Filesystem type
+} __attribute__((packed)) FAT_BootSector;
+
+// FAT32 FSInfo sector: hints kept up to date by whoever last wrote the volume
+typedef struct {
+    uint32_t lead_sig;              // FAT_FSINFO_LEAD_SIG
+    uint8_t  reserved[480];
+    uint32_t struct_sig;            // FAT_FSINFO_STRUCT_SIG
+    uint32_t free_count;            // Free clusters, FAT_UNKNOWN if not known
+    uint32_t next_free;             // Where to start looking for one
+    uint8_t  reserved2[12];
+    uint32_t trail_sig;             // FAT_FSINFO_TRAIL_SIG
+} __attribute__((packed)) FAT_FSInfo;
+
+#define FAT_FSINFO_LEAD_SIG     0x41615252
+#define FAT_FSINFO_STRUCT_SIG   0x61417272
+#define FAT_FSINFO_TRAIL_SIG    0xAA550000
+#define FAT_UNKNOWN             0xFFFFFFFF
+
+// FAT Directory Entry structure
+typedef struct {
+    char     name[8];               // Filename (space-padded)
+    char     ext[3];                // Extension (space-padded)
+    uint8_t  attr;                  // File attributes
+    uint8_t  reserved;              // Reserved
+    uint8_t  create_time_tenth;     // Creation time (tenths of second)
+    uint16_t create_time;           // Creation time
+    uint16_t create_date;           // Creation date
+    uint16_t access_date;           // Last access date
+    uint16_t cluster_high;          // High word of first cluster (FAT32)
+    uint16_t modify_time;           // Modification time
+    uint16_t modify_date;           // Modification date
+    uint16_t cluster_low;           // Low word of first cluster
+    uint32_t file_size;             // File size in bytes
+} __attribute__((packed)) FAT_DirEntry;
+
+// fatReadBatch reads through holes up to this size rather than issuing
+// a second disk_read
+#define FAT_BATCH_GAP_SECTORS 8
+
+// Largest request disk_read accepts
+#define FAT_MAX_READ_SECTORS 256
+
+// Returned for end-of-chain markers, whatever the FAT type
+#define FAT_CHAIN_END       0xFFFFFFFF
+// Links fatSeek decodes per call into the FAT
+#define FAT_CHAIN_BATCH     32
+// A FAT32 FAT is not loaded whole; this many sectors of it are kept
+#define FAT_WINDOW_SECTORS  8
+
+// File attributes
+#define FAT_ATTR_READ_ONLY  0x01
+#define FAT_ATTR_HIDDEN     0x02
+#define FAT_ATTR_SYSTEM     0x04
+#define FAT_ATTR_VOLUME_ID  0x08
+#define FAT_ATTR_DIRECTORY  0x10
+#define FAT_ATTR_ARCHIVE    0x20
+#define FAT_ATTR_LFN        0x0F  // Long filename entry
+
+// FAT type enum
+typedef enum {
+    FAT_TYPE_12,
+    FAT_TYPE_16,
+    FAT_TYPE_32
+} FAT_Type;
+
+// One line of the checksum manifest: "NAME.EXT crc32c size", hex CRC
+typedef struct {
+    char name[11];                  // Padded 8.3 name as in the directory
+    uint32_t crc;
+    uint32_t size;
+} FAT_ManifestEntry;
+
+// Boot snapshot for fatLoadSnapshot, written by tools/mksnapshot into a
+// file made for it. It is only used while the volume still matches it.
+#define FAT_SNAPSHOT_MAGIC      0x50534E46  // "FNSP"
+#define FAT_SNAPSHOT_VERSION    1
+#define FAT_SNAPSHOT_MAX        65536       // Largest snapshot file loaded
+
+typedef struct {
+    uint32_t magic;                 // FAT_SNAPSHOT_MAGIC
+    uint16_t version;               // FAT_SNAPSHOT_VERSION
+    uint16_t header_size;           // sizeof(FAT_SnapshotHeader)
+    uint32_t total_size;            // Header, entries and extents, in bytes
+    uint32_t crc;                   // CRC-32C of total_size bytes, this field 0
+    uint32_t volume_id;             // Serial number from the boot sector
+    uint32_t first_data_sector;     // Geometry, relative to the boot sector
+    uint32_t total_clusters;
+    uint32_t cluster_size;
+    uint32_t root_dir_crc;          // CRC-32C of the whole root directory
+    uint32_t fat_sectors;           // Leading sectors of the FAT in fat_crc
+    uint32_t fat_crc;
+    uint32_t entry_count;
+    uint32_t extent_count;
+} __attribute__((packed)) FAT_SnapshotHeader;
+
+// One file of the root directory; entries are sorted by name
+typedef struct {
+    char name[11];                  // Padded 8.3 name as in the directory
+    uint8_t reserved;
+    uint32_t first_cluster;
+    uint32_t size;
+    uint32_t extent;                // First of this file's extents
+    uint32_t extent_count;          // 0 = follow the FAT as usual
+} __attribute__((packed)) FAT_SnapshotEntry;
+
+// A run of adjacent clusters of one file
+typedef struct {
+    uint32_t cluster;
+    uint32_t count;
+} __attribute__((packed)) FAT_Extent;
+
+// Free space as far as the driver knows it, from fatVolumeInfo
+typedef struct {
+    FAT_Type type;
+    uint32_t cluster_size;          // Bytes
+    uint32_t total_clusters;
+    uint32_t free_clusters;         // FAT_UNKNOWN if FSInfo has no count
+    uint32_t next_free;             // First cluster worth checking, or FAT_UNKNOWN
+} FAT_VolumeInfo;
+
+// Global FAT driver state
+typedef struct {
+    FAT_BootSector boot_sector;
+    uint8_t *fat_table;             // Whole FAT in memory (FAT12/16 only)
+    uint32_t fat_size;              // Size of FAT in bytes
+    uint32_t fat_start_sector;      // Disk LBA of the first FAT
+    const uint8_t *fat_window;      // FAT32: FAT sectors from fat_window_first
+    uint8_t *fat_window_buf;        // Backing store for fat_window off a RAM disk
+    uint32_t fat_window_first;      // FAT sector at fat_window, FAT_UNKNOWN = none
+    uint32_t fat_window_count;      // Sectors valid at fat_window
+    uint32_t data_start_sector;     // First sector of data region
+    uint32_t root_dir_sectors;      // Sectors used by root directory
+    uint32_t first_data_sector;     // First sector containing data
+    uint32_t partition_lba;         // Disk LBA of the boot sector
+    FAT_Type fat_type;              // Type of FAT (12/16/32)
+    uint8_t cluster_shift;          // log2(sectors per cluster)
+    uint32_t total_clusters;        // Data clusters, numbered from 2
+    uint32_t root_cluster;          // FAT32 root directory chain
+    uint32_t free_clusters;         // From FSInfo, FAT_UNKNOWN if not given
+    uint32_t next_free;             // From FSInfo, FAT_UNKNOWN if not given
+    uint8_t *cluster_cache;         // Last cluster read for a partial fatRead
+    uint32_t cluster_cache_size;    // Allocated size of cluster_cache
+    uint32_t cached_cluster;        // Cluster held in cluster_cache, 0 = none
+    FAT_ManifestEntry *manifest;    // From fatLoadManifest
+    uint32_t manifest_count;
+    const FAT_SnapshotEntry *snapshot;  // From fatLoadSnapshot, NULL = none
+    uint32_t snapshot_count;
+    const FAT_Extent *extents;
+    uint32_t extent_count;
+    bool initialized;
+} FAT_State;
+
+// File handle structure
+typedef struct {
+    uint32_t first_cluster;         // First cluster of file
+    uint32_t current_cluster;       // Current cluster being read
+    uint32_t file_size;             // Total file size
+    uint32_t position;              // Current position in file
+    bool is_open;
+    bool verify;                    // Check expected_crc when the end is read
+    bool checked;                   // Has expected_crc/size; rewinding re-arms verify
+    uint32_t crc;                   // CRC-32C of the bytes read so far
+    uint32_t expected_crc;
+    uint32_t expected_size;
+    const FAT_Extent *extents;      // From the snapshot; NULL = use the FAT
+    uint32_t extent_count;
+} FAT_FileHandle;
+
+// One range of one file for fatReadBatch
+typedef struct {
+    const char *filename;
+    uint32_t offset;                // Byte offset in the file
+    uint32_t length;                // Bytes wanted, clamped to the end of the file
+    void *buffer;
+    int result;                     // Set to the bytes read, or -1
+} FAT_ReadRequest;
+
+// External functions you need to provide in your kernel:
+// - disk_read(sector, count, buffer): Read sectors from disk
+// - disk_map(sector, count): Sectors of a disk held in memory, or NULL
+// - kmalloc(size): Allocate kernel memory
+// - kfree(ptr): Free kernel memory
+// - fat_lock()/fat_unlock(): Serialize calls from multiple threads
+extern int disk_read(uint32_t sector, uint32_t count, void *buffer);
+extern const void *disk_map(uint32_t sector, uint32_t count);
+extern void* kmalloc(size_t size);
+extern void kfree(void *ptr);
+extern void fat_lock(void);
+extern void fat_unlock(void);
+
+int fatInit(void);
+int fatOpen(const char *filename, FAT_FileHandle *handle);
+int fatRead(FAT_FileHandle *handle, void *buffer, uint32_t size);
+int fatSeek(FAT_FileHandle *handle, uint32_t offset);
+int fatMap(FAT_FileHandle *handle, uint32_t *sector, uint32_t *count, uint32_t *bytes);
+int fatChain(uint32_t cluster, uint32_t *links, uint32_t max);
+int fatReadBatch(FAT_ReadRequest *requests, uint32_t count);
+int fatVolumeInfo(FAT_VolumeInfo *info);
+int fatLoadManifest(const char *filename);
+int fatVerify(FAT_FileHandle *handle, uint32_t crc);
+uint32_t fatManifestCount(void);
+const FAT_ManifestEntry *fatManifestEntry(uint32_t index);
+int fatLoadSnapshot(const char *filename);
+
+// For vfs_mount once fatInit has succeeded
+extern const vfs_fs_ops_t fat_vfs_ops;
+
+#endif // FAT_H
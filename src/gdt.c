@@ -0,0 +1,44 @@
+// gdt.c - Flat kernel GDT
+//
+// The Multiboot spec leaves GDTR undefined after boot, so the kernel
+// installs its own before it loads any segment register or takes an
+// interrupt. Each CPU also gets a small data segment for %gs that maps
+// its cpu_t, see smp.h.
+#include "gdt.h"
+#include "smp.h"
+
+#define GDT_ENTRIES (GDT_PERCPU_FIRST + MAX_CPUS)
+
+static struct gdt_entry gdt[GDT_ENTRIES];
+static struct gdt_ptr gdtr;
+
+// From interrupts.asm
+extern void gdt_flush(struct gdt_ptr *ptr);
+
+static void gdt_set(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t granularity) {
+    gdt[index].limit_low = limit & 0xFFFF;
+    gdt[index].base_low = base & 0xFFFF;
+    gdt[index].base_mid = (base >> 16) & 0xFF;
+    gdt[index].access = access;
+    gdt[index].granularity = ((limit >> 16) & 0x0F) | (granularity & 0xF0);
+    gdt[index].base_high = (base >> 24) & 0xFF;
+}
+
+void gdt_init(void) {
+    gdt_set(0, 0, 0, 0, 0);                     // Null descriptor
+    gdt_set(1, 0, 0xFFFFF, 0x9A, 0xC0);         // KERNEL_CODE_SEL: ring 0 code, 4 GiB
+    gdt_set(2, 0, 0xFFFFF, 0x92, 0xC0);         // KERNEL_DATA_SEL: ring 0 data, 4 GiB
+
+    gdtr.limit = sizeof(gdt) - 1;
+    gdtr.base = (uint32_t)gdt;
+    gdt_flush(&gdtr);
+}
+
+void gdt_load(void) {
+    gdt_flush(&gdtr);
+}
+
+// Byte-granular data segment covering [base, base + size)
+void gdt_set_percpu(uint32_t cpu, uint32_t base, uint32_t size) {
+    gdt_set(GDT_PERCPU_FIRST + cpu, base, size - 1, 0x92, 0x40);
+}
@@ -0,0 +1,31 @@
+// gdt.h - Flat kernel GDT
+#include <stdint.h>
+#ifndef GDT_H
+#define GDT_H
+
+#define KERNEL_CODE_SEL 0x08
+#define KERNEL_DATA_SEL 0x10
+// One data segment per CPU follows, based at that CPU's cpu_t
+#define GDT_PERCPU_FIRST 3
+#define PERCPU_SEL(cpu) ((GDT_PERCPU_FIRST + (cpu)) << 3)
+
+struct gdt_entry {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t  base_mid;
+    uint8_t  access;                // Present, ring, type
+    uint8_t  granularity;           // Limit bits 16-19, 4K granularity, 32-bit
+    uint8_t  base_high;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+void gdt_init(void);
+// Load the GDT built by gdt_init() on an application processor
+void gdt_load(void);
+void gdt_set_percpu(uint32_t cpu, uint32_t base, uint32_t size);
+
+#endif // GDT_H
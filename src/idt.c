@@ -0,0 +1,282 @@
+// idt.c - Interrupt descriptor table, 8259 PIC and IRQ dispatch
+//
+// Every vector has one slot in a handler table. Hardware interrupts come
+// in through irq_common, which saves only EAX, ECX and EDX; CPU
+// exceptions come in through exception_common, which saves everything so
+// the default handler can print it.
+#include "gdt.h"
+#include "idt.h"
+#include "io.h"
+#include "ksym.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+#include "vga_output.h"
+
+#define PIC1_COMMAND    0x20
+#define PIC1_DATA       0x21
+#define PIC2_COMMAND    0xA0
+#define PIC2_DATA       0xA1
+#define PIC_EOI         0x20
+#define PIC_READ_ISR    0x0B
+#define PIC_CASCADE_IRQ 2
+
+#define IDT_GATE_INT32  0x8E        // Present, ring 0, 32-bit interrupt gate
+
+struct idt_entry {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t  zero;
+    uint8_t  type_attr;
+    uint16_t offset_high;
+} __attribute__((packed));
+
+struct idt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+// Counted per CPU, so the hot path needs no lock
+typedef struct {
+    uint32_t count;
+    uint64_t cycles;                // In the handler, with CONFIG_PROFILE
+} vector_stats_t;
+
+static struct idt_entry idt[256];
+static struct idt_ptr idtr;
+static irq_handler_t irq_handlers[256];
+static exception_handler_t exception_handlers[EXCEPTION_COUNT];
+static vector_stats_t vector_stats[MAX_CPUS][256];
+
+static const char *exception_names[EXCEPTION_COUNT] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow",
+    "bound range", "invalid opcode", "device not available",
+    "double fault", "coprocessor overrun", "invalid TSS",
+    "segment not present", "stack fault", "general protection",
+    "page fault", "reserved", "x87 error", "alignment check",
+    "machine check", "SIMD error", "virtualization", "control protection",
+    "reserved", "reserved", "reserved", "reserved", "reserved", "reserved",
+    "hypervisor injection", "VMM communication", "security", "reserved",
+};
+
+// From interrupts.asm
+extern void idt_load(struct idt_ptr *ptr);
+extern uint32_t exception_stub_table[EXCEPTION_COUNT];
+extern uint32_t irq_stub_table[IRQ_COUNT];
+extern uint32_t lapic_stub_table[LAPIC_VECTOR_COUNT];
+
+static void idt_set_gate(int vector, uint32_t handler) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SEL;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = IDT_GATE_INT32;
+    idt[vector].offset_high = handler >> 16;
+}
+
+// Move the PICs off the CPU exception vectors and mask every line
+static void pic_remap(void) {
+    outb(PIC1_COMMAND, 0x11);               // ICW1: init, expect ICW4
+    outb(PIC2_COMMAND, 0x11);
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);       // ICW2: vector offsets
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    outb(PIC1_DATA, 1 << PIC_CASCADE_IRQ);  // ICW3: slave on IRQ2
+    outb(PIC2_DATA, PIC_CASCADE_IRQ);
+    outb(PIC1_DATA, 0x01);                  // ICW4: 8086 mode
+    outb(PIC2_DATA, 0x01);
+
+    outb(PIC1_DATA, 0xFF & ~(1 << PIC_CASCADE_IRQ));
+    outb(PIC2_DATA, 0xFF);
+}
+
+static void pic_unmask(int irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+static void pic_eoi(int irq) {
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+// IRQ7/IRQ15 also fire spuriously; the in-service bit tells them apart
+static int pic_spurious(int irq) {
+    if ((irq & 7) != 7) {
+        return 0;
+    }
+
+    uint16_t port = irq < 8 ? PIC1_COMMAND : PIC2_COMMAND;
+    outb(port, PIC_READ_ISR);
+    if (inb(port) & 0x80) {
+        return 0;
+    }
+
+    // A spurious IRQ15 was still a real IRQ2 on the master
+    if (irq == 15) {
+        outb(PIC1_COMMAND, PIC_EOI);
+    }
+    return 1;
+}
+
+/**
+ * idt_init - Install the IDT and remap the PICs
+ *
+ * Needs gdt_init() first. Exceptions without a registered handler halt
+ * the CPU with a register dump. All IRQ lines start masked;
+ * irq_register() unmasks a line when it gets a handler. Interrupts stay disabled until
+ * the caller runs irq_enable().
+ */
+void idt_init(void) {
+    pic_remap();
+
+    for (int vector = 0; vector < EXCEPTION_COUNT; vector++) {
+        idt_set_gate(vector, exception_stub_table[vector]);
+    }
+    for (int irq = 0; irq < IRQ_COUNT; irq++) {
+        idt_set_gate(IRQ_BASE_VECTOR + irq, irq_stub_table[irq]);
+    }
+    for (int i = 0; i < LAPIC_VECTOR_COUNT; i++) {
+        idt_set_gate(LAPIC_VECTOR_BASE + i, lapic_stub_table[i]);
+    }
+
+    idtr.limit = sizeof(idt) - 1;
+    idtr.base = (uint32_t)idt;
+    idt_load(&idtr);
+}
+
+// Application processors share the boot CPU's IDT
+void idt_load_cpu(void) {
+    idt_load(&idtr);
+}
+
+void irq_register(int irq, irq_handler_t handler) {
+    if (irq < 0 || irq >= IRQ_COUNT) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    irq_handlers[IRQ_BASE_VECTOR + irq] = handler;
+    pic_unmask(irq);
+    irq_restore(flags);
+}
+
+// Handlers for local APIC vectors send their own EOI to the LAPIC
+void lapic_register(int vector, irq_handler_t handler) {
+    if (vector < LAPIC_VECTOR_BASE || vector >= LAPIC_VECTOR_BASE + LAPIC_VECTOR_COUNT) {
+        return;
+    }
+
+    irq_handlers[vector] = handler;
+}
+
+// Replace the default (fatal) handler; returning resumes at frame->eip
+void exception_register(int vector, exception_handler_t handler) {
+    if (vector < 0 || vector >= EXCEPTION_COUNT) {
+        return;
+    }
+
+    exception_handlers[vector] = handler;
+}
+
+/**
+ * irq_dispatch - Common C entry for hardware interrupts
+ *
+ * The PIC EOI goes out before the handler runs. A thread switch asked for
+ * by the handler happens after the stats are updated, on the way out.
+ */
+void irq_dispatch(interrupt_frame_t *frame) {
+    uint32_t vector = frame->vector;
+
+    if (vector < LAPIC_VECTOR_BASE) {
+        int irq = vector - IRQ_BASE_VECTOR;
+        if (pic_spurious(irq)) {
+            return;
+        }
+        pic_eoi(irq);
+    }
+
+    vector_stats_t *stats = &vector_stats[this_cpu()->id][vector];
+    stats->count++;
+
+    irq_handler_t handler = irq_handlers[vector];
+    if (handler) {
+#ifdef CONFIG_PROFILE
+        uint64_t start = cycles();
+        handler(frame);
+        stats->cycles += cycles() - start;
+#else
+        handler(frame);
+#endif
+    }
+
+    sched_irq_exit();
+}
+
+static uint32_t read_cr2(void) {
+    uint32_t cr2;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+    return cr2;
+}
+
+/**
+ * exception_dispatch - Common C entry for CPU exceptions
+ *
+ * Runs the registered handler, or prints the frame and halts this CPU.
+ */
+void exception_dispatch(exception_frame_t *frame) {
+    uint32_t vector = frame->vector;
+    vector_stats[this_cpu()->id][vector].count++;
+
+    if (exception_handlers[vector]) {
+        exception_handlers[vector](frame);
+        return;
+    }
+
+    kprintf("\n*** CPU %u: exception %u (%s), error code %x\n",
+            this_cpu()->id, vector, exception_names[vector], frame->error_code);
+    kprintf("eip %x  cs %x  eflags %x", frame->eip, frame->cs, frame->eflags);
+    if (vector == EXC_PAGE_FAULT) {
+        kprintf("  cr2 %x", read_cr2());
+    }
+    uint32_t offset;
+    const char *sym = ksym_lookup(frame->eip, &offset);
+    if (sym) {
+        kprintf("  (%s+%x)", sym, offset);
+    }
+    kprintf("\neax %x  ebx %x  ecx %x  edx %x\n", frame->eax, frame->ebx, frame->ecx, frame->edx);
+    kprintf("esi %x  edi %x  ebp %x  esp %x\n",
+            frame->esi, frame->edi, frame->ebp, frame->esp_unused + 20);
+
+    while (1) {
+        __asm__ volatile ("cli; hlt");
+    }
+}
+
+// One line per vector that fired, summed over CPUs
+void idt_stats_dump(void) {
+    print_string("=== Interrupts ===\n");
+    for (int vector = 0; vector < 256; vector++) {
+        uint32_t count = 0;
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < MAX_CPUS; i++) {
+            if (!cpus[i].online) {
+                continue;
+            }
+            count += vector_stats[i][vector].count;
+            total += vector_stats[i][vector].cycles;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        const char *name = vector < EXCEPTION_COUNT ? exception_names[vector] :
+                           vector < IRQ_BASE_VECTOR + IRQ_COUNT ? "PIC IRQ" : "local APIC";
+#ifdef CONFIG_PROFILE
+        kprintf("vector %u (%s): %u, avg %u cycles in handler\n",
+                vector, name, count, (uint32_t)udiv64(total, count, 0));
+#else
+        kprintf("vector %u (%s): %u\n", vector, name, count);
+#endif
+    }
+}
@@ -0,0 +1,65 @@
+// idt.h - Interrupt descriptor table, 8259 PIC and IRQ dispatch
+#include <stdint.h>
+#ifndef IDT_H
+#define IDT_H
+
+#define IRQ_BASE_VECTOR 32          // PIC IRQs are remapped to vectors 32-47
+#define IRQ_COUNT       16
+#define IRQ_TIMER       0
+#define IRQ_ATA_PRIMARY 14
+#define LAPIC_VECTOR_BASE  0xF0     // Vectors 0xF0-0xFF come from the local APIC
+#define LAPIC_VECTOR_COUNT 16
+
+#define EXCEPTION_COUNT    32       // CPU exceptions use vectors 0-31
+#define EXC_BREAKPOINT     3
+#define EXC_PAGE_FAULT     14
+
+// Stack layout built by irq_common in interrupts.asm. Only the registers
+// a C function may clobber are saved; the handler preserves the rest.
+// EBP is there read-only, as the start of the interrupted frame chain.
+typedef struct {
+    uint32_t edx, ecx, eax;
+    uint32_t ebp;
+    uint32_t vector;
+    uint32_t eip, cs, eflags;       // Pushed by the CPU
+} interrupt_frame_t;
+
+// Stack layout built by exception_common: every register, for the dump
+typedef struct {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp_unused, ebx, edx, ecx, eax;   // pusha
+    uint32_t vector;
+    uint32_t error_code;            // 0 for exceptions without one
+    uint32_t eip, cs, eflags;       // Pushed by the CPU
+} exception_frame_t;
+
+typedef void (*irq_handler_t)(interrupt_frame_t *frame);
+typedef void (*exception_handler_t)(exception_frame_t *frame);
+
+void idt_init(void);
+void idt_load_cpu(void);
+void irq_register(int irq, irq_handler_t handler);
+void lapic_register(int vector, irq_handler_t handler);
+void exception_register(int vector, exception_handler_t handler);
+void irq_dispatch(interrupt_frame_t *frame);
+void exception_dispatch(exception_frame_t *frame);
+
+// Per-vector interrupt counts, and handler cycles with CONFIG_PROFILE
+void idt_stats_dump(void);
+
+// Disable interrupts, returning the previous EFLAGS for irq_restore()
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    __asm__ volatile ("pushl %0\n\tpopfl" : : "r"(flags) : "memory", "cc");
+}
+
+static inline void irq_enable(void) {
+    __asm__ volatile ("sti" : : : "memory");
+}
+
+#endif // IDT_H
@@ -0,0 +1,257 @@
+; interrupts.asm - GDT/IDT loading, exception and interrupt entry stubs
+
+KERNEL_CODE_SEL equ 0x08
+KERNEL_DATA_SEL equ 0x10
+IRQ_BASE_VECTOR equ 32
+LAPIC_VECTOR_BASE equ 0xF0
+
+section .text
+
+; void gdt_flush(struct gdt_ptr *ptr)
+; Loads the GDT and reloads every segment register from it
+global gdt_flush
+gdt_flush:
+    mov eax, [esp + 4]
+    lgdt [eax]
+    mov ax, KERNEL_DATA_SEL
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    jmp KERNEL_CODE_SEL:.reload_cs
+.reload_cs:
+    ret
+
+; void idt_load(struct idt_ptr *ptr)
+global idt_load
+idt_load:
+    mov eax, [esp + 4]
+    lidt [eax]
+    ret
+
+; CPU exceptions. Stubs for vectors without an error code push a dummy
+; one, so every exception reaches exception_dispatch with the same
+; exception_frame_t layout.
+%macro EXC_STUB 1
+exc_stub_%1:
+    push dword 0
+    push dword %1
+    jmp exception_common
+%endmacro
+
+%macro EXC_STUB_ERR 1
+exc_stub_%1:
+    push dword %1
+    jmp exception_common
+%endmacro
+
+EXC_STUB 0
+EXC_STUB 1
+EXC_STUB 2
+EXC_STUB 3
+EXC_STUB 4
+EXC_STUB 5
+EXC_STUB 6
+EXC_STUB 7
+EXC_STUB_ERR 8
+EXC_STUB 9
+EXC_STUB_ERR 10
+EXC_STUB_ERR 11
+EXC_STUB_ERR 12
+EXC_STUB_ERR 13
+EXC_STUB_ERR 14
+EXC_STUB 15
+EXC_STUB 16
+EXC_STUB_ERR 17
+EXC_STUB 18
+EXC_STUB 19
+EXC_STUB 20
+EXC_STUB_ERR 21
+EXC_STUB 22
+EXC_STUB 23
+EXC_STUB 24
+EXC_STUB 25
+EXC_STUB 26
+EXC_STUB 27
+EXC_STUB 28
+EXC_STUB_ERR 29
+EXC_STUB_ERR 30
+EXC_STUB 31
+
+; Hardware interrupts have no error code; each stub only pushes its
+; vector so that irq_dispatch gets an interrupt_frame_t
+%macro IRQ_STUB 1
+irq_stub_%1:
+    push dword IRQ_BASE_VECTOR + %1
+    jmp irq_common
+%endmacro
+
+IRQ_STUB 0
+IRQ_STUB 1
+IRQ_STUB 2
+IRQ_STUB 3
+IRQ_STUB 4
+IRQ_STUB 5
+IRQ_STUB 6
+IRQ_STUB 7
+IRQ_STUB 8
+IRQ_STUB 9
+IRQ_STUB 10
+IRQ_STUB 11
+IRQ_STUB 12
+IRQ_STUB 13
+IRQ_STUB 14
+IRQ_STUB 15
+
+; Local APIC vectors (IPIs and the spurious vector) use the same frame
+%macro LAPIC_STUB 1
+lapic_stub_%1:
+    push dword LAPIC_VECTOR_BASE + %1
+    jmp irq_common
+%endmacro
+
+LAPIC_STUB 0
+LAPIC_STUB 1
+LAPIC_STUB 2
+LAPIC_STUB 3
+LAPIC_STUB 4
+LAPIC_STUB 5
+LAPIC_STUB 6
+LAPIC_STUB 7
+LAPIC_STUB 8
+LAPIC_STUB 9
+LAPIC_STUB 10
+LAPIC_STUB 11
+LAPIC_STUB 12
+LAPIC_STUB 13
+LAPIC_STUB 14
+LAPIC_STUB 15
+
+extern irq_dispatch
+extern exception_dispatch
+
+; Fast path: the kernel runs everything in ring 0 with flat segments that
+; never change, so there are no segment registers to save or reload, and
+; irq_dispatch preserves EBX, ESI, EDI and EBP itself like any C function.
+; A thread switch from sched_irq_exit saves those in context_switch.
+; EBP is pushed anyway so the sampler can walk the interrupted stack.
+irq_common:
+    push ebp
+    push eax
+    push ecx
+    push edx
+    cld
+
+    push esp                ; interrupt_frame_t *
+    call irq_dispatch
+    add esp, 4
+
+    pop edx
+    pop ecx
+    pop eax
+    add esp, 8              ; ebp (unchanged), vector
+    iret
+
+; Exceptions are rare, and the default handler prints every register
+exception_common:
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, KERNEL_DATA_SEL
+    mov ds, ax
+    mov es, ax
+    cld
+
+    push esp                ; exception_frame_t *
+    call exception_dispatch
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8              ; vector and error code
+    iret
+
+section .rodata
+
+; Stub addresses for idt_init(), indexed by exception vector
+global exception_stub_table
+exception_stub_table:
+    dd exc_stub_0
+    dd exc_stub_1
+    dd exc_stub_2
+    dd exc_stub_3
+    dd exc_stub_4
+    dd exc_stub_5
+    dd exc_stub_6
+    dd exc_stub_7
+    dd exc_stub_8
+    dd exc_stub_9
+    dd exc_stub_10
+    dd exc_stub_11
+    dd exc_stub_12
+    dd exc_stub_13
+    dd exc_stub_14
+    dd exc_stub_15
+    dd exc_stub_16
+    dd exc_stub_17
+    dd exc_stub_18
+    dd exc_stub_19
+    dd exc_stub_20
+    dd exc_stub_21
+    dd exc_stub_22
+    dd exc_stub_23
+    dd exc_stub_24
+    dd exc_stub_25
+    dd exc_stub_26
+    dd exc_stub_27
+    dd exc_stub_28
+    dd exc_stub_29
+    dd exc_stub_30
+    dd exc_stub_31
+
+; Stub addresses for idt_init(), indexed by IRQ number
+global irq_stub_table
+irq_stub_table:
+    dd irq_stub_0
+    dd irq_stub_1
+    dd irq_stub_2
+    dd irq_stub_3
+    dd irq_stub_4
+    dd irq_stub_5
+    dd irq_stub_6
+    dd irq_stub_7
+    dd irq_stub_8
+    dd irq_stub_9
+    dd irq_stub_10
+    dd irq_stub_11
+    dd irq_stub_12
+    dd irq_stub_13
+    dd irq_stub_14
+    dd irq_stub_15
+
+; Stub addresses for vectors LAPIC_VECTOR_BASE and up
+global lapic_stub_table
+lapic_stub_table:
+    dd lapic_stub_0
+    dd lapic_stub_1
+    dd lapic_stub_2
+    dd lapic_stub_3
+    dd lapic_stub_4
+    dd lapic_stub_5
+    dd lapic_stub_6
+    dd lapic_stub_7
+    dd lapic_stub_8
+    dd lapic_stub_9
+    dd lapic_stub_10
+    dd lapic_stub_11
+    dd lapic_stub_12
+    dd lapic_stub_13
+    dd lapic_stub_14
+    dd lapic_stub_15
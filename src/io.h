@@ -0,0 +1,20 @@
+// io.h - x86 port I/O helpers
+#include <stdint.h>
+#ifndef IO_H
+#define IO_H
+
+static inline void outb(uint16_t port, uint8_t value) {
+    __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void inw_rep(uint16_t port, void* buffer, uint32_t count) {
+    __asm__ volatile ("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+#endif // IO_H
@@ -2,429 +2,108 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include "async.h"
+#include "bench.h"
+#include "cpu.h"
+#include "crc32c.h"
+#include "disk.h"
+#include "elf.h"
+#include "exfat.h"
+#include "fat.h"
+#include "idt.h"
+#include "io.h"
+#include "ksym.h"
+#include "lz4.h"
+#include "multiboot.h"
+#include "page.h"
+#include "prof.h"
+#include "ramdisk.h"
+#include "sampler.h"
+#include "serial.h"
+#include "simd.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "timer.h"
+#include "trace.h"
+#include "vfs.h"
+#include "vga_output.h"
 
-// VGA text mode buffer
-#define VGA_WIDTH  80
-#define VGA_HEIGHT 25
-#define VGA_MEMORY 0xB8000
-
-// VGA color codes
-#define VGA_COLOR_BLACK         0
-#define VGA_COLOR_BLUE          1
-#define VGA_COLOR_GREEN         2
-#define VGA_COLOR_CYAN          3
-#define VGA_COLOR_RED           4
-#define VGA_COLOR_MAGENTA       5
-#define VGA_COLOR_BROWN         6
-#define VGA_COLOR_LIGHT_GREY    7
-#define VGA_COLOR_DARK_GREY     8
-#define VGA_COLOR_LIGHT_BLUE    9
-#define VGA_COLOR_LIGHT_GREEN   10
-#define VGA_COLOR_LIGHT_CYAN    11
-#define VGA_COLOR_LIGHT_RED     12
-#define VGA_COLOR_LIGHT_MAGENTA 13
-#define VGA_COLOR_YELLOW        14
-#define VGA_COLOR_WHITE         15
-
-void vga_init(void);
-void vga_clear(void);
-void kputchar(char c);
-void kputs(const char* str);
-void print_string(const char* str);
-void print_dec(uint32_t num);
-void print_int(int32_t num);
-void print_hex(uint32_t num);
-void print_hex8(uint8_t num);
-void kprintf(const char* fmt, ...);
-
-// FAT Boot Sector structure (FAT12/16/32)
-typedef struct {
-    uint8_t  jmp[3];                // Jump instruction
-    char     oem[8];                // OEM name
-    uint16_t bytes_per_sector;      // Bytes per sector
-    uint8_t  sectors_per_cluster;   // Sectors per cluster
-    uint16_t reserved_sectors;      // Reserved sectors
-    uint8_t  num_fats;              // Number of FATs
-    uint16_t root_entries;          // Root directory entries (FAT12/16)
-    uint16_t total_sectors_16;      // Total sectors (if < 65536)
-    uint8_t  media_type;            // Media descriptor
-    uint16_t sectors_per_fat_16;    // Sectors per FAT (FAT12/16)
-    uint16_t sectors_per_track;     // Sectors per track
-    uint16_t num_heads;             // Number of heads
-    uint32_t hidden_sectors;        // Hidden sectors
-    uint32_t total_sectors_32;      // Total sectors (if >= 65536)
-    
-    // FAT32 specific fields
-    uint32_t sectors_per_fat_32;    // Sectors per FAT (FAT32)
-    uint16_t flags;                 // Flags
-    uint16_t version;               // Version
-    uint32_t root_cluster;          // Root directory cluster (FAT32)
-    uint16_t fsinfo_sector;         // FSInfo sector
-    uint16_t backup_boot_sector;    // Backup boot sector
-    uint8_t  reserved[12];          // Reserved
-    uint8_t  drive_num;             // Drive number
-    uint8_t  reserved1;             // Reserved
-    uint8_t  boot_sig;              // Boot signature
-    uint32_t volume_id;             // Volume ID
-    char     volume_label[11];      // Volume label
-    char     fs_type[8];            // Filesystem type
-} __attribute__((packed)) FAT_BootSector;
-
-// FAT Directory Entry structure
-typedef struct {
-    char     name[8];               // Filename (space-padded)
-    char     ext[3];                // Extension (space-padded)
-    uint8_t  attr;                  // File attributes
-    uint8_t  reserved;              // Reserved
-    uint8_t  create_time_tenth;     // Creation time (tenths of second)
-    uint16_t create_time;           // Creation time
-    uint16_t create_date;           // Creation date
-    uint16_t access_date;           // Last access date
-    uint16_t cluster_high;          // High word of first cluster (FAT32)
-    uint16_t modify_time;           // Modification time
-    uint16_t modify_date;           // Modification date
-    uint16_t cluster_low;           // Low word of first cluster
-    uint32_t file_size;             // File size in bytes
-} __attribute__((packed)) FAT_DirEntry;
-
-// File attributes
-#define FAT_ATTR_READ_ONLY  0x01
-#define FAT_ATTR_HIDDEN     0x02
-#define FAT_ATTR_SYSTEM     0x04
-#define FAT_ATTR_VOLUME_ID  0x08
-#define FAT_ATTR_DIRECTORY  0x10
-#define FAT_ATTR_ARCHIVE    0x20
-#define FAT_ATTR_LFN        0x0F  // Long filename entry
-
-// FAT type enum
-typedef enum {
-    FAT_TYPE_12,
-    FAT_TYPE_16,
-    FAT_TYPE_32
-} FAT_Type;
-
-// Global FAT driver state
-typedef struct {
-    FAT_BootSector boot_sector;
-    uint8_t *fat_table;             // Pointer to FAT in memory
-    uint32_t fat_size;              // Size of FAT in bytes
-    uint32_t data_start_sector;     // First sector of data region
-    uint32_t root_dir_sectors;      // Sectors used by root directory
-    uint32_t first_data_sector;     // First sector containing data
-    FAT_Type fat_type;              // Type of FAT (12/16/32)
-    bool initialized;
-} FAT_State;
-
-static FAT_State g_fat_state = {0};
-
-// File handle structure
-typedef struct {
-    uint32_t first_cluster;         // First cluster of file
-    uint32_t current_cluster;       // Current cluster being read
-    uint32_t file_size;             // Total file size
-    uint32_t position;              // Current position in file
-    bool is_open;
-} FAT_FileHandle;
-
-// External functions you need to provide in your kernel:
-// - disk_read(sector, count, buffer): Read sectors from disk
-// - kmalloc(size): Allocate kernel memory
-// - kfree(ptr): Free kernel memory
-extern int disk_read(uint32_t sector, uint32_t count, void *buffer);
-extern void* kmalloc(size_t size);
-extern void kfree(void *ptr);
-
-// Helper function: Get total sectors
-static uint32_t get_total_sectors(FAT_BootSector *bs) {
-    return (bs->total_sectors_16 != 0) ? bs->total_sectors_16 : bs->total_sectors_32;
-}
-
-// Helper function: Get sectors per FAT
-static uint32_t get_sectors_per_fat(FAT_BootSector *bs) {
-    return (bs->sectors_per_fat_16 != 0) ? bs->sectors_per_fat_16 : bs->sectors_per_fat_32;
-}
-
-// Helper function: Determine FAT type
-static FAT_Type determine_fat_type(FAT_BootSector *bs) {
-    uint32_t total_sectors = get_total_sectors(bs);
-    uint32_t fat_size = get_sectors_per_fat(bs);
-    uint32_t root_dir_sectors = ((bs->root_entries * 32) + (bs->bytes_per_sector - 1)) / bs->bytes_per_sector;
-    uint32_t data_sectors = total_sectors - (bs->reserved_sectors + (bs->num_fats * fat_size) + root_dir_sectors);
-    uint32_t total_clusters = data_sectors / bs->sectors_per_cluster;
-    
-    if (total_clusters < 4085) {
-        return FAT_TYPE_12;
-    } else if (total_clusters < 65525) {
-        return FAT_TYPE_16;
-    } else {
-        return FAT_TYPE_32;
-    }
-}
-
-// Helper function: Get next cluster from FAT
-static uint32_t get_next_cluster(uint32_t cluster) {
-    uint32_t next_cluster = 0;
-    
-    switch (g_fat_state.fat_type) {
-        case FAT_TYPE_12: {
-            uint32_t fat_offset = cluster + (cluster / 2);  // multiply by 1.5
-            uint16_t fat_value = *(uint16_t*)&g_fat_state.fat_table[fat_offset];
-            
-            if (cluster & 1) {
-                next_cluster = fat_value >> 4;
-            } else {
-                next_cluster = fat_value & 0x0FFF;
-            }
-            
-            if (next_cluster >= 0x0FF8) next_cluster = 0xFFFFFFFF;  // EOC marker
-            break;
-        }
-        case FAT_TYPE_16: {
-            uint32_t fat_offset = cluster * 2;
-            next_cluster = *(uint16_t*)&g_fat_state.fat_table[fat_offset];
-            
-            if (next_cluster >= 0xFFF8) next_cluster = 0xFFFFFFFF;  // EOC marker
-            break;
-        }
-        case FAT_TYPE_32: {
-            uint32_t fat_offset = cluster * 4;
-            next_cluster = *(uint32_t*)&g_fat_state.fat_table[fat_offset] & 0x0FFFFFFF;
-            
-            if (next_cluster >= 0x0FFFFFF8) next_cluster = 0xFFFFFFFF;  // EOC marker
-            break;
-        }
-    }
-    
-    return next_cluster;
-}
+// ============================================================================
+// STRING FUNCTIONS (freestanding implementations)
+// ============================================================================
 
-// Helper function: Get first sector of a cluster
-static uint32_t cluster_to_sector(uint32_t cluster) {
-    return ((cluster - 2) * g_fat_state.boot_sector.sectors_per_cluster) + g_fat_state.first_data_sector;
-}
+// The block functions below are written for the i386 string instructions.
+// A byte head brings the destination up to a 4-byte boundary, the body
+// moves whole dwords with "rep movsd"/"rep stosd" and a byte tail finishes
+// the remainder. Building with CPU=erms (-DCONFIG_ERMS) replaces the body
+// with a single "rep movsb"/"rep stosb", which CPUs with Enhanced REP
+// MOVSB/STOSB run at full speed without any alignment work.
+// Everything here relies on the direction flag being clear (see _start).
 
-/**
- * fatInit - Initialize the FAT filesystem driver
- * 
- * Reads the boot sector and FAT table into memory.
- * Must be called before using fatOpen or fatRead.
- * 
- * Returns: 0 on success, -1 on failure
- */
-int fatInit(void) {
-    // Read boot sector
-    if (disk_read(0, 1, &g_fat_state.boot_sector) != 0) {
-        return -1;
-    }
-    
-    // Validate boot sector signature
-    uint8_t *boot_sig = (uint8_t*)&g_fat_state.boot_sector + 510;
-    if (boot_sig[0] != 0x55 || boot_sig[1] != 0xAA) {
-        return -1;
-    }
-    
-    // Calculate filesystem parameters
-    g_fat_state.fat_type = determine_fat_type(&g_fat_state.boot_sector);
-    
-    uint32_t fat_size = get_sectors_per_fat(&g_fat_state.boot_sector);
-    g_fat_state.root_dir_sectors = ((g_fat_state.boot_sector.root_entries * 32) + 
-                                    (g_fat_state.boot_sector.bytes_per_sector - 1)) / 
-                                    g_fat_state.boot_sector.bytes_per_sector;
-    
-    g_fat_state.first_data_sector = g_fat_state.boot_sector.reserved_sectors + 
-                                    (g_fat_state.boot_sector.num_fats * fat_size) + 
-                                    g_fat_state.root_dir_sectors;
-    
-    // Allocate memory for FAT table
-    g_fat_state.fat_size = fat_size * g_fat_state.boot_sector.bytes_per_sector;
-    g_fat_state.fat_table = (uint8_t*)kmalloc(g_fat_state.fat_size);
-    if (!g_fat_state.fat_table) {
-        return -1;
-    }
-    
-    // Read FAT table into memory
-    if (disk_read(g_fat_state.boot_sector.reserved_sectors, fat_size, g_fat_state.fat_table) != 0) {
-        kfree(g_fat_state.fat_table);
-        return -1;
-    }
-    
-    g_fat_state.initialized = true;
-    return 0;
-}
+// Copies shorter than this go straight to the byte tail
+#define MEM_SMALL_COPY 16
 
-/**
- * fatOpen - Open a file in the FAT filesystem
- * 
- * Searches for the file in the root directory and initializes a file handle.
- * Currently only supports files in the root directory.
- * 
- * @filename: Name of the file to open (8.3 format, e.g., "FILE.TXT")
- * @handle: Pointer to file handle structure to initialize
- * 
- * Returns: 0 on success, -1 on failure
- */
-int fatOpen(const char *filename, FAT_FileHandle *handle) {
-    if (!g_fat_state.initialized || !filename || !handle) {
-        return -1;
-    }
-    
-    // Parse filename into 8.3 format
-    char name[8] = "        ";
-    char ext[3] = "   ";
-    
-    const char *dot = strchr(filename, '.');
-    if (dot) {
-        int name_len = dot - filename;
-        if (name_len > 8) name_len = 8;
-        memcpy(name, filename, name_len);
-        
-        int ext_len = strlen(dot + 1);
-        if (ext_len > 3) ext_len = 3;
-        memcpy(ext, dot + 1, ext_len);
-    } else {
-        int name_len = strlen(filename);
-        if (name_len > 8) name_len = 8;
-        memcpy(name, filename, name_len);
-    }
-    
-    // Convert to uppercase
-    for (int i = 0; i < 8; i++) {
-        if (name[i] >= 'a' && name[i] <= 'z') name[i] -= 32;
-    }
-    for (int i = 0; i < 3; i++) {
-        if (ext[i] >= 'a' && ext[i] <= 'z') ext[i] -= 32;
-    }
-    
-    // Read root directory
-    uint32_t root_dir_sector = g_fat_state.boot_sector.reserved_sectors + 
-                               (g_fat_state.boot_sector.num_fats * get_sectors_per_fat(&g_fat_state.boot_sector));
-    
-    FAT_DirEntry *dir_entries = (FAT_DirEntry*)kmalloc(g_fat_state.root_dir_sectors * g_fat_state.boot_sector.bytes_per_sector);
-    if (!dir_entries) {
-        return -1;
-    }
-    
-    if (disk_read(root_dir_sector, g_fat_state.root_dir_sectors, dir_entries) != 0) {
-        kfree(dir_entries);
-        return -1;
-    }
-    
-    // Search for file
-    uint32_t num_entries = (g_fat_state.root_dir_sectors * g_fat_state.boot_sector.bytes_per_sector) / sizeof(FAT_DirEntry);
-    bool found = false;
-    
-    for (uint32_t i = 0; i < num_entries; i++) {
-        FAT_DirEntry *entry = &dir_entries[i];
-        
-        // Check for end of directory
-        if (entry->name[0] == 0x00) break;
-        
-        // Skip deleted entries and LFN entries
-        if (entry->name[0] == 0xE5 || entry->attr == FAT_ATTR_LFN) continue;
-        
-        // Skip directories and volume labels
-        if (entry->attr & (FAT_ATTR_DIRECTORY | FAT_ATTR_VOLUME_ID)) continue;
-        
-        // Compare filename
-        if (memcmp(entry->name, name, 8) == 0 && memcmp(entry->ext, ext, 3) == 0) {
-            // File found!
-            uint32_t cluster = entry->cluster_low | ((uint32_t)entry->cluster_high << 16);
-            
-            handle->first_cluster = cluster;
-            handle->current_cluster = cluster;
-            handle->file_size = entry->file_size;
-            handle->position = 0;
-            handle->is_open = true;
-            
-            found = true;
-            break;
-        }
-    }
-    
-    kfree(dir_entries);
-    return found ? 0 : -1;
-}
+// 32-bit load that is allowed to alias any object
+typedef uint32_t __attribute__((may_alias)) mem_word_t;
 
-/**
- * fatRead - Read data from an open file
- * 
- * Reads up to 'size' bytes from the current position in the file.
- * Advances the file position by the number of bytes read.
- * 
- * @handle: Pointer to open file handle
- * @buffer: Buffer to read data into
- * @size: Maximum number of bytes to read
- * 
- * Returns: Number of bytes read, or -1 on error
- */
-int fatRead(FAT_FileHandle *handle, void *buffer, uint32_t size) {
-    if (!g_fat_state.initialized || !handle || !handle->is_open || !buffer) {
-        return -1;
-    }
-    
-    // Check if we're at end of file
-    if (handle->position >= handle->file_size) {
-        return 0;
-    }
-    
-    // Limit read size to remaining file size
-    if (handle->position + size > handle->file_size) {
-        size = handle->file_size - handle->position;
-    }
-    
-    uint32_t bytes_read = 0;
-    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
-    
-    // Allocate temporary cluster buffer
-    uint8_t *cluster_buffer = (uint8_t*)kmalloc(cluster_size);
-    if (!cluster_buffer) {
-        return -1;
+void* memcpy(void* dest, const void* src, size_t n) {
+    void* d = dest;
+
+#ifdef CONFIG_SSE2
+    if (simd_enabled && n >= SIMD_MIN_BYTES) {
+        return sse2_memcpy(dest, src, n);
     }
-    
-    while (bytes_read < size && handle->current_cluster != 0xFFFFFFFF) {
-        // Calculate offset within current cluster
-        uint32_t cluster_offset = handle->position % cluster_size;
-        uint32_t bytes_to_read = cluster_size - cluster_offset;
-        
-        if (bytes_to_read > size - bytes_read) {
-            bytes_to_read = size - bytes_read;
-        }
-        
-        // Read cluster from disk
-        uint32_t sector = cluster_to_sector(handle->current_cluster);
-        if (disk_read(sector, g_fat_state.boot_sector.sectors_per_cluster, cluster_buffer) != 0) {
-            kfree(cluster_buffer);
-            return -1;
-        }
-        
-        // Copy data to output buffer
-        memcpy((uint8_t*)buffer + bytes_read, cluster_buffer + cluster_offset, bytes_to_read);
-        
-        bytes_read += bytes_to_read;
-        handle->position += bytes_to_read;
-        
-        // Move to next cluster if needed
-        if ((handle->position % cluster_size) == 0 && bytes_read < size) {
-            handle->current_cluster = get_next_cluster(handle->current_cluster);
-        }
+#endif
+
+#ifndef CONFIG_ERMS
+    if (n >= MEM_SMALL_COPY) {
+        size_t head = -(uintptr_t)d & 3;
+        size_t dwords = (n - head) >> 2;
+        n = (n - head) & 3;
+
+        __asm__ volatile ("rep movsb" : "+D"(d), "+S"(src), "+c"(head) : : "memory");
+        __asm__ volatile ("rep movsl" : "+D"(d), "+S"(src), "+c"(dwords) : : "memory");
     }
-    
-    kfree(cluster_buffer);
-    return bytes_read;
-}
+#endif
 
-// ============================================================================
-// STRING FUNCTIONS (freestanding implementations)
-// ============================================================================
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dest;
+}
 
-void* memcpy(void* dest, const void* src, size_t n) {
+void* memmove(void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
     const uint8_t* s = (const uint8_t*)src;
 
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+    // Forward copy is safe unless dest starts inside the source range
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+
+    // Overlapping with dest above src: copy backwards from the last byte
+    d += n - 1;
+    s += n - 1;
+
+#ifndef CONFIG_ERMS
+    if (n >= MEM_SMALL_COPY) {
+        size_t tail = ((uintptr_t)d + 1) & 3;
+        size_t dwords = (n - tail) >> 2;
+        n = (n - tail) & 3;
+
+        __asm__ volatile ("std\n\trep movsb\n\tcld"
+                          : "+D"(d), "+S"(s), "+c"(tail) : : "memory");
+        // movsd addresses the dword ending at the current byte
+        d -= 3;
+        s -= 3;
+        __asm__ volatile ("std\n\trep movsl\n\tcld"
+                          : "+D"(d), "+S"(s), "+c"(dwords) : : "memory");
+        d += 3;
+        s += 3;
     }
+#endif
 
+    __asm__ volatile ("std\n\trep movsb\n\tcld"
+                      : "+D"(d), "+S"(s), "+c"(n) : : "memory");
     return dest;
 }
 
@@ -432,6 +111,19 @@ int memcmp(const void* s1, const void* s2, size_t n) {
     const uint8_t* p1 = (const uint8_t*)s1;
     const uint8_t* p2 = (const uint8_t*)s2;
 
+#ifdef CONFIG_SSE2
+    if (simd_enabled && n >= SIMD_MIN_BYTES) {
+        return sse2_memcmp(s1, s2, n);
+    }
+#endif
+
+    // Skip equal dwords; a mismatching one is resolved bytewise below
+    while (n >= 4 && *(const mem_word_t*)p1 == *(const mem_word_t*)p2) {
+        p1 += 4;
+        p2 += 4;
+        n -= 4;
+    }
+
     for (size_t i = 0; i < n; i++) {
         if (p1[i] != p2[i]) {
             return p1[i] - p2[i];
@@ -442,15 +134,112 @@ int memcmp(const void* s1, const void* s2, size_t n) {
 }
 
 void* memset(void* s, int c, size_t n) {
-    uint8_t* p = (uint8_t*)s;
+    void* p = s;
 
-    for (size_t i = 0; i < n; i++) {
-        p[i] = (uint8_t)c;
+#ifdef CONFIG_SSE2
+    if (simd_enabled && n >= SIMD_MIN_BYTES) {
+        return sse2_memset(s, c, n);
     }
+#endif
 
+#ifndef CONFIG_ERMS
+    if (n >= MEM_SMALL_COPY) {
+        uint32_t fill = (uint8_t)c * 0x01010101u;
+        size_t head = -(uintptr_t)p & 3;
+        size_t dwords = (n - head) >> 2;
+        n = (n - head) & 3;
+
+        __asm__ volatile ("rep stosb" : "+D"(p), "+c"(head) : "a"(fill) : "memory");
+        __asm__ volatile ("rep stosl" : "+D"(p), "+c"(dwords) : "a"(fill) : "memory");
+    }
+#endif
+
+    __asm__ volatile ("rep stosb" : "+D"(p), "+c"(n) : "a"(c) : "memory");
     return s;
 }
 
+/**
+ * checksum32 - Position-dependent checksum of a memory block
+ *
+ * Fletcher-style sum over four interleaved 32-bit lanes: every 16-byte
+ * block adds its dwords to the running sums A and then adds A to B. The
+ * final partial block is zero-padded. The lane layout is what lets the
+ * SSE2 profile compute the same value with one paddd per step.
+ *
+ * Returns: (sum(A) + n) ^ rotl(sum(B), 16)
+ */
+uint32_t checksum32(const void* buf, size_t n) {
+#ifdef CONFIG_SSE2
+    if (simd_enabled && n >= SIMD_MIN_BYTES) {
+        return sse2_checksum32(buf, n);
+    }
+#endif
+
+    const uint8_t* p = (const uint8_t*)buf;
+    uint32_t a[4] = {0, 0, 0, 0};
+    uint32_t b[4] = {0, 0, 0, 0};
+
+    for (size_t off = 0; off < n; off += 16) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint32_t word = 0;
+            for (int i = 3; i >= 0; i--) {
+                size_t idx = off + lane * 4 + i;
+                word = (word << 8) | (idx < n ? p[idx] : 0);
+            }
+            a[lane] += word;
+            b[lane] += a[lane];
+        }
+    }
+
+    uint32_t sum_a = a[0] + a[1] + a[2] + a[3];
+    uint32_t sum_b = b[0] + b[1] + b[2] + b[3];
+    return (sum_a + (uint32_t)n) ^ ((sum_b << 16) | (sum_b >> 16));
+}
+
+// Known answer for checksum_selftest: 2013 bytes of (i * 7 + 3), long
+// enough for the SSE2 kernel and ending in a partial block
+#define CHECKSUM_TEST_BYTES     2013
+#define CHECKSUM_TEST_EXPECTED  0xc3bb63e9
+
+/**
+ * checksum_selftest - Check checksum32 against a known answer
+ *
+ * Runs the scalar loop and, when SSE2 is enabled, the vector kernel, and
+ * compares each with a value computed off-line, so a bug shared by both
+ * paths is caught too.
+ *
+ * Returns: 0 if every enabled path matches, -1 otherwise
+ */
+static int checksum_selftest(void) {
+    static uint8_t buf[CHECKSUM_TEST_BYTES];
+    for (uint32_t i = 0; i < CHECKSUM_TEST_BYTES; i++) {
+        buf[i] = (uint8_t)(i * 7 + 3);
+    }
+
+#ifdef CONFIG_SSE2
+    int saved_simd = simd_enabled;
+    simd_enabled = 0;
+#endif
+    uint32_t scalar = checksum32(buf, CHECKSUM_TEST_BYTES);
+#ifdef CONFIG_SSE2
+    simd_enabled = saved_simd;
+#endif
+    if (scalar != CHECKSUM_TEST_EXPECTED) {
+        kprintf("checksum32 self-test: scalar %x, expected %x\n", scalar, CHECKSUM_TEST_EXPECTED);
+        return -1;
+    }
+#ifdef CONFIG_SSE2
+    if (simd_enabled) {
+        uint32_t vector = checksum32(buf, CHECKSUM_TEST_BYTES);
+        if (vector != CHECKSUM_TEST_EXPECTED) {
+            kprintf("checksum32 self-test: SSE2 %x, expected %x\n", vector, CHECKSUM_TEST_EXPECTED);
+            return -1;
+        }
+    }
+#endif
+    return 0;
+}
+
 size_t strlen(const char* s) {
     size_t len = 0;
     while (s[len] != '\0') {
@@ -479,43 +268,185 @@ char* strchr(const char* s, int c) {
 // ============================================================================
 
 // Simple bump allocator for kernel (you should replace with a proper allocator)
-#define HEAP_SIZE (1024 * 1024)  // 1MB heap
-static uint8_t heap[HEAP_SIZE];
+// Each block is preceded by its size so that kfree can hand back the most
+// recent allocation. That keeps per-call scratch buffers (fatOpen's
+// directory buffer, fatRead's cluster buffer) from leaking.
+// The heap is carved out of RAM by kmalloc_init, an eighth of it within
+// these bounds.
+#define HEAP_MIN_SIZE (1024 * 1024)
+#define HEAP_MAX_SIZE (16 * 1024 * 1024)
+static uint8_t* heap = NULL;
+static size_t heap_size = 0;
 static size_t heap_offset = 0;
+static spinlock_t heap_lock = SPINLOCK_INIT;
+
+// Every block is charged to the code that allocated it, found by the
+// return address; kmalloc_report() names the sites with ksym
+#define KMALLOC_SITES 32
+
+typedef struct {
+    uint32_t caller;                // Return address into the allocating function
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+} kmalloc_site_t;
+
+typedef struct {
+    uint32_t size;                  // Rounded up to 4 bytes
+    uint16_t site;                  // Index into kmalloc_sites
+    uint16_t freed;
+} kmalloc_header_t;
+
+// Slot 0 takes the allocations of any sites past the first KMALLOC_SITES - 1
+static kmalloc_site_t kmalloc_sites[KMALLOC_SITES];
+static uint32_t kmalloc_num_sites = 1;
+static size_t heap_peak = 0;        // High-water mark of heap_offset
+static size_t heap_live = 0;        // Bytes in blocks not freed yet
+static size_t heap_stranded = 0;    // Freed out of order, so not reusable
+static uint32_t kfree_double = 0;
+
+// Find or add the site for @caller; heap_lock held
+static kmalloc_site_t* kmalloc_site(uint32_t caller) {
+    for (uint32_t i = 1; i < kmalloc_num_sites; i++) {
+        if (kmalloc_sites[i].caller == caller) {
+            return &kmalloc_sites[i];
+        }
+    }
+    if (kmalloc_num_sites == KMALLOC_SITES) {
+        return &kmalloc_sites[0];
+    }
+    kmalloc_sites[kmalloc_num_sites].caller = caller;
+    return &kmalloc_sites[kmalloc_num_sites++];
+}
+
+// Call after init_pfa_list
+static void kmalloc_init(void) {
+    size_t size = (size_t)physical_page_count * PAGE_SIZE / 8;
+    if (size < HEAP_MIN_SIZE) {
+        size = HEAP_MIN_SIZE;
+    }
+    if (size > HEAP_MAX_SIZE) {
+        size = HEAP_MAX_SIZE;
+    }
+
+    heap = page_alloc_contiguous(size / PAGE_SIZE);
+    if (!heap && size > HEAP_MIN_SIZE) {
+        size = HEAP_MIN_SIZE;
+        heap = page_alloc_contiguous(size / PAGE_SIZE);
+    }
+    heap_size = heap ? size : 0;
+}
 
 void* kmalloc(size_t size) {
+    uint32_t caller = (uint32_t)__builtin_return_address(0);
+
     // Align to 4-byte boundary
     size = (size + 3) & ~3;
 
-    if (heap_offset + size > HEAP_SIZE) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    kmalloc_site_t* site = kmalloc_site(caller);
+
+    if (heap_offset + sizeof(kmalloc_header_t) + size > heap_size) {
+        site->failures++;
+        spin_unlock_irqrestore(&heap_lock, flags);
+        TRACE_INSTANT(KMALLOC, size, 0);
         return NULL;  // Out of memory
     }
 
-    void* ptr = &heap[heap_offset];
-    heap_offset += size;
+    kmalloc_header_t* header = (kmalloc_header_t*)&heap[heap_offset];
+    header->size = size;
+    header->site = site - kmalloc_sites;
+    header->freed = 0;
+    void* ptr = header + 1;
+    heap_offset += sizeof(kmalloc_header_t) + size;
+
+    if (heap_offset > heap_peak) {
+        heap_peak = heap_offset;
+    }
+    heap_live += size;
+    site->allocs++;
+    site->live_bytes += size;
+    if (site->live_bytes > site->peak_bytes) {
+        site->peak_bytes = site->live_bytes;
+    }
 
+    spin_unlock_irqrestore(&heap_lock, flags);
+    TRACE_INSTANT(KMALLOC, size, ptr);
     return ptr;
 }
 
 void kfree(void* ptr) {
-    // Simple bump allocator doesn't support freeing
-    // You should implement a proper allocator (like a linked list or buddy system)
-    (void)ptr;
-}
+    if (!ptr) {
+        return;
+    }
 
-// Port I/O functions
-static inline void outb(uint16_t port, uint8_t value) {
-    __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
-}
+    kmalloc_header_t* header = (kmalloc_header_t*)ptr - 1;
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    if (header->freed) {
+        kfree_double++;
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return;
+    }
 
-static inline uint8_t inb(uint16_t port) {
-    uint8_t ret;
-    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
+    header->freed = 1;
+    kmalloc_site_t* site = &kmalloc_sites[header->site];
+    site->frees++;
+    site->live_bytes -= header->size;
+    heap_live -= header->size;
+
+    // Only the block on top of the heap can be returned; anything freed out
+    // of order stays allocated until a real allocator replaces this one
+    if ((uint8_t*)ptr + header->size == &heap[heap_offset]) {
+        heap_offset -= sizeof(kmalloc_header_t) + header->size;
+    } else {
+        heap_stranded += header->size;
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
 
-static inline void inw_rep(uint16_t port, void* buffer, uint32_t count) {
-    __asm__ volatile ("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+/**
+ * kmalloc_report - Print heap usage, per allocation site
+ *
+ * "stranded" is memory freed out of order, which the bump allocator
+ * cannot hand out again. Sites are named by the function that called
+ * kmalloc.
+ */
+static void kmalloc_report(void) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    kmalloc_site_t sites[KMALLOC_SITES];
+    uint32_t num_sites = kmalloc_num_sites;
+    memcpy(sites, kmalloc_sites, sizeof(sites));
+    size_t offset = heap_offset, peak = heap_peak, live = heap_live, stranded = heap_stranded;
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    print_string("=== Kernel heap ===\n");
+    kprintf("%u KiB: %u bytes in use, high-water %u, %u live, %u stranded by out-of-order frees\n",
+            (uint32_t)(heap_size / 1024), (uint32_t)offset, (uint32_t)peak,
+            (uint32_t)live, (uint32_t)stranded);
+    if (kfree_double) {
+        kprintf("%u double frees ignored\n", kfree_double);
+    }
+
+    for (uint32_t i = 0; i < num_sites; i++) {
+        kmalloc_site_t* site = &sites[i];
+        if (site->allocs == 0 && site->failures == 0) {
+            continue;
+        }
+
+        uint32_t offset_in;
+        const char* name = ksym_lookup(site->caller - 1, &offset_in);
+        if (i == 0) {
+            print_string("(other sites)");
+        } else if (name) {
+            kprintf("%s+%x", name, offset_in + 1);
+        } else {
+            kprintf("%x", site->caller);
+        }
+        kprintf(": %u allocs, %u frees, %u failed, %u live, %u peak bytes\n",
+                site->allocs, site->frees, site->failures, site->live_bytes, site->peak_bytes);
+    }
 }
 
 // ATA PIO disk reading
@@ -531,21 +462,114 @@ static inline void inw_rep(uint16_t port, void* buffer, uint32_t count) {
 #define ATA_CMD_READ_PIO 0x20
 #define ATA_STATUS_BSY   0x80
 #define ATA_STATUS_DRQ   0x08
+#define ATA_STATUS_ERR   0x01
+#define ATA_DEVICE_CONTROL 0x3F6
+#define ATA_CONTROL_NIEN   0x02    // Set to mask the drive's interrupt
 
-int disk_read(uint32_t sector, uint32_t count, void* buffer) {
-    if (count == 0 || count > 256) return -1;
+// Give up on a command after this long instead of reading garbage
+#define ATA_TIMEOUT_NS  (1000ULL * 1000 * 1000)
+#define ATA_TIMEOUT_TICKS TIMER_HZ
+
+// Poll ATA_STATUS until (status & mask) == want or the deadline passes
+static int ata_wait(uint8_t mask, uint8_t want) {
+    uint64_t deadline = ktime_ns() + ATA_TIMEOUT_NS;
+
+    while ((inb(ATA_STATUS) & mask) != want) {
+        if (ktime_ns() > deadline) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Set by the IRQ14 handler; disk_read sleeps on ata_queue until it is
+static volatile int ata_irq_pending = 0;
+static int ata_irq_enabled = 0;
+static wait_queue_t ata_queue = WAIT_QUEUE_INIT;
+// One command at a time: a sleeping reader must not interleave with another.
+// An asynchronous request holds it from submission until its last sector.
+static kmutex_t ata_mutex;
+// Request whose sectors the IRQ handler transfers, if any
+static disk_request_t *ata_active = 0;
+
+static void ata_complete(disk_request_t *req, int result) {
+    TRACE_ASYNC_END(DISK_READ, req, req->sectors_done, result);
+    ata_active = 0;
+    req->result = result;
+    req->complete_cycles = cycles();
+    req->in_flight = 0;
+    // Signal first: unlocking may switch to a mutex waiter from IRQ14,
+    // which would hold back this request's completion until it yields
+    event_signal(&req->done);
+    mutex_unlock(&ata_mutex);
+}
+
+static void ata_irq(interrupt_frame_t *frame) {
+    (void)frame;
 
-    uint8_t* buf = (uint8_t*)buffer;
+    // Reading the status register acknowledges the interrupt
+    uint8_t status = inb(ATA_STATUS);
 
+    disk_request_t *req = ata_active;
+    if (!req) {
+        ata_irq_pending = 1;
+        wake_up(&ata_queue);
+        return;
+    }
+
+    // One interrupt per sector of a multi-sector read
+    if ((status & (ATA_STATUS_BSY | ATA_STATUS_ERR)) || !(status & ATA_STATUS_DRQ)) {
+        ata_complete(req, -1);
+        return;
+    }
+
+    inw_rep(ATA_DATA, req->buffer + req->sectors_done * 512, 256);
+    if (++req->sectors_done == req->count) {
+        ata_complete(req, 0);
+    }
+}
+
+// Switch disk_read from polling to sleeping until IRQ14
+static void ata_init(void) {
+    outb(ATA_DEVICE_CONTROL, 0);
+    irq_register(IRQ_ATA_PRIMARY, ata_irq);
+    ata_irq_enabled = 1;
+}
+
+// Sleep until the drive has a sector ready (DRQ) or reports an error
+static int ata_wait_data(void) {
+    if (!ata_irq_enabled) {
+        return ata_wait(ATA_STATUS_BSY | ATA_STATUS_DRQ, ATA_STATUS_DRQ);
+    }
+
+    uint32_t flags = irq_save();
+    int ret = 0;
+    while (!ata_irq_pending && ret == 0) {
+        ret = thread_sleep(&ata_queue, ATA_TIMEOUT_TICKS);
+    }
+    ata_irq_pending = 0;
+    irq_restore(flags);
+
+    if (ret != 0) {
+        return -1;
+    }
+
+    uint8_t status = inb(ATA_STATUS);
+    if ((status & (ATA_STATUS_BSY | ATA_STATUS_ERR)) || !(status & ATA_STATUS_DRQ)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int ata_read_sectors(uint32_t sector, uint32_t count, uint8_t* buf) {
     for (uint32_t i = 0; i < count; i++) {
         uint32_t lba = sector + i;
 
         // Wait for disk to be ready
-        for (int j = 0; j < 1000; j++) {
-            if (!(inb(ATA_STATUS) & ATA_STATUS_BSY)) break;
-        }
+        if (ata_wait(ATA_STATUS_BSY, 0) != 0) return -1;
 
         // Send read command
+        ata_irq_pending = 0;
         outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
         outb(ATA_SECTOR_COUNT, 1);
         outb(ATA_LBA_LOW, lba & 0xFF);
@@ -554,10 +578,7 @@ int disk_read(uint32_t sector, uint32_t count, void* buffer) {
         outb(ATA_COMMAND, ATA_CMD_READ_PIO);
 
         // Wait for data ready
-        for (int j = 0; j < 1000000; j++) {
-            uint8_t status = inb(ATA_STATUS);
-            if (!(status & ATA_STATUS_BSY) && (status & ATA_STATUS_DRQ)) break;
-        }
+        if (ata_wait_data() != 0) return -1;
 
         // Read 512 bytes
         inw_rep(ATA_DATA, buf + (i * 512), 256);
@@ -569,39 +590,494 @@ int disk_read(uint32_t sector, uint32_t count, void* buffer) {
     return 0;
 }
 
-void main() {
+int disk_read(uint32_t sector, uint32_t count, void* buffer) {
+    PROF_SCOPE(disk_read);
+
+    if (count == 0 || count > 256) return -1;
+
+    TRACE_ASYNC_BEGIN(DISK_READ, buffer, sector, count);
+    int ret;
+    if (ramdisk_attached()) {
+        ret = ramdisk_read(sector, count, buffer);
+    } else {
+        mutex_lock(&ata_mutex);
+        ret = ata_read_sectors(sector, count, (uint8_t*)buffer);
+        mutex_unlock(&ata_mutex);
+    }
+    TRACE_ASYNC_END(DISK_READ, buffer, ret == 0 ? count : 0, ret);
+
+    return ret;
+}
+
+const void* disk_map(uint32_t sector, uint32_t count) {
+    return ramdisk_map(sector, count);
+}
+
+int disk_read_async(uint32_t sector, uint32_t count, void* buffer, disk_request_t* req) {
+    if (count == 0 || count > 256) return -1;
+
+    // A RAM disk read is over before it could be waited for
+    if (ramdisk_attached()) {
+        req->buffer = (uint8_t*)buffer;
+        req->count = count;
+        req->submit_cycles = cycles();
+        TRACE_ASYNC_BEGIN(DISK_READ, req, sector, count);
+        req->result = ramdisk_read(sector, count, buffer);
+        req->sectors_done = req->result == 0 ? count : 0;
+        req->in_flight = 0;
+        req->complete_cycles = cycles();
+        TRACE_ASYNC_END(DISK_READ, req, req->sectors_done, req->result);
+        event_init(&req->done);
+        event_signal(&req->done);
+        return 0;
+    }
+
+    if (!ata_irq_enabled) return -1;
+
+    mutex_lock(&ata_mutex);
+
+    if (ata_wait(ATA_STATUS_BSY, 0) != 0) {
+        mutex_unlock(&ata_mutex);
+        return -1;
+    }
+
+    req->buffer = (uint8_t*)buffer;
+    req->count = count;
+    req->sectors_done = 0;
+    req->result = 0;
+    req->in_flight = 1;
+    req->submit_cycles = cycles();
+    event_init(&req->done);
+    TRACE_ASYNC_BEGIN(DISK_READ, req, sector, count);
+
+    // The IRQ must not see the command before ata_active is set
+    uint32_t flags = irq_save();
+    ata_active = req;
+    outb(ATA_DRIVE, 0xE0 | ((sector >> 24) & 0x0F));
+    outb(ATA_SECTOR_COUNT, count & 0xFF);   // 0 means 256
+    outb(ATA_LBA_LOW, sector & 0xFF);
+    outb(ATA_LBA_MID, (sector >> 8) & 0xFF);
+    outb(ATA_LBA_HIGH, (sector >> 16) & 0xFF);
+    outb(ATA_COMMAND, ATA_CMD_READ_PIO);
+    irq_restore(flags);
+
+    return 0;
+}
+
+// The FAT driver keeps one shared state and cluster cache. This is a
+// sleeping lock because disk_read sleeps, so only threads on the boot CPU
+// may call into the driver; smp_call() work must not.
+static kmutex_t fat_mutex;
+
+void fat_lock(void) {
+    mutex_lock(&fat_mutex);
+}
+
+void fat_unlock(void) {
+    mutex_unlock(&fat_mutex);
+}
+
+// The VFS lock is held while a page is filled, which takes the FAT lock
+static kmutex_t vfs_mutex;
+
+void vfs_lock(void) {
+    mutex_lock(&vfs_mutex);
+}
+
+void vfs_unlock(void) {
+    mutex_unlock(&vfs_mutex);
+}
+
+// ============================================================================
+// THREAD DEMO: a reader streams a file while a printer reports on it
+// ============================================================================
+
+#define CHUNK_RING_SIZE 8   // Power of two
+
+typedef struct {
+    uint32_t index;
+    uint32_t bytes;
+    uint32_t checksum;
+} chunk_result_t;
+
+// Single-producer/single-consumer ring: only the reader writes head and
+// only the printer writes tail, so neither side needs a lock
+static struct {
+    chunk_result_t slots[CHUNK_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile int done;
+} chunk_ring;
+
+static void reader_thread(void *arg) {
+    const char *filename = (const char*)arg;
+    FAT_FileHandle file;
+    static uint8_t chunk[1024];
+    uint32_t index = 0;
+
+    if (fatOpen(filename, &file) == 0) {
+        int bytes_read;
+        while ((bytes_read = fatRead(&file, chunk, sizeof(chunk))) > 0) {
+            while (chunk_ring.head - chunk_ring.tail == CHUNK_RING_SIZE) {
+                thread_yield();
+            }
+
+            chunk_result_t *slot = &chunk_ring.slots[chunk_ring.head % CHUNK_RING_SIZE];
+            slot->index = index++;
+            slot->bytes = bytes_read;
+            slot->checksum = checksum32(chunk, bytes_read);
+            chunk_ring.head++;
+        }
+    }
+
+    chunk_ring.done = 1;
+}
+
+static void printer_thread(void *arg) {
+    (void)arg;
+    uint32_t total = 0;
+
+    for (;;) {
+        if (chunk_ring.tail == chunk_ring.head) {
+            if (chunk_ring.done && chunk_ring.tail == chunk_ring.head) {
+                break;
+            }
+            thread_yield();
+            continue;
+        }
+
+        chunk_result_t *slot = &chunk_ring.slots[chunk_ring.tail % CHUNK_RING_SIZE];
+        kprintf("  chunk %u: %u bytes, checksum %x\n", slot->index, slot->bytes, slot->checksum);
+        total += slot->bytes;
+        chunk_ring.tail++;
+    }
+
+    kprintf("  printer saw %u bytes\n", total);
+}
+
+// ============================================================================
+// PIPELINE DEMO: read the next cluster while checksumming the previous one
+// ============================================================================
+
+#define PIPE_SLOTS 2
+
+// Shared by the reader and checksum tasks of the pipelined Example 3
+typedef struct {
+    FAT_FileHandle file;
+    uint8_t* buffers[PIPE_SLOTS];
+    uint32_t lengths[PIPE_SLOTS];
+    int full[PIPE_SLOTS];
+    disk_request_t requests[PIPE_SLOTS];
+    async_event_t filled;           // Reader -> checksum task
+    async_event_t freed;            // Checksum task -> reader
+    uint32_t next_read;
+    uint32_t next_sum;
+    int eof;
+    int error;
+
+    uint32_t chunks;
+    uint32_t bytes;
+    uint32_t checksum;              // XOR of the per-chunk checksums
+    uint64_t cpu_cycles;            // Spent checksumming
+    uint64_t overlap_cycles;        // ... while a disk read was in flight
+} pipeline_t;
+
+enum { READER_NEXT, READER_WAIT_IO };
+
+static task_status_t pipeline_reader(task_t* task) {
+    pipeline_t* p = (pipeline_t*)task->ctx;
+
+    for (;;) {
+        uint32_t slot = p->next_read % PIPE_SLOTS;
+
+        switch (task->state) {
+        case READER_NEXT: {
+            if (p->full[slot]) {
+                if (!task_await(task, &p->freed)) {
+                    return TASK_PENDING;
+                }
+                continue;
+            }
+
+            uint32_t sector, count, bytes;
+            int mapped = fatMap(&p->file, &sector, &count, &bytes);
+            if (mapped <= 0 || disk_read_async(sector, count, p->buffers[slot], &p->requests[slot]) != 0) {
+                // End of file, or a mapping or submission failure
+                p->error = mapped != 0;
+                p->eof = 1;
+                event_signal(&p->filled);
+                return TASK_DONE;
+            }
+
+            p->lengths[slot] = bytes;
+            task->state = READER_WAIT_IO;
+        }
+        // fall through
+        case READER_WAIT_IO:
+            if (!task_await(task, &p->requests[slot].done)) {
+                return TASK_PENDING;
+            }
+            if (p->requests[slot].result != 0) {
+                p->error = 1;
+                p->eof = 1;
+                event_signal(&p->filled);
+                return TASK_DONE;
+            }
+
+            p->full[slot] = 1;
+            p->next_read++;
+            event_signal(&p->filled);
+            task->state = READER_NEXT;
+            break;
+        }
+    }
+}
+
+static task_status_t pipeline_checksum(task_t* task) {
+    pipeline_t* p = (pipeline_t*)task->ctx;
+
+    for (;;) {
+        uint32_t slot = p->next_sum % PIPE_SLOTS;
+
+        if (!p->full[slot]) {
+            if (p->eof) {
+                return TASK_DONE;
+            }
+            if (!task_await(task, &p->filled)) {
+                return TASK_PENDING;
+            }
+            continue;
+        }
+
+        // The reader has the other slot on the drive now, if anything
+        disk_request_t* other = &p->requests[(slot + 1) % PIPE_SLOTS];
+        uint64_t start = cycles();
+        p->checksum ^= checksum32(p->buffers[slot], p->lengths[slot]);
+        uint64_t end = cycles();
+
+        p->cpu_cycles += end - start;
+        if (other->in_flight) {
+            p->overlap_cycles += end - start;
+        } else if (other->complete_cycles > start && other->submit_cycles < end) {
+            p->overlap_cycles += other->complete_cycles - start;
+        }
+
+        p->chunks++;
+        p->bytes += p->lengths[slot];
+        p->full[slot] = 0;
+        p->next_sum++;
+        event_signal(&p->freed);
+    }
+}
+
+// ============================================================================
+// SMP DEMO: checksum slices of a buffer on every CPU
+// ============================================================================
+
+#define SMP_DEMO_BYTES (64 * 1024)
+
+typedef struct {
+    smp_work_t work;
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t checksum;
+    uint32_t cpu;
+} hash_job_t;
+
+static void hash_job(void *arg) {
+    hash_job_t *job = (hash_job_t*)arg;
+    job->checksum = checksum32(job->data, job->size);
+    job->cpu = this_cpu()->id;
+}
+
+// Example 11: counts int3 traps
+static volatile uint32_t breakpoint_hits = 0;
+static volatile uint32_t breakpoint_eip = 0;
+
+static void breakpoint_handler(exception_frame_t* frame) {
+    breakpoint_hits++;
+    breakpoint_eip = frame->eip;
+}
+
+// An exFAT disk (the "exFAT RAM disk" entry in grub.cfg) only gets this
+// example: DATA.DAT is one NoFatChain extent, read without FAT lookups
+static void exfat_example(void) {
+    print_string("exFAT filesystem initialized successfully!\n");
+    EXFAT_VolumeInfo volume;
+    if (exfatVolumeInfo(&volume) == 0) {
+        kprintf("exFAT, %u clusters of %u bytes, %u free\n",
+                volume.total_clusters, volume.cluster_size, volume.free_clusters);
+    }
+    print_string("\n=== exFAT: Reading DATA.DAT ===\n");
+
+    EXFAT_FileHandle file;
+    if (exfatOpen("DATA.DAT", &file) != 0) {
+        print_string("Could not open DATA.DAT\n");
+        return;
+    }
+    kprintf("%u bytes, %s\n", file.file_size,
+            file.contiguous ? "one extent (NoFatChain)" : "FAT chain");
+
+    uint32_t chunk = 65536;
+    uint8_t *buffer = (uint8_t*)kmalloc(chunk);
+    if (!buffer) {
+        print_string("Out of memory\n");
+        return;
+    }
+
+    crc32c_init((cpuid_features_ecx() & CPUID_ECX_SSE42) != 0);
+    uint32_t crc = 0;
+    uint32_t total = 0;
+    uint64_t start_ns = ktime_ns();
+    int n;
+    while ((n = exfatRead(&file, buffer, chunk)) > 0) {
+        crc = crc32c(crc, buffer, n);
+        total += n;
+    }
+    kprintf("Read %u bytes in %u us, CRC-32C %x%s\n", total,
+            (uint32_t)udiv64(ktime_ns() - start_ns, 1000, 0), crc, n < 0 ? " (read error)" : "");
+    kfree(buffer);
+}
+
+void main(uint32_t magic, struct multiboot_info *mbi) {
     char *vram = (char*)0xb8000; // Base address of video mem
     const char color = 7; // gray text on black background
     int current_offset = 0;
 
 
+    multiboot_init(magic, mbi);
+    serial_init();
+    smp_early_init();
+
     print_string("Kernel starting...\n");
+
+    timer_init();
+    kprintf("TSC calibrated at %u kHz\n", tsc_khz);
+#ifdef CONFIG_TRACE
+    trace_init();
+#endif
+
+    // Threads need stack pages and the timer interrupt
+    init_pfa_list();
+    kmalloc_init();
+    kprintf("%u MiB usable in %u page frames, %u KiB heap\n",
+            physical_page_count / 256, physical_page_count, (uint32_t)(heap_size / 1024));
+    for (uint32_t i = 0; i < multiboot_module_count(); i++) {
+        const struct multiboot_module* mod = multiboot_module(i);
+        kprintf("Module %u: %s at %x, %u bytes\n", i,
+                mod->string ? (const char*)mod->string : "",
+                mod->mod_start, mod->mod_end - mod->mod_start);
+    }
+    int nsyms = ksym_init();
+    if (nsyms >= 0) {
+        kprintf("%d kernel functions in the symbol table\n", nsyms);
+    }
+    idt_init();
+    sched_init();
+    ata_init();
+    smp_init();
+    kprintf("%u CPU(s) online\n", smp_num_cpus);
+
+#ifdef CONFIG_SSE2
+    if (simd_init() == 0) {
+        print_string("SSE2 enabled for kernel string routines\n");
+    } else {
+        print_string("SSE2 not available, using i386 routines\n");
+    }
+#endif
+    if (checksum_selftest() != 0) {
+        print_string("ERROR: checksum32 self-test failed\n");
+    }
+
+    // A RAM disk module replaces the hard disk for everything below
+    MOD_FileHandle ramdisk_file;
+    const char *ramdisk_name = "RAMDISK.IMG";
+    if (modOpen(ramdisk_name, &ramdisk_file) != 0) {
+        ramdisk_name = "EXFAT.IMG";
+    }
+    if (modOpen(ramdisk_name, &ramdisk_file) == 0 &&
+        ramdisk_attach(ramdisk_file.data, ramdisk_file.size) == 0) {
+        kprintf("Using %s as the disk, %u sectors\n", ramdisk_name, ramdisk_sectors());
+    }
+
     print_string("Initializing FAT filesystem...\n");
 
     // Initialize the FAT filesystem
     if (fatInit() != 0) {
+        if (exfatInit() == 0) {
+            vfs_mount(&exfat_vfs_ops);
+            exfat_example();
+            goto halt;
+        }
         print_string("ERROR: Failed to initialize FAT filesystem!\n");
-        print_string("Make sure there's a FAT-formatted disk attached.\n");
+        print_string("Make sure there's a FAT or exFAT disk attached.\n");
         goto halt;
     }
 
-    print_string("FAT filesystem initialized successfully!\n\n");
+    print_string("FAT filesystem initialized successfully!\n");
+    if (vfs_mount(&fat_vfs_ops) != 0) {
+        print_string("No memory for the VFS page cache\n");
+    }
+    FAT_VolumeInfo volume;
+    if (fatVolumeInfo(&volume) == 0) {
+        static const char *const fat_names[] = { "FAT12", "FAT16", "FAT32" };
+        kprintf("%s, %u clusters of %u bytes, ", fat_names[volume.type],
+                volume.total_clusters, volume.cluster_size);
+        if (volume.free_clusters == FAT_UNKNOWN) {
+            print_string("free space unknown\n");
+        } else {
+            kprintf("%u free\n", volume.free_clusters);
+        }
+    }
+
+    // Files listed in MANIFEST.CRC are checked as fatRead returns them
+    crc32c_init((cpuid_features_ecx() & CPUID_ECX_SSE42) != 0);
+
+    // With a current BOOT.SNP, opens skip the directory and the hot files
+    // skip the FAT; a stale one is ignored
+    int snapshot_files = fatLoadSnapshot("BOOT.SNP");
+    if (snapshot_files >= 0) {
+        kprintf("Boot snapshot: %d files indexed\n", snapshot_files);
+    } else {
+        print_string("No usable BOOT.SNP, searching the directory\n");
+    }
+    int manifest_entries = fatLoadManifest("MANIFEST.CRC");
+    if (manifest_entries >= 0) {
+        kprintf("Verifying %d files from MANIFEST.CRC with %s CRC-32C\n",
+                manifest_entries, crc32c_sse42 ? "SSE4.2" : "slicing-by-8");
+    }
+    print_string("\n");
+
+    // "bench" on the GRUB command line replaces the demos with benchmarks
+    if (multiboot_cmdline_has("bench")) {
+        bench_run();
+        kmalloc_report();
+        page_cache_dump();
+        goto halt;
+    }
+
+#ifdef CONFIG_PROFILE
+    sampler_start();
+#endif
 
     // ========================================================================
     // Example 1: Read a simple text file
     // ========================================================================
     print_string("=== Example 1: Reading README.TXT ===\n");
 
-    FAT_FileHandle readme_file;
-    if (fatOpen("README.TXT", &readme_file) == 0) {
+    // Through the VFS, so Example 12 finds README.TXT in the page cache
+    int readme_fd = vfs_open("README.TXT");
+    vfs_stat_t readme_stat;
+    if (readme_fd >= 0 && vfs_fstat(readme_fd, &readme_stat) == 0) {
         print_string("Successfully opened README.TXT\n");
         print_string("File size: ");
-        print_dec(readme_file.file_size);
+        print_dec(readme_stat.size);
         print_string(" bytes\n\n");
 
         // Read and display the first 512 bytes
         char buffer[512];
-        int bytes_read = fatRead(&readme_file, buffer, sizeof(buffer));
+        int bytes_read = vfs_read(readme_fd, buffer, sizeof(buffer));
+        vfs_close(readme_fd);
 
         if (bytes_read > 0) {
             print_string("Content:\n");
@@ -667,6 +1143,7 @@ void main() {
         uint8_t chunk[256];
         uint32_t total_read = 0;
         int chunk_num = 0;
+        uint64_t start_ns = ktime_ns();
 
         while (data_file.position < data_file.file_size) {
             int bytes_read = fatRead(&data_file, chunk, sizeof(chunk));
@@ -686,7 +1163,9 @@ void main() {
         print_dec(chunk_num);
         print_string(" chunks (");
         print_dec(total_read);
-        print_string(" bytes total)\n");
+        print_string(" bytes total) in ");
+        print_dec((uint32_t)udiv64(ktime_ns() - start_ns, 1000, 0));
+        print_string(" us\n");
     } else {
         print_string("Could not open DATA.DAT\n");
     }
@@ -694,44 +1173,96 @@ void main() {
     print_string("\n");
 
     // ========================================================================
-    // Example 4: Load a file into memory at a specific address
+    // Example 3b: The same read, pipelined with the async executor
     // ========================================================================
-    print_string("=== Example 4: Loading PROGRAM.BIN into memory ===\n");
-
-    FAT_FileHandle program_file;
-    if (fatOpen("PROGRAM.BIN", &program_file) == 0) {
-        print_string("Successfully opened PROGRAM.BIN\n");
-
-        // Allocate memory for the entire file
-        void* program_memory = kmalloc(program_file.file_size);
+    print_string("=== Example 3b: Pipelined read of DATA.DAT ===\n");
+
+    static pipeline_t pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    event_init(&pipe.filled);
+    event_init(&pipe.freed);
+
+    if (fatOpen("DATA.DAT", &pipe.file) == 0) {
+        uint32_t cluster_size = 0;
+        uint32_t sector, count, bytes;
+        // Size the buffers from the first run, then start over
+        if (fatMap(&pipe.file, &sector, &count, &bytes) > 0) {
+            cluster_size = count * 512;
+        }
+        fatSeek(&pipe.file, 0);
 
-        if (program_memory) {
-            // Read entire file into memory
-            int bytes_read = fatRead(&program_file, program_memory, program_file.file_size);
+        for (int i = 0; i < PIPE_SLOTS; i++) {
+            pipe.buffers[i] = cluster_size ? (uint8_t*)kmalloc(cluster_size) : 0;
+        }
 
-            if (bytes_read == (int)program_file.file_size) {
-                print_string("Successfully loaded ");
-                print_dec(bytes_read);
-                print_string(" bytes at address ");
-                print_hex((uint32_t)program_memory);
-                print_string("\n");
+        if (pipe.buffers[PIPE_SLOTS - 1]) {
+            executor_t executor;
+            task_t reader_task, checksum_task;
+
+            executor_init(&executor);
+            task_init(&reader_task, "reader", pipeline_reader, &pipe);
+            task_init(&checksum_task, "checksum", pipeline_checksum, &pipe);
+            executor_spawn(&executor, &reader_task);
+            executor_spawn(&executor, &checksum_task);
+
+            uint64_t start_ns = ktime_ns();
+            executor_run(&executor);
+            uint64_t elapsed_ns = ktime_ns() - start_ns;
+
+            kprintf("Read %u chunks (%u bytes total) in %u us%s\n", pipe.chunks, pipe.bytes,
+                    (uint32_t)udiv64(elapsed_ns, 1000, 0), pipe.error ? ", with errors" : "");
+            kprintf("Checksum %x, %u us of CPU work, %u us of it during disk reads\n", pipe.checksum,
+                    (uint32_t)udiv64(cycles_to_ns(pipe.cpu_cycles), 1000, 0),
+                    (uint32_t)udiv64(cycles_to_ns(pipe.overlap_cycles), 1000, 0));
+        } else {
+            print_string("Could not allocate pipeline buffers\n");
+        }
 
-                // Now you could execute it or process it
-                // For example, if it's a function:
-                // void (*program_func)() = (void(*)())program_memory;
-                // program_func();
+        // Allocated last, freed first
+        for (int i = PIPE_SLOTS - 1; i >= 0; i--) {
+            kfree(pipe.buffers[i]);
+        }
+    } else {
+        print_string("Could not open DATA.DAT\n");
+    }
 
-            } else {
-                print_string("ERROR: Failed to read complete file!\n");
-            }
+    print_string("\n");
 
-            // Don't forget to free when done (if your kfree works)
-            // kfree(program_memory);
-        } else {
-            print_string("ERROR: Failed to allocate memory!\n");
+    // ========================================================================
+    // Example 4: Load an ELF program and run it
+    // ========================================================================
+    print_string("=== Example 4: Loading PROGRAM.ELF into memory ===\n");
+
+    // Segments are streamed from the file straight to their load address
+    ELF_Image program;
+    if (elf_load("PROGRAM.ELF", &program) == 0) {
+        print_string("Successfully loaded PROGRAM.ELF, entry ");
+        print_hex(program.entry);
+        print_string("\n");
+
+        for (uint32_t i = 0; i < program.num_segments; i++) {
+            void* seg = (void*)program.segments[i].vaddr;
+            uint32_t seg_size = program.segments[i].filesz;
+            uint32_t sum = checksum32(seg, seg_size);
+
+            kprintf("  segment %x: %u bytes from file, %u in memory, checksum %x\n",
+                    program.segments[i].vaddr, seg_size, program.segments[i].memsz, sum);
+#ifdef CONFIG_SSE2
+            // Cross-check the vector kernel against the scalar one
+            int saved_simd = simd_enabled;
+            simd_enabled = 0;
+            uint32_t ref = checksum32(seg, seg_size);
+            simd_enabled = saved_simd;
+            print_string(sum == ref ? "  checksum verified\n" : "  ERROR: Checksum mismatch!\n");
+#endif
         }
+
+        int ret = elf_exec(&program);
+        print_string("Program returned ");
+        print_int(ret);
+        print_string("\n");
     } else {
-        print_string("Could not open PROGRAM.BIN\n");
+        print_string("Could not load PROGRAM.ELF\n");
     }
 
     print_string("\n");
@@ -741,10 +1272,11 @@ void main() {
     // ========================================================================
     print_string("=== Example 5: Verifying CONFIG.TXT ===\n");
 
-    FAT_FileHandle config_file;
-    if (fatOpen("CONFIG.TXT", &config_file) == 0) {
+    int config_fd = vfs_open("CONFIG.TXT");
+    if (config_fd >= 0) {
         char line_buffer[128];
-        int bytes_read = fatRead(&config_file, line_buffer, sizeof(line_buffer) - 1);
+        int bytes_read = vfs_read(config_fd, line_buffer, sizeof(line_buffer) - 1);
+        vfs_close(config_fd);
 
         if (bytes_read > 0) {
             line_buffer[bytes_read] = '\0';  // Null terminate
@@ -762,13 +1294,242 @@ void main() {
 
     print_string("\n");
 
+    // ========================================================================
+    // Example 6: Stream a file on one thread and report on another
+    // ========================================================================
+    print_string("=== Example 6: Reader and printer threads on DATA.DAT ===\n");
+
+    thread_t *printer = thread_create("printer", printer_thread, 0);
+    thread_t *reader = printer ? thread_create("reader", reader_thread, "DATA.DAT") : 0;
+    if (reader) {
+        thread_join(reader);
+    } else {
+        print_string("Could not create threads\n");
+        chunk_ring.done = 1;    // Let the printer finish on its own
+    }
+    if (printer) {
+        thread_join(printer);
+    }
+
+    print_string("\n");
+
+    // ========================================================================
+    // Example 7: Checksum DATA.DAT in slices on every CPU
+    // ========================================================================
+    print_string("=== Example 7: Hashing DATA.DAT on all CPUs ===\n");
+
+    uint8_t* smp_buffer = (uint8_t*)kmalloc(SMP_DEMO_BYTES);
+    FAT_FileHandle smp_file;
+    if (smp_buffer && fatOpen("DATA.DAT", &smp_file) == 0) {
+        int bytes_read = fatRead(&smp_file, smp_buffer, SMP_DEMO_BYTES);
+        uint32_t size = bytes_read > 0 ? bytes_read : 0;
+        uint32_t slice = (size / smp_num_cpus + 15) & ~15;
+        hash_job_t jobs[MAX_CPUS];
+
+        // The boot CPU takes slice 0 inline, after the others are queued
+        for (int i = smp_num_cpus - 1; i >= 0; i--) {
+            uint32_t start = i * slice < size ? i * slice : size;
+            uint32_t end = start + slice < size ? start + slice : size;
+
+            jobs[i].data = smp_buffer + start;
+            jobs[i].size = end - start;
+            jobs[i].work.fn = hash_job;
+            jobs[i].work.arg = &jobs[i];
+            smp_call(i, &jobs[i].work);
+        }
+
+        int mismatches = 0;
+        for (uint32_t i = 0; i < smp_num_cpus; i++) {
+            smp_wait(&jobs[i].work);
+            uint32_t ref = checksum32(jobs[i].data, jobs[i].size);
+            kprintf("  slice %u: %u bytes on CPU %u, checksum %x\n",
+                    i, jobs[i].size, jobs[i].cpu, jobs[i].checksum);
+            mismatches += jobs[i].checksum != ref;
+        }
+        print_string(mismatches ? "  ERROR: Checksum mismatch!\n" : "  all slices verified\n");
+    } else {
+        print_string("Could not open DATA.DAT\n");
+    }
+    kfree(smp_buffer);
+
+    print_string("\n");
+
+    // ========================================================================
+    // Example 8: Read PROGRAM.ELF from a boot module instead of the disk
+    // ========================================================================
+    print_string("=== Example 8: PROGRAM.ELF as a Multiboot module ===\n");
+
+    MOD_FileHandle mod_file;
+    FAT_FileHandle disk_file;
+    if (modOpen("PROGRAM.ELF", &mod_file) == 0 && fatOpen("PROGRAM.ELF", &disk_file) == 0) {
+        kprintf("  module: %u bytes, checksum %x\n",
+                mod_file.size, checksum32(mod_file.data, mod_file.size));
+
+        // Compare in chunks against the copy on disk
+        char mod_chunk[512], disk_chunk[512];
+        int mismatches = 0;
+        uint32_t compared = 0;
+        int n;
+        while ((n = fatRead(&disk_file, disk_chunk, sizeof(disk_chunk))) > 0) {
+            if (modRead(&mod_file, mod_chunk, n) != n || memcmp(mod_chunk, disk_chunk, n) != 0) {
+                mismatches++;
+            }
+            compared += n;
+        }
+        if (compared != mod_file.size) {
+            mismatches++;
+        }
+        print_string(mismatches ? "  ERROR: Module differs from the file on disk!\n"
+                                : "  module matches the file on disk\n");
+    } else {
+        print_string("No PROGRAM.ELF module (add \"module /PROGRAM.ELF\" to grub.cfg)\n");
+    }
+
+    print_string("\n");
+
+    // ========================================================================
+    // Example 9: Read DATA.DAT from its compressed copy
+    // ========================================================================
+    print_string("=== Example 9: DATA.DAT decompressed from DATA.LZ4 ===\n");
+
+    // 64 KiB at a time, so whole blocks are decoded into the buffer
+    uint8_t* lz4_buffer = (uint8_t*)kmalloc(64 * 1024);
+    LZ4_FileHandle lz4_file;
+    // DATA.DAT is on the disk too, so name the compressed copy directly
+    if (lz4_buffer && lz4Open("DATA.LZ4", &lz4_file) == 0) {
+        uint32_t sum = 0;
+        uint64_t start_ns = ktime_ns();
+        int n;
+        while ((n = lz4Read(&lz4_file, lz4_buffer, 64 * 1024)) > 0) {
+            sum += checksum32(lz4_buffer, n);
+        }
+        uint32_t us = (uint32_t)udiv64(ktime_ns() - start_ns, 1000, 0);
+
+        kprintf("  %u bytes on disk, %u decompressed, checksum %x, %u us\n",
+                lz4_file.file.file_size, lz4_file.position, sum, us);
+        if (n < 0 || (lz4_file.size && lz4_file.position != lz4_file.size)) {
+            print_string("  ERROR: Decompression failed!\n");
+        }
+        lz4Close(&lz4_file);
+    } else {
+        print_string("Could not open DATA.LZ4\n");
+    }
+    kfree(lz4_buffer);
+
+    print_string("\n");
+
+    // ========================================================================
+    // Example 10: Read every file in the manifest and check its CRC
+    // ========================================================================
+    print_string("=== Example 10: Verifying files against MANIFEST.CRC ===\n");
+
+    int verify_failures = 0;
+    uint8_t* verify_buffer = (uint8_t*)kmalloc(64 * 1024);
+    for (uint32_t i = 0; verify_buffer && i < fatManifestCount(); i++) {
+        const FAT_ManifestEntry* me = fatManifestEntry(i);
+
+        // Back from the padded directory form to "NAME.EXT"
+        char name[13];
+        int len = 0;
+        for (int j = 0; j < 8 && me->name[j] != ' '; j++) name[len++] = me->name[j];
+        if (me->name[8] != ' ') {
+            name[len++] = '.';
+            for (int j = 8; j < 11 && me->name[j] != ' '; j++) name[len++] = me->name[j];
+        }
+        name[len] = '\0';
+
+        FAT_FileHandle verify_file;
+        int n = -1;
+        uint64_t start = cycles();
+        if (fatOpen(name, &verify_file) == 0) {
+            while ((n = fatRead(&verify_file, verify_buffer, 64 * 1024)) > 0) {
+            }
+        }
+        uint32_t us = (uint32_t)udiv64(cycles_to_ns(cycles() - start), 1000, 0);
+
+        if (n == 0 && verify_file.file_size == me->size) {
+            kprintf("  %s: %u bytes, crc32c %x, %u us\n", name, me->size, me->crc, us);
+        } else {
+            kprintf("  ERROR: %s is missing or corrupt!\n", name);
+            verify_failures++;
+        }
+    }
+    kfree(verify_buffer);
+    if (manifest_entries < 0) {
+        print_string("No MANIFEST.CRC on this disk\n");
+    }
+
+    print_string("\n");
+
+    // ========================================================================
+    // Example 11: Recover from a breakpoint exception
+    // ========================================================================
+    print_string("=== Example 11: Breakpoint exception ===\n");
+
+    // int3 is a trap, so the handler returns to the next instruction
+    exception_register(EXC_BREAKPOINT, breakpoint_handler);
+    for (int i = 0; i < 3; i++) {
+        __asm__ volatile ("int3");
+    }
+    exception_register(EXC_BREAKPOINT, 0);
+    kprintf("  %u breakpoints handled, last at eip %x\n", breakpoint_hits, breakpoint_eip);
+
+    print_string("\n");
+
+    // ========================================================================
+    // Example 12: Open README.TXT again, served by the VFS page cache
+    // ========================================================================
+    print_string("=== Example 12: README.TXT from the page cache ===\n");
+
+    vfs_stats_t before, after;
+    vfs_stats(&before);
+    int again_fd = vfs_open("readme.txt");
+    if (again_fd >= 0) {
+        char buffer[512];
+        int bytes_read = vfs_read(again_fd, buffer, sizeof(buffer));
+        vfs_close(again_fd);
+        vfs_stats(&after);
+        kprintf("  %d bytes: %u page hits, %u misses, directory lookup %s\n", bytes_read,
+                after.page_hits - before.page_hits, after.page_misses - before.page_misses,
+                after.inode_hits > before.inode_hits ? "skipped" : "done");
+        kprintf("  Page cache: %u of %u pages, %u hits, %u misses, %u evictions\n",
+                after.pages_cached, VFS_CACHE_PAGES, after.page_hits, after.page_misses,
+                after.page_evictions);
+    } else {
+        print_string("Could not open README.TXT\n");
+    }
+
+    print_string("\n");
+
     // ========================================================================
     // Done!
     // ========================================================================
     print_string("=== FAT filesystem demo complete! ===\n");
-    print_string("All file operations successful.\n\n");
+    if (verify_failures) {
+        kprintf("ERROR: %d files failed verification.\n\n", verify_failures);
+    } else {
+        print_string("All file operations successful.\n\n");
+    }
+
+    uint64_t uptime_ns = ktime_ns();
+    kprintf("CPU idle %u ms of %u ms since boot\n",
+            (uint32_t)udiv64(cycles_to_ns(sched_idle_cycles()), 1000000, 0),
+            (uint32_t)udiv64(uptime_ns, 1000000, 0));
+
+    kmalloc_report();
+    page_cache_dump();
+    idt_stats_dump();
+
+#ifdef CONFIG_PROFILE
+    sampler_stop();
+    prof_dump();
+    sampler_dump();
+#endif
 
 halt:
+#ifdef CONFIG_TRACE
+    trace_dump();
+#endif
     print_string("Kernel halting.\n");
 
     // Halt the CPU
@@ -0,0 +1,115 @@
+// ksym.c - Kernel symbol lookup from the ELF symbol table
+//
+// GRUB copies the kernel's .symtab and .strtab into memory and passes the
+// section headers in the Multiboot info, so the kernel can name its own
+// functions without anything extra on the disk.
+#include <stddef.h>
+#include "ksym.h"
+#include "multiboot.h"
+
+extern void* kmalloc(size_t size);
+
+typedef struct {
+    uint32_t addr;
+    uint32_t size;
+    const char *name;
+} ksym_t;
+
+// Function symbols sorted by address
+static ksym_t *ksyms = 0;
+static uint32_t num_ksyms = 0;
+
+int ksym_init(void) {
+    uint32_t num_sections;
+    const Elf32_Shdr *sections = multiboot_elf_sections(&num_sections);
+    if (!sections) {
+        return -1;
+    }
+
+    const Elf32_Shdr *symtab = 0;
+    for (uint32_t i = 0; i < num_sections; i++) {
+        if (sections[i].type == ELF_SHT_SYMTAB && sections[i].addr) {
+            symtab = &sections[i];
+            break;
+        }
+    }
+    if (!symtab || symtab->link >= num_sections || !sections[symtab->link].addr) {
+        return -1;
+    }
+
+    const Elf32_Sym *syms = (const Elf32_Sym *)symtab->addr;
+    uint32_t total = symtab->size / sizeof(Elf32_Sym);
+    const char *strtab = (const char *)sections[symtab->link].addr;
+
+    uint32_t funcs = 0;
+    for (uint32_t i = 0; i < total; i++) {
+        if (ELF_ST_TYPE(syms[i].info) == ELF_STT_FUNC && syms[i].value) {
+            funcs++;
+        }
+    }
+
+    ksyms = (ksym_t *)kmalloc(funcs * sizeof(ksym_t));
+    if (!ksyms) {
+        return -1;
+    }
+
+    // Insertion sort; a kernel has a few hundred functions
+    num_ksyms = 0;
+    for (uint32_t i = 0; i < total; i++) {
+        if (ELF_ST_TYPE(syms[i].info) != ELF_STT_FUNC || !syms[i].value) {
+            continue;
+        }
+        uint32_t j = num_ksyms++;
+        while (j > 0 && ksyms[j - 1].addr > syms[i].value) {
+            ksyms[j] = ksyms[j - 1];
+            j--;
+        }
+        ksyms[j].addr = syms[i].value;
+        ksyms[j].size = syms[i].size;
+        ksyms[j].name = strtab + syms[i].name;
+    }
+
+    return num_ksyms;
+}
+
+int ksym_index(uint32_t addr) {
+    // Last symbol starting at or below @addr
+    uint32_t lo = 0, hi = num_ksyms;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (ksyms[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return -1;
+    }
+
+    // A size of 0 means unknown; such a symbol runs up to the next one
+    const ksym_t *sym = &ksyms[lo - 1];
+    if (sym->size && addr - sym->addr >= sym->size) {
+        return -1;
+    }
+    return lo - 1;
+}
+
+const char *ksym_lookup(uint32_t addr, uint32_t *offset) {
+    int i = ksym_index(addr);
+    if (i < 0) {
+        return 0;
+    }
+    if (offset) {
+        *offset = addr - ksyms[i].addr;
+    }
+    return ksyms[i].name;
+}
+
+uint32_t ksym_count(void) {
+    return num_ksyms;
+}
+
+const char *ksym_name(uint32_t index) {
+    return index < num_ksyms ? ksyms[index].name : 0;
+}
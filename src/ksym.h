@@ -0,0 +1,20 @@
+// ksym.h - Kernel symbol lookup from the ELF symbol table
+#include <stdint.h>
+#ifndef KSYM_H
+#define KSYM_H
+
+// Collect the function symbols from the section headers GRUB passed in.
+// Needs kmalloc.
+// Returns: Number of functions found, or -1 without a symbol table
+int ksym_init(void);
+
+// Name of the function containing @addr, and @addr's offset into it
+// Returns: The name, or 0 if @addr is in no known function
+const char *ksym_lookup(uint32_t addr, uint32_t *offset);
+
+// Index of that function in 0..ksym_count()-1, or -1
+int ksym_index(uint32_t addr);
+uint32_t ksym_count(void);
+const char *ksym_name(uint32_t index);
+
+#endif // KSYM_H
@@ -0,0 +1,304 @@
+// lz4.c - Transparent LZ4 decompression on top of fatRead
+//
+// lz4Open looks at the first bytes of a file: an LZ4 frame is decoded on
+// the fly by lz4Read, anything else is read as is. Only one compressed
+// block is held in memory at a time; it is read through fatRead, so whole
+// clusters still go straight from the disk into the block buffer.
+#include <string.h>
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH 4
+
+// Frame descriptor flags (FLG byte)
+#define LZ4_FLG_VERSION_MASK    0xC0
+#define LZ4_FLG_VERSION         0x40
+#define LZ4_FLG_BLOCK_INDEP     0x20
+#define LZ4_FLG_BLOCK_CHECKSUM  0x10
+#define LZ4_FLG_CONTENT_SIZE    0x08
+#define LZ4_FLG_DICT_ID         0x01
+
+#define LZ4_BLOCK_UNCOMPRESSED  0x80000000
+
+// Length extension: bytes of 255 add up until one is smaller
+static int read_length(const uint8_t **ip, const uint8_t *iend, uint32_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress_block(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        uint32_t literals = token >> 4;
+        if (literals == 15 && read_length(&ip, iend, &literals) != 0) {
+            return -1;
+        }
+        if (literals > (uint32_t)(iend - ip) || literals > (uint32_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        // The last sequence is literals only
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) {
+            return -1;
+        }
+
+        uint32_t len = token & 15;
+        if (len == 15 && read_length(&ip, iend, &len) != 0) {
+            return -1;
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > (uint32_t)(oend - op)) {
+            return -1;
+        }
+
+        // A match closer than its length repeats bytes it is still writing
+        const uint8_t *match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        } else {
+            while (len--) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op - dst;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Reads and checks the frame header; leaves the file at the first block
+static int parse_frame_header(LZ4_FileHandle *handle) {
+    // Magic, FLG, BD, then optional content size and dictionary ID, and HC
+    uint8_t header[4 + 2 + 8 + 4 + 1];
+    if (fatRead(&handle->file, header, 6) != 6) {
+        return -1;
+    }
+
+    uint8_t flg = header[4];
+    uint8_t bd = header[5];
+    if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION) {
+        return -1;
+    }
+    // Dependent blocks would need the previous 64 KiB kept around
+    if (!(flg & LZ4_FLG_BLOCK_INDEP) || (flg & LZ4_FLG_DICT_ID)) {
+        return -1;
+    }
+
+    uint32_t rest = 1 + ((flg & LZ4_FLG_CONTENT_SIZE) ? 8 : 0);
+    if (fatRead(&handle->file, header + 6, rest) != (int)rest) {
+        return -1;
+    }
+
+    // BD bits 6-4: 4 = 64 KiB, 5 = 256 KiB, 6 = 1 MiB, 7 = 4 MiB
+    uint32_t block_id = (bd >> 4) & 7;
+    if (block_id < 4) {
+        return -1;
+    }
+    handle->block_max = 1u << (8 + 2 * block_id);
+    if (handle->block_max > LZ4_MAX_BLOCK) {
+        return -1;
+    }
+
+    handle->block_checksums = (flg & LZ4_FLG_BLOCK_CHECKSUM) != 0;
+    handle->size = 0;
+    if (flg & LZ4_FLG_CONTENT_SIZE) {
+        // Only the low 32 bits matter for files on FAT
+        handle->size = get_le32(header + 6);
+    }
+    return 0;
+}
+
+/**
+ * lz4Open - Open a file, decompressing it on the fly if it is LZ4
+ *
+ * If @filename does not exist, the same name with the extension LZ4 is
+ * tried, so "DATA.DAT" finds the DATA.LZ4 the Makefile made from it.
+ * Either way the file is treated as compressed if and only if it starts
+ * with an LZ4 frame header.
+ *
+ * @filename: 8.3 name of the file
+ * @handle: Filled in on success; release it with lz4Close
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int lz4Open(const char *filename, LZ4_FileHandle *handle) {
+    if (!filename || !handle) {
+        return -1;
+    }
+
+    memset(handle, 0, sizeof(*handle));
+
+    if (fatOpen(filename, &handle->file) != 0) {
+        char name[13];
+        uint32_t base = 0;
+        while (filename[base] && filename[base] != '.' && base < 8) {
+            name[base] = filename[base];
+            base++;
+        }
+        memcpy(name + base, ".LZ4", 5);
+        if (fatOpen(name, &handle->file) != 0) {
+            return -1;
+        }
+    }
+
+    uint8_t magic[4];
+    int n = fatRead(&handle->file, magic, sizeof(magic));
+    if (n == sizeof(magic) && get_le32(magic) == LZ4_FRAME_MAGIC) {
+        if (fatSeek(&handle->file, 0) != 0 || parse_frame_header(handle) != 0) {
+            return -1;
+        }
+
+        // Freed in reverse order by lz4Close
+        handle->in = (uint8_t*)kmalloc(handle->block_max);
+        handle->out = handle->in ? (uint8_t*)kmalloc(handle->block_max) : 0;
+        if (!handle->out) {
+            kfree(handle->in);
+            return -1;
+        }
+        handle->compressed = true;
+    } else {
+        if (n < 0 || fatSeek(&handle->file, 0) != 0) {
+            return -1;
+        }
+        handle->size = handle->file.file_size;
+    }
+
+    handle->is_open = true;
+    return 0;
+}
+
+// Decode the next block into @dst, which holds at least block_max bytes
+// Returns: Bytes decoded, 0 at the end mark, -1 on error
+static int next_block(LZ4_FileHandle *handle, uint8_t *dst) {
+    uint8_t word[4];
+    if (fatRead(&handle->file, word, 4) != 4) {
+        return -1;
+    }
+
+    uint32_t block_size = get_le32(word);
+    if (block_size == 0) {
+        handle->at_end = true;      // A content checksum may follow; it is not checked
+        return 0;
+    }
+
+    bool stored = (block_size & LZ4_BLOCK_UNCOMPRESSED) != 0;
+    block_size &= ~LZ4_BLOCK_UNCOMPRESSED;
+    if (block_size > handle->block_max) {
+        return -1;
+    }
+
+    int n;
+    if (stored) {
+        n = fatRead(&handle->file, dst, block_size) == (int)block_size ? (int)block_size : -1;
+    } else if (fatRead(&handle->file, handle->in, block_size) == (int)block_size) {
+        n = lz4_decompress_block(handle->in, block_size, dst, handle->block_max);
+    } else {
+        n = -1;
+    }
+
+    if (n > 0 && handle->block_checksums && fatRead(&handle->file, word, 4) != 4) {
+        return -1;
+    }
+    return n;
+}
+
+/**
+ * lz4Read - Read decompressed data from a file opened with lz4Open
+ *
+ * Blocks are decoded straight into @buffer while it has room for a whole
+ * block; the tail of a request goes through the handle's block buffer.
+ *
+ * @handle: Open handle
+ * @buffer: Buffer to read data into
+ * @size: Maximum number of bytes to read
+ *
+ * Returns: Number of bytes read, 0 at end of file, or -1 on error
+ */
+int lz4Read(LZ4_FileHandle *handle, void *buffer, uint32_t size) {
+    if (!handle || !handle->is_open || !buffer) {
+        return -1;
+    }
+
+    if (!handle->compressed) {
+        int n = fatRead(&handle->file, buffer, size);
+        if (n > 0) {
+            handle->position += n;
+        }
+        return n;
+    }
+
+    uint8_t *out = (uint8_t*)buffer;
+    uint32_t done = 0;
+
+    while (done < size) {
+        if (handle->out_pos < handle->out_len) {
+            uint32_t n = handle->out_len - handle->out_pos;
+            if (n > size - done) {
+                n = size - done;
+            }
+            memcpy(out + done, handle->out + handle->out_pos, n);
+            handle->out_pos += n;
+            done += n;
+            continue;
+        }
+
+        if (handle->at_end) {
+            break;
+        }
+
+        bool direct = size - done >= handle->block_max;
+        int n = next_block(handle, direct ? out + done : handle->out);
+        if (n < 0) {
+            return -1;
+        }
+        if (direct) {
+            done += n;
+        } else {
+            handle->out_len = n;
+            handle->out_pos = 0;
+        }
+    }
+
+    handle->position += done;
+    return done;
+}
+
+void lz4Close(LZ4_FileHandle *handle) {
+    if (!handle || !handle->is_open) {
+        return;
+    }
+
+    kfree(handle->out);
+    kfree(handle->in);
+    handle->out = 0;
+    handle->in = 0;
+    handle->is_open = false;
+}
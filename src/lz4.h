@@ -0,0 +1,37 @@
+// lz4.h - Transparent LZ4 decompression on top of fatRead
+#include <stdint.h>
+#include <stdbool.h>
+#include "fat.h"
+#ifndef LZ4_H
+#define LZ4_H
+
+// Files are LZ4 frames (what the lz4 tool writes) with independent blocks.
+// The Makefile compresses with -B4, so blocks are at most 64 KiB.
+#define LZ4_FRAME_MAGIC 0x184D2204
+#define LZ4_MAX_BLOCK   (256 * 1024)    // Largest block size accepted (-B5)
+
+// A file opened with lz4Open. Plain files pass straight through to fatRead.
+typedef struct {
+    FAT_FileHandle file;
+    bool compressed;
+    bool block_checksums;           // Each block is followed by 4 bytes
+    bool at_end;                    // End mark read
+    uint32_t block_max;             // Largest decompressed block
+    uint32_t size;                  // Decompressed size, 0 if the frame does not say
+    uint32_t position;              // Decompressed bytes returned so far
+    uint8_t *in;                    // One compressed block
+    uint8_t *out;                   // Last block decoded here, if the caller's buffer was too small
+    uint32_t out_len;
+    uint32_t out_pos;
+    bool is_open;
+} LZ4_FileHandle;
+
+int lz4Open(const char *filename, LZ4_FileHandle *handle);
+int lz4Read(LZ4_FileHandle *handle, void *buffer, uint32_t size);
+void lz4Close(LZ4_FileHandle *handle);
+
+// Decode one LZ4 block of @src_len bytes into at most @dst_cap bytes
+// Returns: Decompressed size, or -1 if the block is corrupt or too big
+int lz4_decompress_block(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap);
+
+#endif // LZ4_H
@@ -24,8 +24,13 @@ extern main
 _start:
     ; Set up stack
     mov esp, stack_top
+
+    ; The string routines in kernel_main.c expect DF clear
+    cld
     
-    ; Call kernel main
+    ; Call kernel main(magic, multiboot_info)
+    push ebx
+    push eax
     call main
     
     ; Hang if main returns
@@ -0,0 +1,150 @@
+// multiboot.c - Access to the Multiboot information structure
+#include <stddef.h>
+#include <string.h>
+#include "multiboot.h"
+
+struct multiboot_info *mb_info = 0;
+
+/**
+ * multiboot_init - Record the info structure GRUB passed to _start
+ *
+ * @magic: EAX at entry, must be MULTIBOOT_BOOTLOADER_MAGIC
+ * @info: EBX at entry, physical (= virtual) address of the info structure
+ */
+void multiboot_init(uint32_t magic, struct multiboot_info *info) {
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        mb_info = info;
+    }
+}
+
+/**
+ * multiboot_cmdline_has - Check the kernel command line for a word
+ *
+ * The command line is split on spaces; GRUB includes the kernel path as
+ * the first word (e.g. "/kernel bench").
+ *
+ * Returns: 1 if @word appears as a whole word, 0 otherwise
+ */
+int multiboot_cmdline_has(const char *word) {
+    if (!mb_info || !(mb_info->flags & MULTIBOOT_INFO_CMDLINE)) {
+        return 0;
+    }
+
+    const char *p = (const char *)mb_info->cmdline;
+    while (*p) {
+        while (*p == ' ') p++;
+
+        const char *w = word;
+        while (*w && *p == *w) {
+            p++;
+            w++;
+        }
+        if (*w == '\0' && (*p == ' ' || *p == '\0')) {
+            return 1;
+        }
+
+        while (*p && *p != ' ') p++;
+    }
+
+    return 0;
+}
+
+uint32_t multiboot_module_count(void) {
+    if (!mb_info || !(mb_info->flags & MULTIBOOT_INFO_MODS)) {
+        return 0;
+    }
+    return mb_info->mods_count;
+}
+
+const struct multiboot_module *multiboot_module(uint32_t index) {
+    if (index >= multiboot_module_count()) {
+        return 0;
+    }
+    return (const struct multiboot_module *)mb_info->mods_addr + index;
+}
+
+const Elf32_Shdr *multiboot_elf_sections(uint32_t *count) {
+    if (!mb_info || !(mb_info->flags & MULTIBOOT_INFO_ELF_SHDR) ||
+        mb_info->elf_size != sizeof(Elf32_Shdr)) {
+        *count = 0;
+        return 0;
+    }
+    *count = mb_info->elf_num;
+    return (const Elf32_Shdr *)mb_info->elf_addr;
+}
+
+// Does the first word of a module line, or its last path component, equal @name?
+static int module_name_matches(const char *line, const char *name) {
+    const char *end = line;
+    const char *base = line;
+    while (*end && *end != ' ') {
+        if (*end == '/') {
+            base = end + 1;
+        }
+        end++;
+    }
+
+    size_t len = strlen(name);
+    if ((size_t)(end - line) == len && memcmp(line, name, len) == 0) {
+        return 1;
+    }
+    return (size_t)(end - base) == len && memcmp(base, name, len) == 0;
+}
+
+/**
+ * modOpen - Open a Multiboot module as an in-memory file
+ *
+ * Modules are named by their "module" line in grub.cfg: either the whole
+ * path or its last component matches, so "module /boot/INITRD.IMG" opens
+ * as "INITRD.IMG". The data stays where GRUB loaded it; the page
+ * allocator keeps those frames reserved.
+ *
+ * @name: Module name
+ * @handle: Filled in on success
+ *
+ * Returns: 0 on success, -1 if there is no such module
+ */
+int modOpen(const char *name, MOD_FileHandle *handle) {
+    if (!name || !handle) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < multiboot_module_count(); i++) {
+        const struct multiboot_module *mod = multiboot_module(i);
+        if (mod->string && module_name_matches((const char *)mod->string, name)) {
+            handle->data = (const uint8_t *)mod->mod_start;
+            handle->size = mod->mod_end - mod->mod_start;
+            handle->position = 0;
+            handle->is_open = true;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+// Same contract as fatRead
+int modRead(MOD_FileHandle *handle, void *buffer, uint32_t size) {
+    if (!handle || !handle->is_open || !buffer) {
+        return -1;
+    }
+
+    uint32_t left = handle->size - handle->position;
+    if (size > left) {
+        size = left;
+    }
+
+    memcpy(buffer, handle->data + handle->position, size);
+    handle->position += size;
+    return size;
+}
+
+// Same contract as fatSeek: offsets past the end clamp to the size
+int modSeek(MOD_FileHandle *handle, uint32_t offset) {
+    if (!handle || !handle->is_open) {
+        return -1;
+    }
+
+    handle->position = offset < handle->size ? offset : handle->size;
+    return 0;
+}
@@ -0,0 +1,83 @@
+// multiboot.h - Multiboot (v1) information passed in by GRUB
+#include <stdint.h>
+#include <stdbool.h>
+#include "elf.h"
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+// Value of EAX at _start when loaded by a Multiboot bootloader
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// multiboot_info.flags bits
+#define MULTIBOOT_INFO_MEMORY   (1 << 0)
+#define MULTIBOOT_INFO_CMDLINE  (1 << 2)
+#define MULTIBOOT_INFO_MODS     (1 << 3)
+#define MULTIBOOT_INFO_ELF_SHDR (1 << 5)
+#define MULTIBOOT_INFO_MEM_MAP  (1 << 6)
+
+struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;             // KiB below 1 MiB
+    uint32_t mem_upper;             // KiB above 1 MiB
+    uint32_t boot_device;
+    uint32_t cmdline;               // Physical address of the command line
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t elf_num;               // ELF section headers: count,
+    uint32_t elf_size;              // size of one,
+    uint32_t elf_addr;              // address of the table,
+    uint32_t elf_shndx;             // section name string table index
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+} __attribute__((packed));
+
+// One entry of the BIOS memory map at mmap_addr. size does not count
+// itself, so the next entry is at (uint8_t*)entry + entry->size + 4.
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;                  // MULTIBOOT_MEMORY_*
+} __attribute__((packed));
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+// One entry of the module list at mods_addr
+struct multiboot_module {
+    uint32_t mod_start;             // First byte
+    uint32_t mod_end;               // One past the last byte
+    uint32_t string;                // "module" line from grub.cfg, path first
+    uint32_t reserved;
+} __attribute__((packed));
+
+// A Multiboot module opened as a read-only in-memory file
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t position;
+    bool is_open;
+} MOD_FileHandle;
+
+// Set up by multiboot_init(); 0 when not booted by Multiboot
+extern struct multiboot_info *mb_info;
+
+void multiboot_init(uint32_t magic, struct multiboot_info *info);
+int multiboot_cmdline_has(const char *word);
+
+uint32_t multiboot_module_count(void);
+const struct multiboot_module *multiboot_module(uint32_t index);
+
+// The kernel's own ELF section headers; GRUB loads .symtab and .strtab too
+// Returns: The table, or 0 if the bootloader did not pass one
+const Elf32_Shdr *multiboot_elf_sections(uint32_t *count);
+
+int modOpen(const char *name, MOD_FileHandle *handle);
+int modRead(MOD_FileHandle *handle, void *buffer, uint32_t size);
+int modSeek(MOD_FileHandle *handle, uint32_t offset);
+
+#endif // MULTIBOOT_H
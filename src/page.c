@@ -1,33 +1,219 @@
+#include "multiboot.h"
 #include "page.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "trace.h"
+#include "vga_output.h"
 #include <stdint.h>
 
-struct ppage physical_page_array[128];
+// Single pages come from a per-CPU magazine (cpu_t.pages) with only
+// interrupts disabled. The magazine is refilled from and drained to the
+// global free list in batches of PAGE_MAGAZINE_BATCH, which is the only
+// time page_lock is taken for them. Multi-page allocations always go to
+// the global list.
+//
+// The frames themselves are all usable RAM above 1 MiB in the Multiboot
+// memory map, minus the kernel image, the Multiboot structures and the
+// modules. The struct ppage array is carved out of that RAM as well.
+
+#define LOW_MEMORY_END  0x100000    // BIOS, VGA and the AP trampoline live below
+#define PAGE_MAX_RANGES 32
+// Used without a memory map or mem_upper from the bootloader
+#define PAGE_FALLBACK_END (16 * 1024 * 1024)
+
+struct mem_range {
+    uint32_t start;
+    uint32_t end;
+};
+
+struct ppage* physical_page_array = 0;
+uint32_t physical_page_count = 0;
 struct ppage* free_list_head = 0;
+// Protects free_list_head
+static spinlock_t page_lock = SPINLOCK_INIT;
+// Frames taken by page_reserve and page_alloc_contiguous; page_lock held
+static uint32_t pages_reserved = 0;
 struct page_directory_entry pd[1024] __attribute__((aligned(4096)));
 struct page_entry pt[1024] __attribute__((aligned(4096)));
 
-void init_pfa_list(void) {
-    for (int i = 0; i < 128; i++) {
-        physical_page_array[i].is_free = 1;
-        physical_page_array[i].refcount = 0;
+// From kernel.ld
+extern char _end_kernel[];
+
+static struct mem_range ranges[PAGE_MAX_RANGES];
+static uint32_t num_ranges = 0;
+
+static void range_add(uint64_t start, uint64_t end) {
+    if (end > 0xFFFFF000ULL) {
+        end = 0xFFFFF000ULL;        // No PAE: only the low 4 GiB are reachable
+    }
+    if (start < LOW_MEMORY_END) {
+        start = LOW_MEMORY_END;
+    }
+
+    uint32_t s = ((uint32_t)start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t e = (uint32_t)end & ~(PAGE_SIZE - 1);
+    if (start < end && s < e && num_ranges < PAGE_MAX_RANGES) {
+        ranges[num_ranges].start = s;
+        ranges[num_ranges].end = e;
+        num_ranges++;
+    }
+}
+
+// Cut [start, end) out of every range, widened to whole pages
+static void range_reserve(uint32_t start, uint32_t end) {
+    if (end <= start) {
+        return;
+    }
+
+    start &= ~(PAGE_SIZE - 1);
+    end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 
-        // Link to the next page, or NULL if last
-        if (i < 127) {
-            physical_page_array[i].next = &physical_page_array[i + 1];
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        struct mem_range* r = &ranges[i];
+        if (end <= r->start || start >= r->end) {
+            continue;
+        }
+
+        if (start > r->start && end < r->end && num_ranges < PAGE_MAX_RANGES) {
+            // Split in two
+            ranges[num_ranges].start = end;
+            ranges[num_ranges].end = r->end;
+            num_ranges++;
+            r->end = start;
+        } else if (start > r->start) {
+            r->end = start;
+        } else if (end < r->end) {
+            r->start = end;
         } else {
-            physical_page_array[i].next = 0;
+            r->start = r->end;      // Swallowed whole
+        }
+    }
+}
+
+static void collect_ranges(void) {
+    num_ranges = 0;
+
+    if (mb_info && (mb_info->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        uint32_t addr = mb_info->mmap_addr;
+        uint32_t end = addr + mb_info->mmap_length;
+        while (addr < end) {
+            struct multiboot_mmap_entry* e = (struct multiboot_mmap_entry*)addr;
+            if (e->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                range_add(e->addr, e->addr + e->len);
+            }
+            addr += e->size + sizeof(e->size);
         }
+    } else if (mb_info && (mb_info->flags & MULTIBOOT_INFO_MEMORY)) {
+        range_add(LOW_MEMORY_END, LOW_MEMORY_END + (uint64_t)mb_info->mem_upper * 1024);
+    } else {
+        range_add(LOW_MEMORY_END, PAGE_FALLBACK_END);
     }
 
-    // Set head of the free list
-    free_list_head = &physical_page_array[0];
+    range_reserve(LOW_MEMORY_END, (uint32_t)_end_kernel);
+
+    if (mb_info) {
+        range_reserve((uint32_t)mb_info, (uint32_t)mb_info + sizeof(*mb_info));
+        if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) {
+            range_reserve(mb_info->mmap_addr, mb_info->mmap_addr + mb_info->mmap_length);
+        }
+        if (mb_info->flags & MULTIBOOT_INFO_CMDLINE) {
+            const char* c = (const char*)mb_info->cmdline;
+            uint32_t len = 0;
+            while (c[len]) len++;
+            range_reserve(mb_info->cmdline, mb_info->cmdline + len + 1);
+        }
+        for (uint32_t i = 0; i < multiboot_module_count(); i++) {
+            const struct multiboot_module* mod = multiboot_module(i);
+            range_reserve(mod->mod_start, mod->mod_end);
+            if (mod->string) {
+                const char* c = (const char*)mod->string;
+                uint32_t len = 0;
+                while (c[len]) len++;
+                range_reserve(mod->string, mod->string + len + 1);
+            }
+        }
+        // Symbol and string tables GRUB loaded after the kernel
+        uint32_t num_sections;
+        const Elf32_Shdr* sections = multiboot_elf_sections(&num_sections);
+        if (sections) {
+            range_reserve((uint32_t)sections, (uint32_t)(sections + num_sections));
+            for (uint32_t i = 0; i < num_sections; i++) {
+                if (sections[i].addr) {
+                    range_reserve(sections[i].addr, sections[i].addr + sections[i].size);
+                }
+            }
+        }
+        if (multiboot_module_count()) {
+            range_reserve(mb_info->mods_addr,
+                          mb_info->mods_addr + multiboot_module_count() * sizeof(struct multiboot_module));
+        }
+    }
 }
 
-struct ppage* allocate_physical_pages(unsigned int npages) {
-    if (npages == 0 || free_list_head == 0) {
-        return 0;  // Invalid request or no pages available
+/**
+ * init_pfa_list - Build the page frame array and free list from the memory map
+ *
+ * Needs multiboot_init(). The free list starts with the highest frames,
+ * so low memory, where ELF programs are loaded, is handed out last.
+ */
+void init_pfa_list(void) {
+    collect_ranges();
+
+    uint32_t frames = 0;
+    struct mem_range* largest = 0;
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        uint32_t n = (ranges[i].end - ranges[i].start) / PAGE_SIZE;
+        frames += n;
+        if (!largest || n > (largest->end - largest->start) / PAGE_SIZE) {
+            largest = &ranges[i];
+        }
+    }
+    if (!largest) {
+        return;
     }
 
+    // The array goes at the top of the largest range; it covers a few
+    // frames more than are left afterwards, which is harmless
+    uint32_t array_bytes = frames * sizeof(struct ppage);
+    uint32_t array_pages = (array_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (array_pages >= (largest->end - largest->start) / PAGE_SIZE) {
+        return;
+    }
+    largest->end -= array_pages * PAGE_SIZE;
+    physical_page_array = (struct ppage*)largest->end;
+
+    // Ranges in address order, so the array is sorted by frame number
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        for (uint32_t j = i + 1; j < num_ranges; j++) {
+            if (ranges[j].start < ranges[i].start) {
+                struct mem_range t = ranges[i];
+                ranges[i] = ranges[j];
+                ranges[j] = t;
+            }
+        }
+    }
+
+    uint32_t n = 0;
+    free_list_head = 0;
+    for (uint32_t i = 0; i < num_ranges; i++) {
+        for (uint32_t addr = ranges[i].start; addr < ranges[i].end; addr += PAGE_SIZE) {
+            struct ppage* page = &physical_page_array[n++];
+            page->frame_number = addr >> 12;
+            page->physical_addr = (void*)addr;
+            page->is_free = 1;
+            page->refcount = 0;
+            page->prev = 0;
+
+            // Pushing in ascending order leaves the highest frame first
+            page->next = free_list_head;
+            free_list_head = page;
+        }
+    }
+    physical_page_count = n;
+}
+
+// Take npages off the global free list as one linked list; page_lock held
+static struct ppage* pool_take(unsigned int npages) {
     // Check if there are at least npages available
     struct ppage* temp = free_list_head;
     for (unsigned int i = 0; i < npages; i++) {
@@ -61,23 +247,265 @@ struct ppage* allocate_physical_pages(unsigned int npages) {
     return alloc_list;
 }
 
+// Push a page back on the global free list; page_lock held
+static void pool_put(struct ppage* page) {
+    page->is_free = 1;
+    page->refcount = 0;
+    page->next = free_list_head;
+    free_list_head = page;
+}
+
+static void magazine_refill(struct page_magazine* mag) {
+    spin_lock(&page_lock);
+    while (mag->count < PAGE_MAGAZINE_BATCH && free_list_head) {
+        struct ppage* page = free_list_head;
+        free_list_head = page->next;
+        mag->pages[mag->count++] = page;
+    }
+    spin_unlock(&page_lock);
+    mag->refills++;
+}
+
+static void magazine_drain(struct page_magazine* mag, uint32_t n) {
+    spin_lock(&page_lock);
+    while (n-- && mag->count) {
+        pool_put(mag->pages[--mag->count]);
+    }
+    spin_unlock(&page_lock);
+    mag->drains++;
+}
+
+struct ppage* allocate_physical_pages(unsigned int npages) {
+    if (npages == 0) {
+        return 0;  // Invalid request
+    }
+
+    uint32_t flags = irq_save();
+    struct page_magazine* mag = &this_cpu()->pages;
+
+    if (npages == 1) {
+        if (mag->count == 0) {
+            magazine_refill(mag);
+        }
+
+        struct ppage* page = 0;
+        if (mag->count) {
+            page = mag->pages[--mag->count];
+            page->is_free = 0;
+            page->refcount = 1;
+            page->next = 0;
+            mag->allocated++;
+        }
+        irq_restore(flags);
+        TRACE_INSTANT(PAGE_ALLOC, 1, page ? page->physical_addr : 0);
+        return page;
+    }
+
+    spin_lock(&page_lock);
+    struct ppage* list = pool_take(npages);
+    spin_unlock(&page_lock);
+
+    // Frames parked in this CPU's magazine may be what is missing
+    if (!list && mag->count) {
+        magazine_drain(mag, mag->count);
+        spin_lock(&page_lock);
+        list = pool_take(npages);
+        spin_unlock(&page_lock);
+    }
+    if (list) {
+        mag->allocated += npages;
+    }
+
+    irq_restore(flags);
+    TRACE_INSTANT(PAGE_ALLOC, npages, list ? list->physical_addr : 0);
+    return list;
+}
+
 void free_physical_pages(struct ppage* ppage_list) {
     if (ppage_list == 0) {
         return;
     }
 
+    uint32_t flags = irq_save();
+
+    if (ppage_list->next == 0) {
+        struct page_magazine* mag = &this_cpu()->pages;
+        if (mag->count == PAGE_MAGAZINE_SIZE) {
+            magazine_drain(mag, PAGE_MAGAZINE_BATCH);
+        }
+
+        ppage_list->is_free = 1;
+        ppage_list->refcount = 0;
+        mag->pages[mag->count++] = ppage_list;
+        mag->freed++;
+        irq_restore(flags);
+        return;
+    }
+
+    spin_lock(&page_lock);
     struct ppage* current = ppage_list;
     while (current != 0) {
-        current->is_free = 1;
-        current->refcount = 0;
-
         struct ppage* next = current->next;
+        pool_put(current);
+        this_cpu()->pages.freed++;
+        current = next;
+    }
+    spin_unlock(&page_lock);
 
-        // Insert this page back to the front of the free list
-        current->next = free_list_head;
-        free_list_head = current;
+    irq_restore(flags);
+}
 
-        current = next;
+// page_reserve with page_lock held; this CPU's magazine already drained
+static int page_reserve_locked(uint32_t start, uint32_t end) {
+    uint32_t first = start >> 12;
+    uint32_t last = (end + PAGE_SIZE - 1) >> 12;
+    if (last <= first) {
+        return -1;
+    }
+
+    struct ppage* taken = 0;
+    uint32_t found = 0;
+    struct ppage** link = &free_list_head;
+    while (*link) {
+        struct ppage* page = *link;
+        if (page->frame_number >= first && page->frame_number < last) {
+            *link = page->next;
+            page->next = taken;
+            taken = page;
+            found++;
+        } else {
+            link = &page->next;
+        }
+    }
+
+    int ret = 0;
+    if (found != last - first) {
+        // Put back what we took
+        while (taken) {
+            struct ppage* next = taken->next;
+            taken->next = free_list_head;
+            free_list_head = taken;
+            taken = next;
+        }
+        ret = -1;
+    } else {
+        for (struct ppage* page = taken; page; page = page->next) {
+            page->is_free = 0;
+            page->refcount = 1;
+        }
+        pages_reserved += found;
+    }
+
+    return ret;
+}
+
+/**
+ * page_reserve - Take the frames under [start, end) off the free list
+ *
+ * For memory that is used at a fixed address, such as ELF segments. All
+ * or nothing: fails if any of the frames is allocated, sitting in a CPU's
+ * magazine or not managed by the allocator at all.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int page_reserve(uint32_t start, uint32_t end) {
+    uint32_t flags = irq_save();
+
+    // This CPU's magazine is the one place we can empty without asking
+    struct page_magazine* mag = &this_cpu()->pages;
+    if (mag->count) {
+        magazine_drain(mag, mag->count);
+    }
+
+    spin_lock(&page_lock);
+    int ret = page_reserve_locked(start, end);
+    spin_unlock(&page_lock);
+
+    irq_restore(flags);
+    return ret;
+}
+
+/**
+ * page_alloc_contiguous - Allocate physically contiguous frames
+ *
+ * Searches from the top of memory down. The frames stay reserved; there
+ * is no matching free.
+ *
+ * Returns: Address of the first frame, or 0 if no run is free
+ */
+void* page_alloc_contiguous(uint32_t npages) {
+    if (npages == 0) {
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+    struct page_magazine* mag = &this_cpu()->pages;
+    if (mag->count) {
+        magazine_drain(mag, mag->count);
+    }
+
+    // Held across the scan so the run cannot be taken before it is reserved
+    spin_lock(&page_lock);
+    uint32_t addr = 0;
+    uint32_t run = 0;
+    for (uint32_t i = physical_page_count; i-- > 0;) {
+        struct ppage* page = &physical_page_array[i];
+        if (!page->is_free) {
+            run = 0;
+            continue;
+        }
+        if (run && page->frame_number + 1 != physical_page_array[i + 1].frame_number) {
+            run = 0;        // A gap: this frame starts a new run
+        }
+
+        if (++run == npages) {
+            uint32_t start = page->frame_number << 12;
+            if (page_reserve_locked(start, start + npages * PAGE_SIZE) == 0) {
+                addr = start;
+                break;
+            }
+            run = 0;
+        }
+    }
+    spin_unlock(&page_lock);
+    irq_restore(flags);
+
+    if (addr) {
+        TRACE_INSTANT(PAGE_ALLOC, npages, addr);
+    }
+    return (void*)addr;
+}
+
+// One line per online CPU with its magazine counters
+void page_cache_dump(void) {
+    uint32_t flags = irq_save();
+    spin_lock(&page_lock);
+    uint32_t pooled = 0;
+    for (struct ppage* page = free_list_head; page; page = page->next) {
+        pooled++;
+    }
+    uint32_t reserved = pages_reserved;
+    spin_unlock(&page_lock);
+    irq_restore(flags);
+
+    uint32_t cached = 0, allocated = 0, freed = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cached += cpus[i].pages.count;
+        allocated += cpus[i].pages.allocated;
+        freed += cpus[i].pages.freed;
+    }
+
+    print_string("=== Page frames ===\n");
+    kprintf("%u frames: %u free (%u in CPU caches), %u allocated, %u reserved (heap, programs)\n",
+            physical_page_count, pooled + cached, cached, allocated - freed, reserved);
+    kprintf("%u frames allocated and %u freed since boot\n", allocated, freed);
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (!cpus[i].online) {
+            continue;
+        }
+        struct page_magazine* mag = &cpus[i].pages;
+        kprintf("cpu %u: %u cached, %u refills, %u drains\n",
+                i, mag->count, mag->refills, mag->drains);
     }
 }
 
@@ -3,7 +3,11 @@
 #ifndef PAGE_H
 #define PAGE_H
 
+#define PAGE_SIZE 4096
 
+// Per-CPU cache of free frames in front of the global free list
+#define PAGE_MAGAZINE_SIZE  8
+#define PAGE_MAGAZINE_BATCH 4       // Frames moved per refill or drain
 
 struct ppage {
 uint32_t frame_number;
@@ -15,9 +19,23 @@ unsigned int refcount;
 };
 
 
+struct page_magazine {
+    struct ppage *pages[PAGE_MAGAZINE_SIZE];
+    uint32_t count;
+    uint32_t refills;               // Batches taken from the global list
+    uint32_t drains;                // Batches returned to it
+    uint32_t allocated;             // Frames handed out on this CPU
+    uint32_t freed;                 // Frames given back on this CPU
+};
+
 struct ppage *allocate_physical_pages(unsigned int npages);
 void free_physical_pages(struct ppage *ppage_list);
-extern struct ppage physical_page_array[128];
+// Frame usage (free, allocated, reserved) and the per-CPU caches
+void page_cache_dump(void);
+int page_reserve(uint32_t start, uint32_t end);
+void* page_alloc_contiguous(uint32_t npages);
+extern struct ppage* physical_page_array;     // Sorted by frame number
+extern uint32_t physical_page_count;
 extern struct ppage* free_list_head;
 
 void init_pfa_list(void);
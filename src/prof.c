@@ -0,0 +1,86 @@
+// prof.c - Profiling site bookkeeping and the stats dump
+#include "prof.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "vga_output.h"
+
+static prof_site_t *prof_sites = 0;
+static spinlock_t prof_lock = SPINLOCK_INIT;
+
+void prof_record(prof_site_t *site, uint64_t start) {
+    uint64_t elapsed = cycles() - start;
+    // Sites are also hit from IRQ handlers, other threads and other CPUs
+    uint32_t flags = spin_lock_irqsave(&prof_lock);
+
+    if (!site->registered) {
+        site->registered = 1;
+        site->next = prof_sites;
+        prof_sites = site;
+    }
+
+    site->calls++;
+    site->total_cycles += elapsed;
+    if (elapsed > site->max_cycles) {
+        site->max_cycles = elapsed;
+    }
+
+    spin_unlock_irqrestore(&prof_lock, flags);
+}
+
+void prof_scope_end(prof_scope_t *scope) {
+    prof_record(scope->site, scope->start);
+}
+
+void prof_reset(void) {
+    for (prof_site_t *site = prof_sites; site; site = site->next) {
+        site->calls = 0;
+        site->total_cycles = 0;
+        site->max_cycles = 0;
+    }
+}
+
+// print_dec() only takes 32 bits; totals can exceed that
+static void print_dec64(uint64_t num) {
+    char buffer[24];
+    int i = 0;
+    uint32_t digit;
+
+    do {
+        num = udiv64(num, 10, &digit);
+        buffer[i++] = '0' + digit;
+    } while (num > 0);
+
+    while (i > 0) {
+        kputchar(buffer[--i]);
+    }
+}
+
+/**
+ * prof_dump - Print every profiling site that has been hit
+ *
+ * One line per site: calls, total cycles, average and max cycles per
+ * call, and the total converted to microseconds.
+ */
+void prof_dump(void) {
+    kprintf("=== Profile (TSC %u kHz) ===\n", tsc_khz);
+    kprintf("site          calls total_cyc avg_cyc max_cyc total_us\n");
+
+    for (prof_site_t *site = prof_sites; site; site = site->next) {
+        uint64_t avg = site->calls ? udiv64(site->total_cycles, site->calls, 0) : 0;
+
+        kprintf("%s", site->name);
+        for (int pad = 14 - (int)__builtin_strlen(site->name); pad > 0; pad--) {
+            kputchar(' ');
+        }
+        print_dec(site->calls);
+        kputchar(' ');
+        print_dec64(site->total_cycles);
+        kputchar(' ');
+        print_dec64(avg);
+        kputchar(' ');
+        print_dec64(site->max_cycles);
+        kputchar(' ');
+        print_dec64(udiv64(cycles_to_ns(site->total_cycles), 1000, 0));
+        kputchar('\n');
+    }
+}
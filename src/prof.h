@@ -0,0 +1,49 @@
+// prof.h - Cycle-counting profiling sites
+#include <stdint.h>
+#ifndef PROF_H
+#define PROF_H
+
+// One named site: call count, total and worst-case TSC cycles
+typedef struct prof_site {
+    const char *name;
+    uint32_t calls;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    struct prof_site *next;         // Registration list, linked on first hit
+    int registered;
+} prof_site_t;
+
+// Live PROF_SCOPE measurement, closed by the cleanup handler
+typedef struct {
+    prof_site_t *site;
+    uint64_t start;
+} prof_scope_t;
+
+void prof_record(prof_site_t *site, uint64_t start);
+void prof_scope_end(prof_scope_t *scope);
+void prof_dump(void);
+void prof_reset(void);
+
+#ifdef CONFIG_PROFILE
+#include "timer.h"
+
+// PROF_BEGIN(name) ... PROF_END(name) times a region within one block
+#define PROF_BEGIN(name) \
+    static prof_site_t prof_site_##name = { #name }; \
+    uint64_t prof_start_##name = cycles()
+#define PROF_END(name) \
+    prof_record(&prof_site_##name, prof_start_##name)
+
+// PROF_SCOPE(name) times from here to the end of the enclosing scope,
+// so every return path of a function is covered
+#define PROF_SCOPE(name) \
+    static prof_site_t prof_site_##name = { #name }; \
+    prof_scope_t prof_scope_##name __attribute__((cleanup(prof_scope_end))) = \
+        { &prof_site_##name, cycles() }
+#else
+#define PROF_BEGIN(name)    do { } while (0)
+#define PROF_END(name)      do { } while (0)
+#define PROF_SCOPE(name)    do { } while (0)
+#endif
+
+#endif // PROF_H
@@ -0,0 +1,53 @@
+// ramdisk.c - Block device backed by a disk image in memory
+//
+// The image is usually a Multiboot module (see modOpen in multiboot.c),
+// so it is already in RAM when the kernel starts. Reads are a memcpy, and
+// ramdisk_map() lets callers use the sectors in place.
+#include <string.h>
+#include "ramdisk.h"
+
+static const uint8_t *ramdisk_image = 0;
+static uint32_t ramdisk_sector_count = 0;
+
+int ramdisk_attach(const void *image, uint32_t size) {
+    // A trailing partial sector cannot be read
+    if (!image || size < RAMDISK_SECTOR_SIZE) {
+        return -1;
+    }
+
+    ramdisk_image = (const uint8_t*)image;
+    ramdisk_sector_count = size / RAMDISK_SECTOR_SIZE;
+    return 0;
+}
+
+void ramdisk_detach(void) {
+    ramdisk_image = 0;
+    ramdisk_sector_count = 0;
+}
+
+int ramdisk_attached(void) {
+    return ramdisk_image != 0;
+}
+
+uint32_t ramdisk_sectors(void) {
+    return ramdisk_sector_count;
+}
+
+const void *ramdisk_map(uint32_t sector, uint32_t count) {
+    if (!ramdisk_image || count == 0 ||
+        sector >= ramdisk_sector_count || count > ramdisk_sector_count - sector) {
+        return 0;
+    }
+
+    return ramdisk_image + sector * RAMDISK_SECTOR_SIZE;
+}
+
+int ramdisk_read(uint32_t sector, uint32_t count, void *buffer) {
+    const void *src = ramdisk_map(sector, count);
+    if (!src) {
+        return -1;
+    }
+
+    memcpy(buffer, src, count * RAMDISK_SECTOR_SIZE);
+    return 0;
+}
@@ -0,0 +1,26 @@
+// ramdisk.h - Block device backed by a disk image in memory
+#include <stdint.h>
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#define RAMDISK_SECTOR_SIZE 512
+
+// Serve disk_read() from @size bytes at @image instead of the ATA drive.
+// The image stays in place; nothing is copied.
+// Returns: 0 on success, -1 if the image is empty
+int ramdisk_attach(const void *image, uint32_t size);
+
+// Go back to the ATA drive
+void ramdisk_detach(void);
+
+int ramdisk_attached(void);
+uint32_t ramdisk_sectors(void);
+
+int ramdisk_read(uint32_t sector, uint32_t count, void *buffer);
+
+// Pointer to @count sectors starting at @sector inside the image
+// Returns: The pointer, or 0 if no image is attached or the range is
+// outside it
+const void *ramdisk_map(uint32_t sector, uint32_t count);
+
+#endif // RAMDISK_H
@@ -0,0 +1,170 @@
+// sampler.c - Statistical profiler fed by the timer interrupt
+//
+// Each tick stores the interrupted EIP and a few return addresses from
+// the EBP chain. The kernel is built without -fomit-frame-pointer, so
+// every C function keeps [ebp] = caller's ebp and [ebp + 4] = return
+// address. Only the boot CPU gets IRQ0, so only its buffer fills for now;
+// the buffers are per CPU so that other tick sources need no lock.
+#include <stddef.h>
+#include "ksym.h"
+#include "page.h"
+#include "sampler.h"
+#include "smp.h"
+#include "timer.h"
+#include "vga_output.h"
+
+extern void* kmalloc(size_t size);
+extern void kfree(void* ptr);
+
+// From kernel.ld
+extern char _end_kernel[];
+
+#define KERNEL_START 0x100000
+
+typedef struct {
+    uint32_t pc[SAMPLER_DEPTH];     // 0 past the end of the backtrace
+} sample_t;
+
+typedef struct {
+    sample_t *samples;
+    uint32_t count;
+    uint32_t dropped;
+} sample_buffer_t;
+
+static sample_buffer_t buffers[MAX_CPUS];
+static volatile int sampling = 0;
+
+int sampler_start(void) {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (!cpus[i].online || buffers[i].samples) {
+            continue;
+        }
+        buffers[i].samples = (sample_t*)kmalloc(SAMPLER_SAMPLES * sizeof(sample_t));
+        if (!buffers[i].samples) {
+            return -1;
+        }
+    }
+
+    sampling = 1;
+    return 0;
+}
+
+void sampler_stop(void) {
+    sampling = 0;
+}
+
+static int in_kernel_text(uint32_t addr) {
+    return addr >= KERNEL_START && addr < (uint32_t)_end_kernel;
+}
+
+void sampler_tick(interrupt_frame_t *frame) {
+    if (!sampling) {
+        return;
+    }
+
+    sample_buffer_t *buf = &buffers[this_cpu()->id];
+    if (!buf->samples) {
+        return;
+    }
+    if (buf->count == SAMPLER_SAMPLES) {
+        buf->dropped++;
+        return;
+    }
+
+    sample_t *s = &buf->samples[buf->count++];
+    s->pc[0] = frame->eip;
+
+    // Frames only go up the stack, and never by more than a stack page
+    // or two; anything else means the chain is broken
+    uint32_t ebp = frame->ebp;
+    for (int depth = 1; depth < SAMPLER_DEPTH; depth++) {
+        uint32_t ret = 0;
+        if (ebp && (ebp & 3) == 0 && ebp >= KERNEL_START) {
+            uint32_t *fp = (uint32_t*)ebp;
+            uint32_t next = fp[0];
+            ret = fp[1];
+            if (!in_kernel_text(ret)) {
+                ret = 0;
+            }
+            ebp = (next > ebp && next - ebp < 2 * PAGE_SIZE) ? next : 0;
+        }
+        s->pc[depth] = ret;
+    }
+}
+
+/**
+ * sampler_dump - Print the functions that were sampled most
+ *
+ * "self" counts samples whose EIP was in the function, "total" those with
+ * the function anywhere in the recorded backtrace.
+ */
+void sampler_dump(void) {
+    uint32_t samples = 0, dropped = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        samples += buffers[i].count;
+        dropped += buffers[i].dropped;
+    }
+    kprintf("=== Samples: %u at %u Hz, %u dropped ===\n", samples, TIMER_HZ, dropped);
+
+    uint32_t nsyms = ksym_count();
+    if (samples == 0) {
+        return;
+    }
+    if (nsyms == 0) {
+        print_string("No kernel symbol table; boot with GRUB to get one\n");
+        return;
+    }
+
+    // self[] and total[] per symbol, plus one slot for unknown addresses
+    uint32_t *self = (uint32_t*)kmalloc((nsyms + 1) * 2 * sizeof(uint32_t));
+    if (!self) {
+        return;
+    }
+    uint32_t *total = self + nsyms + 1;
+    for (uint32_t i = 0; i < (nsyms + 1) * 2; i++) {
+        self[i] = 0;
+    }
+
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        for (uint32_t n = 0; n < buffers[c].count; n++) {
+            const sample_t *s = &buffers[c].samples[n];
+            int seen[SAMPLER_DEPTH];
+            for (int d = 0; d < SAMPLER_DEPTH && (d == 0 || s->pc[d]); d++) {
+                // Return addresses point after the call; look up the call itself
+                int sym = ksym_index(d == 0 ? s->pc[d] : s->pc[d] - 1);
+                uint32_t slot = sym < 0 ? nsyms : (uint32_t)sym;
+                if (d == 0) {
+                    self[slot]++;
+                }
+
+                // Recursion counts once per sample
+                int dup = 0;
+                for (int k = 0; k < d; k++) {
+                    dup |= seen[k] == (int)slot;
+                }
+                seen[d] = slot;
+                if (!dup) {
+                    total[slot]++;
+                }
+            }
+        }
+    }
+
+    print_string("  self%  total%  function\n");
+    for (int rank = 0; rank < SAMPLER_TOP; rank++) {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i <= nsyms; i++) {
+            if (self[i] > self[best] || (self[i] == self[best] && total[i] > total[best])) {
+                best = i;
+            }
+        }
+        if (self[best] == 0) {
+            break;
+        }
+        kprintf("  %u  %u  %s\n", self[best] * 100 / samples, total[best] * 100 / samples,
+                best == nsyms ? "(unknown)" : ksym_name(best));
+        self[best] = 0;
+    }
+
+    kfree(self);
+}
@@ -0,0 +1,21 @@
+// sampler.h - Statistical profiler fed by the timer interrupt
+#include <stdint.h>
+#include "idt.h"
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#define SAMPLER_DEPTH   4           // Interrupted EIP plus three callers
+#define SAMPLER_SAMPLES 4096        // Per CPU, ~4 s of ticks; later ones are dropped
+#define SAMPLER_TOP     20          // Functions listed by sampler_dump()
+
+// Allocate a sample buffer for every online CPU and start recording
+int sampler_start(void);
+void sampler_stop(void);
+
+// Record where @frame interrupted; called from the timer interrupt
+void sampler_tick(interrupt_frame_t *frame);
+
+// Per-function histogram of the samples, symbolized with ksym
+void sampler_dump(void);
+
+#endif // SAMPLER_H
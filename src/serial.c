@@ -0,0 +1,44 @@
+// serial.c - Polled 16550 UART on COM1
+//
+// kputchar() copies everything to COM1 once serial_init() has run, so
+// output such as the benchmark tables can be captured on the host with
+// "qemu-system-i386 -serial stdio".
+#include "io.h"
+#include "serial.h"
+
+#define UART_DATA       0           // DLAB=0: data, DLAB=1: divisor low
+#define UART_IER        1           // DLAB=0: interrupt enable, DLAB=1: divisor high
+#define UART_FCR        2
+#define UART_LCR        3
+#define UART_MCR        4
+#define UART_LSR        5
+#define UART_LSR_THRE   0x20        // Transmit holding register empty
+
+int serial_ready = 0;
+
+void serial_init(void) {
+    outb(SERIAL_COM1 + UART_IER, 0x00);     // No interrupts
+    outb(SERIAL_COM1 + UART_LCR, 0x80);     // DLAB on
+    outb(SERIAL_COM1 + UART_DATA, 0x01);    // 115200 baud
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, 0x03);     // 8N1, DLAB off
+    outb(SERIAL_COM1 + UART_FCR, 0xC7);     // Enable and clear FIFOs
+    outb(SERIAL_COM1 + UART_MCR, 0x03);     // DTR + RTS
+
+    // No UART present: the LSR reads back as all ones
+    serial_ready = inb(SERIAL_COM1 + UART_LSR) != 0xFF;
+}
+
+void serial_putchar(char c) {
+    if (!serial_ready) {
+        return;
+    }
+
+    if (c == '\n') {
+        serial_putchar('\r');
+    }
+
+    while (!(inb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE)) {
+    }
+    outb(SERIAL_COM1 + UART_DATA, c);
+}
@@ -0,0 +1,12 @@
+// serial.h - COM1 output, mirrored from the VGA console
+#include <stdint.h>
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#define SERIAL_COM1 0x3F8
+
+void serial_init(void);
+void serial_putchar(char c);
+extern int serial_ready;
+
+#endif // SERIAL_H
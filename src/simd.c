@@ -0,0 +1,245 @@
+// simd.c - SSE2 string and checksum kernels (PROFILE=sse2 only)
+//
+// This is the only translation unit compiled with vector registers enabled.
+// Everything else is built with -mgeneral-regs-only, so the compiler never
+// touches XMM state behind our back and kernel_fpu_begin/end only has to
+// protect the code in this file. Each entry point calls kernel_fpu_begin
+// before its first vector expression, even an initializer, since that
+// would clobber the XMM state about to be saved.
+//
+// The stacks are only 4-byte aligned, so the Makefile builds this file
+// with -mstackrealign: spilled vector locals are stored with movdqa.
+#include "cpu.h"
+#include "idt.h"
+#include "simd.h"
+#include "smp.h"
+#include "thread.h"
+#include "vga_output.h"
+
+typedef uint8_t  v16u8  __attribute__((vector_size(16)));
+typedef char     v16i8  __attribute__((vector_size(16)));
+typedef uint32_t v4u32  __attribute__((vector_size(16)));
+// Unaligned views, used for movdqu loads/stores
+typedef v16u8    v16u8_u __attribute__((aligned(1), may_alias));
+typedef v4u32    v4u32_u __attribute__((aligned(1), may_alias));
+
+#define CR0_MP          (1 << 1)
+#define CR0_EM          (1 << 2)
+#define CR0_TS          (1 << 3)
+#define CR4_OSFXSR      (1 << 9)
+#define CR4_OSXMMEXCPT  (1 << 10)
+
+int simd_enabled = 0;
+
+/**
+ * simd_init - Enable the FPU and SSE for kernel use
+ *
+ * Clears CR0.EM/TS, sets CR0.MP and turns on FXSAVE/SSE support in CR4.
+ * Leaves simd_enabled at 0 on CPUs without SSE2 so the generic routines
+ * keep being used.
+ *
+ * Returns: 0 on success, -1 if the CPU lacks SSE2
+ */
+int simd_init(void) {
+    uint32_t edx = cpuid_features_edx();
+    if ((edx & (CPUID_EDX_FXSR | CPUID_EDX_SSE2)) != (CPUID_EDX_FXSR | CPUID_EDX_SSE2)) {
+        return -1;
+    }
+
+    simd_init_cpu();
+    simd_enabled = 1;
+    return 0;
+}
+
+/**
+ * simd_init_cpu - Set CR0/CR4 up for SSE on the calling CPU
+ *
+ * simd_init() does this for the boot CPU; application processors call it
+ * themselves once simd_enabled is set.
+ */
+void simd_init_cpu(void) {
+    uint32_t cr0, cr4;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP;
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0));
+
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4));
+
+    __asm__ volatile ("fninit");
+}
+
+void kernel_fpu_begin(void) {
+    // A thread switch would not save the XMM registers
+    preempt_disable();
+    // An interrupt handler may nest; the depth and save area must move together
+    uint32_t flags = irq_save();
+    cpu_t *cpu = this_cpu();
+    if (cpu->fpu_depth == FPU_MAX_DEPTH) {
+        kprintf("PANIC: kernel_fpu_begin nested too deep\n");
+        for (;;) {
+            __asm__ volatile ("cli; hlt");
+        }
+    }
+    __asm__ volatile ("fxsave %0" : "=m"(cpu->fpu_save_area[cpu->fpu_depth]));
+    cpu->fpu_depth++;
+    irq_restore(flags);
+}
+
+void kernel_fpu_end(void) {
+    uint32_t flags = irq_save();
+    cpu_t *cpu = this_cpu();
+    cpu->fpu_depth--;
+    __asm__ volatile ("fxrstor %0" : : "m"(cpu->fpu_save_area[cpu->fpu_depth]));
+    irq_restore(flags);
+    preempt_enable();
+}
+
+void *sse2_memcpy(void *dest, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    kernel_fpu_begin();
+
+    // Byte head so that every vector store is aligned
+    while (((uintptr_t)d & 15) && n) {
+        *d++ = *s++;
+        n--;
+    }
+
+    while (n >= 64) {
+        v16u8 a = *(const v16u8_u *)(s +  0);
+        v16u8 b = *(const v16u8_u *)(s + 16);
+        v16u8 c = *(const v16u8_u *)(s + 32);
+        v16u8 e = *(const v16u8_u *)(s + 48);
+        *(v16u8 *)(d +  0) = a;
+        *(v16u8 *)(d + 16) = b;
+        *(v16u8 *)(d + 32) = c;
+        *(v16u8 *)(d + 48) = e;
+        d += 64;
+        s += 64;
+        n -= 64;
+    }
+
+    while (n >= 16) {
+        *(v16u8 *)d = *(const v16u8_u *)s;
+        d += 16;
+        s += 16;
+        n -= 16;
+    }
+
+    while (n--) {
+        *d++ = *s++;
+    }
+
+    kernel_fpu_end();
+    return dest;
+}
+
+void *sse2_memset(void *s, int c, size_t n) {
+    uint8_t *p = (uint8_t *)s;
+
+    kernel_fpu_begin();
+    v16u8 fill = (v16u8){0} + (uint8_t)c;
+
+    while (((uintptr_t)p & 15) && n) {
+        *p++ = (uint8_t)c;
+        n--;
+    }
+
+    while (n >= 64) {
+        *(v16u8 *)(p +  0) = fill;
+        *(v16u8 *)(p + 16) = fill;
+        *(v16u8 *)(p + 32) = fill;
+        *(v16u8 *)(p + 48) = fill;
+        p += 64;
+        n -= 64;
+    }
+
+    while (n >= 16) {
+        *(v16u8 *)p = fill;
+        p += 16;
+        n -= 16;
+    }
+
+    while (n--) {
+        *p++ = (uint8_t)c;
+    }
+
+    kernel_fpu_end();
+    return s;
+}
+
+int sse2_memcmp(const void *s1, const void *s2, size_t n) {
+    const uint8_t *p1 = (const uint8_t *)s1;
+    const uint8_t *p2 = (const uint8_t *)s2;
+    int result = 0;
+
+    kernel_fpu_begin();
+
+    while (n >= 16) {
+        v16u8 a = *(const v16u8_u *)p1;
+        v16u8 b = *(const v16u8_u *)p2;
+        // pcmpeqb + pmovmskb: one bit per equal byte
+        uint32_t eq = __builtin_ia32_pmovmskb128((v16i8)(a == b));
+        if (eq != 0xFFFF) {
+            int i = __builtin_ctz(~eq);
+            result = p1[i] - p2[i];
+            goto done;
+        }
+        p1 += 16;
+        p2 += 16;
+        n -= 16;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (p1[i] != p2[i]) {
+            result = p1[i] - p2[i];
+            break;
+        }
+    }
+
+done:
+    kernel_fpu_end();
+    return result;
+}
+
+/**
+ * sse2_checksum32 - Vector version of checksum32() in kernel_main.c
+ *
+ * Keeps the four per-lane running sums (A) and sums of sums (B) in one
+ * XMM register each; the result is bit-identical to the scalar version.
+ */
+uint32_t sse2_checksum32(const void *buf, size_t n) {
+    const uint8_t *p = (const uint8_t *)buf;
+    size_t len = n;
+
+    kernel_fpu_begin();
+    v4u32 a = {0, 0, 0, 0};
+    v4u32 b = {0, 0, 0, 0};
+
+    while (n >= 16) {
+        a += *(const v4u32_u *)p;
+        b += a;
+        p += 16;
+        n -= 16;
+    }
+
+    if (n) {
+        // Zero-padded final block
+        uint8_t tail[16] __attribute__((aligned(16))) = {0};
+        for (size_t i = 0; i < n; i++) {
+            tail[i] = p[i];
+        }
+        a += *(const v4u32 *)tail;
+        b += a;
+    }
+
+    uint32_t sum_a = a[0] + a[1] + a[2] + a[3];
+    uint32_t sum_b = b[0] + b[1] + b[2] + b[3];
+
+    kernel_fpu_end();
+    return (sum_a + (uint32_t)len) ^ ((sum_b << 16) | (sum_b >> 16));
+}
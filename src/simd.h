@@ -0,0 +1,27 @@
+// simd.h - SSE2 kernels for the PROFILE=sse2 build
+#include <stdint.h>
+#include <stddef.h>
+#ifndef SIMD_H
+#define SIMD_H
+
+// Calls below this size stay on the general-register routines, since
+// saving and restoring the XMM state costs more than it saves
+#define SIMD_MIN_BYTES 1024
+
+// Set by simd_init() once CR0/CR4 allow SSE instructions
+extern int simd_enabled;
+
+int simd_init(void);
+void simd_init_cpu(void);
+
+// Bracket any kernel use of XMM registers. Each nesting level saves the
+// XMM state it interrupts, up to FPU_MAX_DEPTH levels.
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+void *sse2_memcpy(void *dest, const void *src, size_t n);
+void *sse2_memset(void *s, int c, size_t n);
+int sse2_memcmp(const void *s1, const void *s2, size_t n);
+uint32_t sse2_checksum32(const void *buf, size_t n);
+
+#endif // SIMD_H
@@ -0,0 +1,281 @@
+// smp.c - Application processor startup, per-CPU data and IPIs
+//
+// The boot CPU starts the others with the INIT-SIPI-SIPI sequence,
+// broadcast through its local APIC to every other CPU. Each AP comes up
+// in real mode in ap_boot.asm, enters protected mode and lands in
+// ap_main(), which loads the shared GDT and IDT, points %gs at its cpu_t
+// and then waits for work. Threads only run on the boot CPU; the other
+// CPUs run smp_work_t items queued with smp_call() and tell the boot CPU
+// about completions with an IPI.
+#include <string.h>
+#include "cpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "page.h"
+#include "simd.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+#include "vga_output.h"
+
+#define MSR_APIC_BASE           0x1B
+#define APIC_BASE_ENABLE        (1 << 11)
+#define APIC_BASE_ADDR_MASK     0xFFFFF000
+
+// Local APIC registers, as byte offsets from the MMIO base
+#define LAPIC_ID                0x020
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+
+#define LAPIC_SVR_ENABLE        (1 << 8)
+#define ICR_FIXED               0x00000
+#define ICR_INIT                0x00500
+#define ICR_STARTUP             0x00600
+#define ICR_DELIVERY_PENDING    (1 << 12)
+#define ICR_ASSERT              (1 << 14)
+#define ICR_LEVEL               (1 << 15)
+#define ICR_ALL_BUT_SELF        (3 << 18)
+
+// Wait this long for APs to report in after the second SIPI
+#define AP_STARTUP_WAIT_US      100000
+
+cpu_t cpus[MAX_CPUS];
+uint32_t smp_num_cpus = 1;
+
+// Read by ap_boot.asm: next CPU index and the stack top for each index
+volatile uint32_t ap_next_index = 1;
+uint32_t ap_stacks[MAX_CPUS];
+
+static volatile uint32_t *lapic = 0;
+// Boot CPU threads sleep here in smp_wait()
+static wait_queue_t smp_done_queue = WAIT_QUEUE_INIT;
+
+// From ap_boot.asm
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+
+static uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+static void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void lapic_enable(void) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+static void lapic_send_ipi(uint32_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING) {
+        __asm__ volatile ("rep; nop");
+    }
+}
+
+static void udelay(uint32_t us) {
+    uint64_t deadline = ktime_ns() + (uint64_t)us * 1000;
+    while (ktime_ns() < deadline) {
+        __asm__ volatile ("rep; nop");
+    }
+}
+
+static void percpu_load(uint32_t id) {
+    __asm__ volatile ("movw %w0, %%gs" : : "r"(PERCPU_SEL(id)));
+}
+
+/**
+ * smp_early_init - Install the GDT and per-CPU segments
+ *
+ * Every CPU's segment is set up here so that APs only have to load
+ * theirs. Runs before anything uses this_cpu(), including
+ * kernel_fpu_begin().
+ */
+void smp_early_init(void) {
+    gdt_init();
+
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpus[i].self = &cpus[i];
+        cpus[i].id = i;
+        gdt_set_percpu(i, (uint32_t)&cpus[i], sizeof(cpu_t));
+    }
+
+    percpu_load(0);
+    cpus[0].online = 1;
+}
+
+// Pop and run everything queued for the calling CPU
+static void smp_run_work(cpu_t *cpu) {
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&cpu->work_lock);
+        smp_work_t *work = cpu->work_head;
+        if (work) {
+            cpu->work_head = work->next;
+            if (!cpu->work_head) {
+                cpu->work_tail = 0;
+            }
+        }
+        spin_unlock_irqrestore(&cpu->work_lock, flags);
+
+        if (!work) {
+            return;
+        }
+
+        work->fn(work->arg);
+        cpu->work_done++;
+
+        __asm__ volatile ("" : : : "memory");
+        work->done = 1;
+        lapic_send_ipi(cpus[0].apic_id, ICR_FIXED | ICR_ASSERT | IPI_WAKE_VECTOR);
+    }
+}
+
+// IPI_WORK_VECTOR on an AP: only there to break the hlt in ap_main()
+static void ipi_work(interrupt_frame_t *frame) {
+    (void)frame;
+    this_cpu()->ipis_received++;
+    lapic_eoi();
+}
+
+// IPI_WAKE_VECTOR on the boot CPU: some work item finished
+static void ipi_wake(interrupt_frame_t *frame) {
+    (void)frame;
+    this_cpu()->ipis_received++;
+    lapic_eoi();
+    wake_up(&smp_done_queue);
+}
+
+void ap_main(uint32_t id) __attribute__((noreturn));
+
+void ap_main(uint32_t id) {
+    cpu_t *cpu = &cpus[id];
+
+    gdt_load();
+    percpu_load(id);
+    idt_load_cpu();
+    lapic_enable();
+#ifdef CONFIG_SSE2
+    if (simd_enabled) {
+        simd_init_cpu();
+    }
+#endif
+
+    cpu->apic_id = lapic_read(LAPIC_ID) >> 24;
+    __asm__ volatile ("" : : : "memory");
+    cpu->online = 1;
+
+    // Check for work with interrupts off so an IPI cannot slip in
+    // between the check and the hlt; sti only takes effect after hlt
+    for (;;) {
+        __asm__ volatile ("cli");
+        if (!cpu->work_head) {
+            __asm__ volatile ("sti; hlt");
+            continue;
+        }
+        __asm__ volatile ("sti");
+        smp_run_work(cpu);
+    }
+}
+
+/**
+ * smp_init - Bring up the application processors
+ *
+ * Does nothing on CPUs without a local APIC. Sets smp_num_cpus to the
+ * number of CPUs that reported in.
+ */
+void smp_init(void) {
+    if (!(cpuid_features_edx() & CPUID_EDX_APIC)) {
+        return;
+    }
+
+    uint64_t apic_base = rdmsr(MSR_APIC_BASE);
+    if (!(apic_base & APIC_BASE_ENABLE)) {
+        return;
+    }
+    lapic = (volatile uint32_t*)(uint32_t)(apic_base & APIC_BASE_ADDR_MASK);
+
+    lapic_register(IPI_WORK_VECTOR, ipi_work);
+    lapic_register(IPI_WAKE_VECTOR, ipi_wake);
+    lapic_enable();
+    cpus[0].apic_id = lapic_read(LAPIC_ID) >> 24;
+
+    // Stacks for every possible AP; the ones nobody claims go back below
+    struct ppage *stacks[MAX_CPUS] = { 0 };
+    for (uint32_t i = 1; i < MAX_CPUS; i++) {
+        stacks[i] = allocate_physical_pages(1);
+        if (stacks[i]) {
+            ap_stacks[i] = (uint32_t)stacks[i]->physical_addr + PAGE_SIZE;
+        }
+    }
+
+    memcpy((void*)AP_TRAMPOLINE_BASE, ap_trampoline_start,
+           ap_trampoline_end - ap_trampoline_start);
+
+    lapic_send_ipi(0, ICR_ALL_BUT_SELF | ICR_INIT | ICR_ASSERT | ICR_LEVEL);
+    udelay(10000);
+    for (int i = 0; i < 2; i++) {
+        lapic_send_ipi(0, ICR_ALL_BUT_SELF | ICR_STARTUP | (AP_TRAMPOLINE_BASE >> 12));
+        udelay(200);
+    }
+
+    // APs claim indices in ap_next_index but are only usable once online
+    uint64_t deadline = ktime_ns() + (uint64_t)AP_STARTUP_WAIT_US * 1000;
+    while (ktime_ns() < deadline) {
+        uint32_t claimed = ap_next_index < MAX_CPUS ? ap_next_index : MAX_CPUS;
+        uint32_t online = 1;
+        for (uint32_t i = 1; i < claimed; i++) {
+            online += cpus[i].online;
+        }
+        if (claimed == MAX_CPUS && online == MAX_CPUS) {
+            break;
+        }
+    }
+
+    smp_num_cpus = 1;
+    for (uint32_t i = 1; i < MAX_CPUS; i++) {
+        if (cpus[i].online) {
+            smp_num_cpus++;
+        } else if (i >= ap_next_index) {
+            ap_stacks[i] = 0;
+            free_physical_pages(stacks[i]);
+        }
+    }
+}
+
+void smp_call(uint32_t cpu_id, smp_work_t *work) {
+    work->done = 0;
+    work->next = 0;
+
+    if (cpu_id >= MAX_CPUS || cpu_id == this_cpu()->id || !cpus[cpu_id].online) {
+        work->fn(work->arg);
+        work->done = 1;
+        return;
+    }
+
+    cpu_t *cpu = &cpus[cpu_id];
+    uint32_t flags = spin_lock_irqsave(&cpu->work_lock);
+    if (cpu->work_tail) {
+        cpu->work_tail->next = work;
+    } else {
+        cpu->work_head = work;
+    }
+    cpu->work_tail = work;
+    spin_unlock_irqrestore(&cpu->work_lock, flags);
+
+    lapic_send_ipi(cpu->apic_id, ICR_FIXED | ICR_ASSERT | IPI_WORK_VECTOR);
+}
+
+void smp_wait(smp_work_t *work) {
+    uint32_t flags = irq_save();
+    while (!work->done) {
+        thread_sleep(&smp_done_queue, 0);
+    }
+    irq_restore(flags);
+}
@@ -0,0 +1,78 @@
+// smp.h - Application processor startup, per-CPU data and IPIs
+#include <stdint.h>
+#include "page.h"
+#include "spinlock.h"
+#ifndef SMP_H
+#define SMP_H
+
+#define MAX_CPUS            8
+#define AP_TRAMPOLINE_BASE  0x8000      // Must match ap_boot.asm; 4 KiB aligned, below 1 MiB
+#define FPU_MAX_DEPTH       4           // Nested kernel_fpu_begin calls per CPU
+
+// LAPIC vectors, above the remapped PIC range
+#define IPI_WORK_VECTOR     0xF0        // "Check your work queue"
+#define IPI_WAKE_VECTOR     0xF1        // "Work finished", sent to the boot CPU
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+// Work item handed to another CPU with smp_call()
+typedef struct smp_work {
+    void (*fn)(void *arg);
+    void *arg;
+    volatile int done;
+    struct smp_work *next;
+} smp_work_t;
+
+// Per-CPU area, reached through %gs (see this_cpu())
+typedef struct cpu {
+    struct cpu *self;               // Must stay first
+    uint32_t id;                    // 0 = boot CPU
+    uint32_t apic_id;
+    volatile int online;
+
+    // Scheduler state; threads only run on the boot CPU
+    int preempt_count;
+    int need_resched;
+
+    // Work queued by smp_call()
+    spinlock_t work_lock;
+    smp_work_t *work_head;
+    smp_work_t *work_tail;
+    uint32_t work_done;
+    uint32_t ipis_received;
+
+    // Single-page allocations and frees, see page.c
+    struct page_magazine pages;
+
+    // kernel_fpu_begin/end save areas (PROFILE=sse2), one per nesting
+    // level, so an interrupt handler using XMM keeps the state it interrupted
+    int fpu_depth;
+    uint8_t fpu_save_area[FPU_MAX_DEPTH][512] __attribute__((aligned(16)));
+} __attribute__((aligned(64))) cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t smp_num_cpus;
+
+static inline cpu_t *this_cpu(void) {
+    cpu_t *cpu;
+    __asm__ volatile ("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Point %gs at the boot CPU's area; before anything calls this_cpu()
+void smp_early_init(void);
+// Start the other CPUs. Needs idt_init(), sched_init() and the page allocator.
+void smp_init(void);
+
+/**
+ * smp_call - Run @work->fn(@work->arg) on CPU @cpu
+ *
+ * Returns at once; use smp_wait() for completion. Work for the boot CPU
+ * or a CPU that is not online runs before smp_call() returns. Work runs
+ * outside any thread, so it must not sleep (no FAT calls, disk_read or
+ * mutexes); kmalloc, the page allocator and kprintf are fine.
+ */
+void smp_call(uint32_t cpu, smp_work_t *work);
+// Sleep until @work has run; called from a thread on the boot CPU
+void smp_wait(smp_work_t *work);
+
+#endif // SMP_H
@@ -0,0 +1,48 @@
+// spinlock.h - Ticket spinlocks for state shared between CPUs
+//
+// Tickets are handed out in order, so CPUs get the lock first come,
+// first served. The _irqsave variants also keep interrupt handlers on
+// the local CPU out, which is what every lock in the kernel needs since
+// the same state is touched from IRQ context. Locks are never held
+// across a sleep.
+//
+// lock xadd needs a 486; the kernel is otherwise built for a 386, but
+// any machine with a local APIC (and thus more than one CPU) has it.
+#include <stdint.h>
+#include "idt.h"
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+typedef struct {
+    volatile uint16_t owner;        // Ticket currently allowed in
+    volatile uint16_t next;         // Next ticket to hand out
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock(spinlock_t *lock) {
+    uint16_t ticket = 1;
+    __asm__ volatile ("lock xaddw %0, %1" : "+r"(ticket), "+m"(lock->next) : : "memory");
+    while (lock->owner != ticket) {
+        __asm__ volatile ("rep; nop" : : : "memory");   // pause
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    // Only the holder writes owner, and x86 stores are not reordered
+    // with earlier loads or stores
+    __asm__ volatile ("incw %0" : "+m"(lock->owner) : : "memory");
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
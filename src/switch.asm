@@ -0,0 +1,29 @@
+; switch.asm - Kernel thread context switch
+
+section .text
+
+; void context_switch(uint32_t *old_esp, uint32_t new_esp)
+;
+; Saves the callee-saved registers and EFLAGS on the current stack,
+; stores the stack pointer in *old_esp and resumes the thread whose
+; stack pointer is new_esp. thread.c builds the same frame for new
+; threads: EFLAGS, EDI, ESI, EBX, EBP, return address.
+global context_switch
+context_switch:
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushfd
+
+    mov eax, [esp + 24]     ; old_esp
+    mov edx, [esp + 28]     ; new_esp
+    mov [eax], esp
+    mov esp, edx
+
+    popfd
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
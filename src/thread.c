@@ -0,0 +1,414 @@
+// thread.c - Kernel threads and the round-robin scheduler
+//
+// Threads run in ring 0 on one-page stacks from the physical page
+// allocator. The IRQ0 handler preempts the running thread every
+// SCHED_SLICE_TICKS ticks; threads can also give up the CPU with
+// thread_yield() or block on a wait queue. The flow of control that
+// entered main() is adopted as thread 0 and keeps the boot stack from
+// multiboot.asm. When nothing is runnable the idle thread halts the CPU
+// until the next interrupt. All of this runs on the boot CPU only; the
+// other CPUs take work through smp_call() instead.
+#include "idt.h"
+#include "sampler.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+#include "vga_output.h"
+
+// Written at the bottom of every thread stack and checked on each switch
+#define STACK_CANARY 0x57ACCA9E
+#define EFLAGS_RESERVED 0x002
+
+static thread_t threads[THREAD_MAX];
+static thread_t *current = 0;
+static thread_t *idle_thread = 0;
+static wait_queue_t run_queue = WAIT_QUEUE_INIT;
+static uint32_t next_thread_id = 0;
+static uint32_t slice_ticks = 0;
+
+// Time spent in the idle thread, accounted on every switch to and from it
+static uint64_t idle_cycles = 0;
+static uint64_t idle_since = 0;
+
+// From switch.asm
+extern void context_switch(uint32_t *old_esp, uint32_t new_esp);
+
+static void queue_push(wait_queue_t *q, thread_t *t) {
+    t->next = 0;
+    if (q->tail) {
+        q->tail->next = t;
+    } else {
+        q->head = t;
+    }
+    q->tail = t;
+}
+
+static thread_t *queue_pop(wait_queue_t *q) {
+    thread_t *t = q->head;
+    if (t) {
+        q->head = t->next;
+        if (!q->head) {
+            q->tail = 0;
+        }
+        t->next = 0;
+    }
+    return t;
+}
+
+static void queue_remove(wait_queue_t *q, thread_t *t) {
+    thread_t *prev = 0;
+    for (thread_t *it = q->head; it; prev = it, it = it->next) {
+        if (it != t) {
+            continue;
+        }
+        if (prev) {
+            prev->next = t->next;
+        } else {
+            q->head = t->next;
+        }
+        if (q->tail == t) {
+            q->tail = prev;
+        }
+        t->next = 0;
+        return;
+    }
+}
+
+static void check_stack(thread_t *t) {
+    if (t->stack_page && *(uint32_t*)t->stack_page->physical_addr != STACK_CANARY) {
+        kprintf("PANIC: stack overflow in thread %s\n", t->name);
+        for (;;) {
+            __asm__ volatile ("cli; hlt");
+        }
+    }
+}
+
+/**
+ * schedule - Switch to the next ready thread
+ *
+ * Must be called with interrupts disabled. A running thread goes to the
+ * back of the run queue and keeps the CPU if nothing else is ready; a
+ * blocked or dead one hands over to the idle thread in that case.
+ */
+static void schedule(void) {
+    thread_t *prev = current;
+
+    check_stack(prev);
+    this_cpu()->need_resched = 0;
+
+    if (prev->state == THREAD_RUNNING) {
+        if (!run_queue.head) {
+            return;
+        }
+        prev->state = THREAD_READY;
+        // The idle thread only runs when the queue is empty
+        if (prev != idle_thread) {
+            queue_push(&run_queue, prev);
+        }
+    }
+
+    thread_t *next = queue_pop(&run_queue);
+    if (!next) {
+        next = idle_thread;
+    }
+
+    next->state = THREAD_RUNNING;
+    current = next;
+    slice_ticks = 0;
+
+    if (next != prev) {
+        uint64_t now = cycles();
+        if (prev == idle_thread) {
+            idle_cycles += now - idle_since;
+        } else if (next == idle_thread) {
+            idle_since = now;
+        }
+        context_switch(&prev->esp, next->esp);
+    }
+}
+
+// Move a blocked thread to the run queue
+static void wake_thread(thread_t *t) {
+    t->waiting_on = 0;
+    t->wake_tick = 0;
+    t->state = THREAD_READY;
+    queue_push(&run_queue, t);
+}
+
+// Wake sleepers whose timeout has passed
+static void check_timeouts(void) {
+    for (int i = 0; i < THREAD_MAX; i++) {
+        thread_t *t = &threads[i];
+        if (t->state == THREAD_BLOCKED && t->wake_tick &&
+            (int32_t)(timer_ticks - t->wake_tick) >= 0) {
+            queue_remove(t->waiting_on, t);
+            t->timed_out = 1;
+            wake_thread(t);
+        }
+    }
+}
+
+// IRQ0: keep time and ask for preemption once the slice is used up
+static void sched_timer_irq(interrupt_frame_t *frame) {
+#ifdef CONFIG_PROFILE
+    sampler_tick(frame);
+#else
+    (void)frame;
+#endif
+
+    timer_tick();
+    check_timeouts();
+
+    if (++slice_ticks >= SCHED_SLICE_TICKS || current == idle_thread) {
+        this_cpu()->need_resched = 1;
+    }
+}
+
+/**
+ * sched_irq_exit - Preempt the current thread on the way out of an interrupt
+ *
+ * Called by irq_dispatch once the handler has returned, so the time until
+ * this thread runs again is not charged to the handler. Interrupts are
+ * still disabled.
+ */
+void sched_irq_exit(void) {
+    cpu_t *cpu = this_cpu();
+    if (cpu->need_resched && cpu->preempt_count == 0) {
+        schedule();
+    }
+}
+
+// First code run by every new thread, "returned" to by context_switch
+static void thread_trampoline(void) {
+    irq_enable();
+    current->entry(current->arg);
+    thread_exit();
+}
+
+static void idle_loop(void *arg) {
+    (void)arg;
+
+    // Interrupts that make a thread runnable switch away from here
+    for (;;) {
+        __asm__ volatile ("sti; hlt");
+    }
+}
+
+// Set up a thread slot and its stack; called with interrupts disabled
+static thread_t *thread_alloc(const char *name, void (*entry)(void *arg), void *arg) {
+    thread_t *t = 0;
+    for (int i = 0; i < THREAD_MAX; i++) {
+        if (threads[i].state == THREAD_UNUSED) {
+            t = &threads[i];
+            break;
+        }
+    }
+
+    struct ppage *page = t ? allocate_physical_pages(1) : 0;
+    if (!page) {
+        return 0;
+    }
+
+    uint32_t *stack = (uint32_t*)page->physical_addr;
+    uint32_t *sp = stack + THREAD_STACK_SIZE / sizeof(uint32_t);
+
+    stack[0] = STACK_CANARY;
+
+    // Frame popped by context_switch, see switch.asm
+    *--sp = 0;                              // Return address of the trampoline
+    *--sp = (uint32_t)thread_trampoline;
+    *--sp = 0;                              // EBP
+    *--sp = 0;                              // EBX
+    *--sp = 0;                              // ESI
+    *--sp = 0;                              // EDI
+    *--sp = EFLAGS_RESERVED;                // EFLAGS, interrupts off until the trampoline
+
+    t->esp = (uint32_t)sp;
+    t->id = next_thread_id++;
+    t->name = name;
+    t->stack_page = page;
+    t->entry = entry;
+    t->arg = arg;
+    t->next = 0;
+    t->waiting_on = 0;
+    t->wake_tick = 0;
+    t->exited.head = t->exited.tail = 0;
+    t->state = THREAD_READY;
+    return t;
+}
+
+/**
+ * sched_init - Turn the boot flow into thread 0 and start preemption
+ *
+ * Needs idt_init() and init_pfa_list() first. Interrupts are enabled on
+ * return.
+ */
+void sched_init(void) {
+    thread_t *boot = &threads[0];
+
+    boot->id = next_thread_id++;
+    boot->name = "main";
+    boot->state = THREAD_RUNNING;
+    boot->stack_page = 0;
+    current = boot;
+
+    idle_thread = thread_alloc("idle", idle_loop, 0);
+
+    irq_register(IRQ_TIMER, sched_timer_irq);
+    irq_enable();
+}
+
+/**
+ * thread_create - Start a kernel thread
+ *
+ * @name: Name for diagnostics (not copied)
+ * @entry: Function to run; returning from it ends the thread
+ * @arg: Passed to @entry
+ *
+ * Returns: The new thread, or 0 if no slot or stack page is free
+ */
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg) {
+    uint32_t flags = irq_save();
+
+    thread_t *t = thread_alloc(name, entry, arg);
+    if (t) {
+        queue_push(&run_queue, t);
+    }
+
+    irq_restore(flags);
+    return t;
+}
+
+void thread_yield(void) {
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_exit(void) {
+    irq_save();
+    current->state = THREAD_DEAD;
+    wake_up(&current->exited);
+    schedule();
+
+    // Dead threads are never switched back to
+    for (;;) {
+        __asm__ volatile ("hlt");
+    }
+}
+
+/**
+ * thread_join - Wait for a thread to exit and free its stack
+ *
+ * Only one thread may join a given thread. Threads that are never joined
+ * keep their stack page.
+ */
+void thread_join(thread_t *thread) {
+    uint32_t flags = irq_save();
+
+    while (thread->state != THREAD_DEAD) {
+        thread_sleep(&thread->exited, 0);
+    }
+
+    free_physical_pages(thread->stack_page);
+    thread->stack_page = 0;
+    thread->state = THREAD_UNUSED;
+    irq_restore(flags);
+}
+
+thread_t *thread_current(void) {
+    return current;
+}
+
+int thread_sleep(wait_queue_t *wq, uint32_t timeout_ticks) {
+    current->state = THREAD_BLOCKED;
+    current->waiting_on = wq;
+    current->wake_tick = timeout_ticks ? timer_ticks + timeout_ticks : 0;
+    // A deadline that wraps to 0 would mean "no timeout"
+    if (timeout_ticks && current->wake_tick == 0) {
+        current->wake_tick = 1;
+    }
+    current->timed_out = 0;
+    queue_push(wq, current);
+
+    schedule();
+
+    return current->timed_out ? -1 : 0;
+}
+
+void wake_up(wait_queue_t *wq) {
+    uint32_t flags = irq_save();
+
+    thread_t *t;
+    while ((t = queue_pop(wq))) {
+        wake_thread(t);
+    }
+
+    // Called from an interrupt that arrived while idle: run the sleeper now
+    if (current == idle_thread && run_queue.head) {
+        schedule();
+    }
+
+    irq_restore(flags);
+}
+
+void wake_up_one(wait_queue_t *wq) {
+    uint32_t flags = irq_save();
+
+    thread_t *t = queue_pop(wq);
+    if (t) {
+        wake_thread(t);
+    }
+
+    if (current == idle_thread && run_queue.head) {
+        schedule();
+    }
+
+    irq_restore(flags);
+}
+
+uint64_t sched_idle_cycles(void) {
+    uint32_t flags = irq_save();
+
+    uint64_t total = idle_cycles;
+    if (current == idle_thread) {
+        total += cycles() - idle_since;
+    }
+
+    irq_restore(flags);
+    return total;
+}
+
+void preempt_disable(void) {
+    this_cpu()->preempt_count++;
+}
+
+// need_resched is only ever set on the boot CPU
+void preempt_enable(void) {
+    cpu_t *cpu = this_cpu();
+    if (--cpu->preempt_count == 0 && cpu->need_resched) {
+        thread_yield();
+    }
+}
+
+void mutex_lock(kmutex_t *mutex) {
+    uint32_t flags = irq_save();
+
+    while (mutex->locked) {
+        thread_sleep(&mutex->waiters, 0);
+    }
+    mutex->locked = 1;
+    mutex->owner = current;
+
+    irq_restore(flags);
+}
+
+void mutex_unlock(kmutex_t *mutex) {
+    uint32_t flags = irq_save();
+
+    mutex->owner = 0;
+    mutex->locked = 0;
+    wake_up_one(&mutex->waiters);
+
+    irq_restore(flags);
+}
@@ -0,0 +1,83 @@
+// thread.h - Kernel threads and the round-robin scheduler
+#include <stdint.h>
+#include "page.h"
+#ifndef THREAD_H
+#define THREAD_H
+
+#define THREAD_MAX          16
+#define THREAD_STACK_SIZE   PAGE_SIZE   // One frame from the page allocator
+#define SCHED_SLICE_TICKS   10          // Timer ticks per time slice
+
+typedef enum {
+    THREAD_UNUSED,
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+} thread_state_t;
+
+struct thread;
+
+// FIFO of threads blocked in thread_sleep()
+typedef struct {
+    struct thread *head;
+    struct thread *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { 0, 0 }
+
+typedef struct thread {
+    uint32_t esp;                   // Saved stack pointer while switched out
+    uint32_t id;
+    const char *name;
+    thread_state_t state;
+    struct ppage *stack_page;       // 0 for the boot thread
+    void (*entry)(void *arg);
+    void *arg;
+    struct thread *next;            // Run queue or wait queue link
+    wait_queue_t *waiting_on;       // Queue this thread is blocked on
+    uint32_t wake_tick;             // timer_ticks deadline, 0 = none
+    int timed_out;
+    wait_queue_t exited;            // Woken by thread_exit() for thread_join()
+} thread_t;
+
+// Sleeping lock for state shared between threads. mutex_unlock may run
+// in IRQ context for a lock another thread took: the ATA driver's
+// ata_mutex is held by a request until its last sector and released by
+// the IRQ14 handler, so owner is only informational there.
+typedef struct {
+    volatile int locked;
+    thread_t *owner;
+    wait_queue_t waiters;
+} kmutex_t;
+
+void sched_init(void);
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg);
+void thread_yield(void);
+void thread_exit(void) __attribute__((noreturn));
+void thread_join(thread_t *thread);
+thread_t *thread_current(void);
+
+// Block on @wq until wake_up(), or for at most @timeout_ticks timer ticks
+// (0 = no limit). Call with interrupts disabled, after checking the
+// condition being waited for; they are disabled again on return.
+// Returns 0 when woken, -1 on timeout.
+int thread_sleep(wait_queue_t *wq, uint32_t timeout_ticks);
+// Make every thread on @wq runnable; safe from IRQ handlers
+void wake_up(wait_queue_t *wq);
+void wake_up_one(wait_queue_t *wq);
+
+// TSC cycles spent in the idle thread since sched_init()
+uint64_t sched_idle_cycles(void);
+
+// Called by irq_dispatch last; switches threads if the timer asked for it
+void sched_irq_exit(void);
+
+// Keep the current thread on the CPU, e.g. while XMM state is live
+void preempt_disable(void);
+void preempt_enable(void);
+
+void mutex_lock(kmutex_t *mutex);
+void mutex_unlock(kmutex_t *mutex);
+
+#endif // THREAD_H
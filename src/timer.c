@@ -0,0 +1,101 @@
+// timer.c - PIT tick and TSC calibration
+//
+// PIT channel 0 is programmed as the periodic tick source. Nothing is
+// delivered until an IRQ0 handler calls timer_tick(); until then the
+// fine-grained clock is the TSC, calibrated here against PIT channel 2,
+// which can be polled through port 0x61 without interrupts.
+#include "io.h"
+#include "timer.h"
+
+#define PIT_CHANNEL0    0x40
+#define PIT_CHANNEL2    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE_PORT   0x61        // Bit 0: ch2 gate, bit 1: speaker, bit 5: ch2 output
+
+#define PIT_CMD_CH0_RATE    0x34    // Channel 0, lobyte/hibyte, mode 2 (rate generator)
+#define PIT_CMD_CH2_ONESHOT 0xB0    // Channel 2, lobyte/hibyte, mode 0 (terminal count)
+
+#define CALIBRATE_MS    10
+// Used if calibration cannot run, so ktime_ns() never divides by zero
+#define FALLBACK_TSC_KHZ 1000000
+
+volatile uint32_t timer_ticks = 0;
+uint32_t tsc_khz = FALLBACK_TSC_KHZ;
+static uint64_t tsc_boot = 0;
+
+uint64_t udiv64(uint64_t n, uint32_t d, uint32_t *rem) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+
+    // r < d, so the 64/32 divl below cannot overflow
+    __asm__ ("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+// Count TSC cycles across a CALIBRATE_MS one-shot on PIT channel 2
+static uint32_t calibrate_tsc_khz(void) {
+    uint16_t latch = PIT_BASE_HZ / (1000 / CALIBRATE_MS);
+
+    // Gate channel 2 on, keep the speaker off
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    outb(PIT_COMMAND, PIT_CMD_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, latch & 0xFF);
+    outb(PIT_CHANNEL2, latch >> 8);
+
+    uint64_t start = cycles();
+    uint32_t polls = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        // A missing PIT would leave OUT2 low forever
+        if (++polls == 0x1000000) {
+            return 0;
+        }
+    }
+    uint64_t elapsed = cycles() - start;
+
+    return (uint32_t)udiv64(elapsed, CALIBRATE_MS, 0);
+}
+
+/**
+ * timer_init - Start the periodic tick and calibrate the TSC
+ *
+ * Programs PIT channel 0 for TIMER_HZ and measures the TSC rate against
+ * PIT channel 2. Must run before ktime_ns() is used for timeouts.
+ */
+void timer_init(void) {
+    uint16_t divisor = PIT_BASE_HZ / TIMER_HZ;
+
+    outb(PIT_COMMAND, PIT_CMD_CH0_RATE);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, divisor >> 8);
+
+    uint32_t khz = calibrate_tsc_khz();
+    if (khz != 0) {
+        tsc_khz = khz;
+    }
+
+    tsc_boot = cycles();
+}
+
+void timer_tick(void) {
+    timer_ticks++;
+}
+
+uint64_t cycles_to_ns(uint64_t c) {
+    uint32_t rem;
+
+    // Whole milliseconds first so the remainder scaling cannot overflow
+    uint64_t ms = udiv64(c, tsc_khz, &rem);
+    return ms * 1000000 + udiv64((uint64_t)rem * 1000000, tsc_khz, 0);
+}
+
+// Nanoseconds since timer_init()
+uint64_t ktime_ns(void) {
+    return cycles_to_ns(cycles() - tsc_boot);
+}
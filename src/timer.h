@@ -0,0 +1,30 @@
+// timer.h - PIT tick and TSC-based time keeping
+#include <stdint.h>
+#ifndef TIMER_H
+#define TIMER_H
+
+#define PIT_BASE_HZ 1193182
+#define TIMER_HZ    1000            // Periodic tick rate of PIT channel 0
+
+// Incremented by timer_tick() from the IRQ0 handler
+extern volatile uint32_t timer_ticks;
+// TSC frequency measured by timer_init()
+extern uint32_t tsc_khz;
+
+void timer_init(void);
+void timer_tick(void);
+
+// Raw time stamp counter
+static inline uint64_t cycles(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// 64-by-32 division without libgcc: returns n / d and stores n % d in *rem
+uint64_t udiv64(uint64_t n, uint32_t d, uint32_t *rem);
+
+uint64_t cycles_to_ns(uint64_t c);
+uint64_t ktime_ns(void);
+
+#endif // TIMER_H
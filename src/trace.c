@@ -0,0 +1,88 @@
+// trace.c - Tracepoint ring buffer and its serial dump
+//
+// Writers claim a slot with one lock xadd on the head counter, so
+// tracepoints work from IRQ handlers and other CPUs without a lock. A
+// record being written while the buffer is dumped may come out torn.
+#ifdef CONFIG_TRACE
+#include <stddef.h>
+#include <string.h>
+#include "serial.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+#include "trace.h"
+
+trace_buffer_t trace_buffer;
+
+// "name begin-args|end-args"; instant events only have the first list
+static const char *const trace_names[TRACE_EVENT_COUNT] = {
+    [TRACE_DISK_READ]           = "disk_read sector count|sectors result",
+    [TRACE_FAT_OPEN]            = "fatOpen|result",
+    [TRACE_FAT_READ]            = "fatRead size|bytes",
+    [TRACE_FAT_NEXT_CLUSTER]    = "get_next_cluster cluster next",
+    [TRACE_KMALLOC]             = "kmalloc size ptr",
+    [TRACE_PAGE_ALLOC]          = "page_alloc pages addr",
+};
+
+void trace_init(void) {
+    trace_buffer.version = TRACE_VERSION;
+    trace_buffer.record_size = sizeof(trace_record_t);
+    trace_buffer.capacity = TRACE_RECORDS;
+    trace_buffer.tsc_khz = tsc_khz;
+    trace_buffer.event_count = TRACE_EVENT_COUNT;
+    for (int i = 0; i < TRACE_EVENT_COUNT; i++) {
+        for (int j = 0; j < TRACE_NAME_LEN - 1 && trace_names[i][j]; j++) {
+            trace_buffer.names[i][j] = trace_names[i][j];
+        }
+    }
+    // Last, so a memory dump taken earlier has no valid header to find
+    memcpy(trace_buffer.magic, TRACE_MAGIC, sizeof(trace_buffer.magic));
+}
+
+void trace_record(uint32_t event, uint32_t phase, uint32_t id, uint32_t arg0, uint32_t arg1) {
+    uint32_t index = 1;
+    __asm__ volatile ("lock xaddl %0, %1" : "+r"(index), "+m"(trace_buffer.head) : : "memory");
+
+    trace_record_t *rec = &trace_buffer.records[index & (TRACE_RECORDS - 1)];
+    cpu_t *cpu = this_cpu();
+    thread_t *thread = cpu->id == 0 ? thread_current() : 0;
+
+    rec->tsc = cycles();
+    rec->event = event;
+    rec->phase = phase;
+    rec->cpu = cpu->id;
+    rec->thread = thread ? thread->id : 0;
+    rec->id = id;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+}
+
+static void serial_puts(const char *s) {
+    while (*s) {
+        serial_putchar(*s++);
+    }
+}
+
+/**
+ * trace_dump - Write the trace buffer to COM1 for tools/trace2json.py
+ *
+ * The header and the used records go out as hex, 32 bytes per line, so
+ * the serial log stays plain text. Nothing goes to the VGA console.
+ */
+void trace_dump(void) {
+    static const char hex[] = "0123456789abcdef";
+    uint32_t used = trace_buffer.head < TRACE_RECORDS ? trace_buffer.head : TRACE_RECORDS;
+    uint32_t bytes = offsetof(trace_buffer_t, records) + used * sizeof(trace_record_t);
+    const uint8_t *p = (const uint8_t *)&trace_buffer;
+
+    serial_puts("\nTRACE BEGIN\n");
+    for (uint32_t i = 0; i < bytes; i++) {
+        serial_putchar(hex[p[i] >> 4]);
+        serial_putchar(hex[p[i] & 15]);
+        if ((i & 31) == 31 || i == bytes - 1) {
+            serial_putchar('\n');
+        }
+    }
+    serial_puts("TRACE END\n");
+}
+#endif // CONFIG_TRACE
@@ -0,0 +1,87 @@
+// trace.h - Static tracepoints recorded into a binary ring buffer
+//
+// Built with CONFIG_TRACE (make TRACE=1), every tracepoint stores one
+// fixed-size record with a TSC timestamp in trace_buffer. Without it the
+// macros expand to nothing. tools/trace2json.py turns the buffer, taken
+// from the serial port or a memory dump, into Chrome trace JSON.
+#include <stdint.h>
+#ifndef TRACE_H
+#define TRACE_H
+
+// Events; trace.c has their names and argument names, in this order
+enum trace_event {
+    TRACE_DISK_READ,                // Async span from submit to completion
+    TRACE_FAT_OPEN,                 // Span around fatOpen
+    TRACE_FAT_READ,                 // Span around fatRead
+    TRACE_FAT_NEXT_CLUSTER,         // Instant: cluster, next
+    TRACE_KMALLOC,                  // Instant: size, pointer
+    TRACE_PAGE_ALLOC,               // Instant: pages, first frame address
+    TRACE_EVENT_COUNT
+};
+
+// Record phases use the Chrome trace event letters
+#define TRACE_PH_BEGIN          'B'
+#define TRACE_PH_END            'E'
+#define TRACE_PH_INSTANT        'i'
+#define TRACE_PH_ASYNC_BEGIN    'b'
+#define TRACE_PH_ASYNC_END      'e'
+
+#define TRACE_RECORDS   8192        // Power of two; the oldest are overwritten
+#define TRACE_NAME_LEN  48
+
+typedef struct {
+    uint64_t tsc;
+    uint16_t event;
+    uint8_t phase;
+    uint8_t cpu;
+    uint32_t thread;                // Thread id on the boot CPU, else 0
+    uint32_t id;                    // Pairs async begin and end
+    uint32_t arg0, arg1;
+    uint32_t reserved;
+} trace_record_t;
+
+// Everything the host decoder needs, in one block it can find by magic
+typedef struct {
+    char magic[8];                  // TRACE_MAGIC, written by trace_init
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;
+    uint32_t tsc_khz;
+    volatile uint32_t head;         // Records written so far, including overwritten ones
+    uint32_t event_count;
+    char names[TRACE_EVENT_COUNT][TRACE_NAME_LEN];     // Event and argument names
+    trace_record_t records[TRACE_RECORDS];
+} trace_buffer_t;
+
+#define TRACE_MAGIC     "NEILTRCE"
+#define TRACE_VERSION   1
+
+extern trace_buffer_t trace_buffer;
+
+// Fill in the header; records made before this are kept
+void trace_init(void);
+void trace_record(uint32_t event, uint32_t phase, uint32_t id, uint32_t arg0, uint32_t arg1);
+
+// Write the buffer to the serial port as hex between TRACE BEGIN/END lines
+void trace_dump(void);
+
+#ifdef CONFIG_TRACE
+#define TRACE_BEGIN(event, a0, a1) \
+    trace_record(TRACE_##event, TRACE_PH_BEGIN, 0, (uint32_t)(a0), (uint32_t)(a1))
+#define TRACE_END(event, a0, a1) \
+    trace_record(TRACE_##event, TRACE_PH_END, 0, (uint32_t)(a0), (uint32_t)(a1))
+#define TRACE_INSTANT(event, a0, a1) \
+    trace_record(TRACE_##event, TRACE_PH_INSTANT, 0, (uint32_t)(a0), (uint32_t)(a1))
+#define TRACE_ASYNC_BEGIN(event, id, a0, a1) \
+    trace_record(TRACE_##event, TRACE_PH_ASYNC_BEGIN, (uint32_t)(id), (uint32_t)(a0), (uint32_t)(a1))
+#define TRACE_ASYNC_END(event, id, a0, a1) \
+    trace_record(TRACE_##event, TRACE_PH_ASYNC_END, (uint32_t)(id), (uint32_t)(a0), (uint32_t)(a1))
+#else
+#define TRACE_BEGIN(event, a0, a1)              do { } while (0)
+#define TRACE_END(event, a0, a1)                do { } while (0)
+#define TRACE_INSTANT(event, a0, a1)            do { } while (0)
+#define TRACE_ASYNC_BEGIN(event, id, a0, a1)    do { } while (0)
+#define TRACE_ASYNC_END(event, id, a0, a1)      do { } while (0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,332 @@
+// vfs.c - File descriptors, shared inodes and a page cache over one filesystem
+//
+// vfs_open gives out small integer descriptors. Descriptors open on the
+// same path share one inode, and every read goes through a page cache
+// keyed by (inode, page index), so data read through one descriptor is
+// there for the next, even after the file was closed and opened again.
+// The mounted filesystem only has to find files and read byte ranges.
+#include <string.h>
+#include "vfs.h"
+
+typedef struct {
+    vfs_inode_t *inode;             // NULL = free page
+    uint32_t ino;                   // inode->ino when the page was filled
+    uint32_t index;                 // Page of the file
+    uint32_t bytes;                 // Valid bytes, short on the last page
+    uint32_t last_used;
+    int16_t next;                   // Hash chain, -1 = end
+} vfs_page_t;
+
+typedef struct {
+    vfs_inode_t *inode;             // NULL = descriptor not in use
+    uint32_t position;
+} vfs_file_t;
+
+static const vfs_fs_ops_t *vfs_ops = 0;
+static vfs_inode_t vfs_inodes[VFS_INODES];
+static vfs_file_t vfs_files[VFS_MAX_FILES];
+static vfs_page_t vfs_pages[VFS_CACHE_PAGES];
+static int16_t vfs_buckets[VFS_HASH_BUCKETS];
+static uint8_t *vfs_page_data = 0;  // VFS_CACHE_PAGES pages, from kmalloc
+static uint32_t vfs_clock = 0;
+static uint32_t vfs_next_ino = 1;
+static vfs_stats_t vfs_counters;
+
+static inline uint32_t page_hash(uint32_t ino, uint32_t index) {
+    return (ino * 0x9E3779B1u + index) & (VFS_HASH_BUCKETS - 1);
+}
+
+static inline uint8_t *page_data(const vfs_page_t *page) {
+    return vfs_page_data + (uint32_t)(page - vfs_pages) * VFS_PAGE_SIZE;
+}
+
+// Take @page out of its hash chain and mark it free
+static void page_drop(vfs_page_t *page) {
+    int16_t slot = page - vfs_pages;
+    int16_t *link = &vfs_buckets[page_hash(page->ino, page->index)];
+    while (*link != -1 && *link != slot) {
+        link = &vfs_pages[*link].next;
+    }
+    if (*link == slot) {
+        *link = page->next;
+    }
+    page->inode = 0;
+    vfs_counters.pages_cached--;
+}
+
+/**
+ * page_get - Find or fill one page of a file in the cache
+ *
+ * @inode: File the page belongs to
+ * @index: Page of the file, below the page count of its size
+ *
+ * A miss takes a free page, or else the least recently used one, and
+ * fills it with one read from the filesystem.
+ *
+ * Returns: The page, or NULL on a read error
+ */
+static vfs_page_t *page_get(vfs_inode_t *inode, uint32_t index) {
+    uint32_t bucket = page_hash(inode->ino, index);
+    for (int16_t i = vfs_buckets[bucket]; i != -1; i = vfs_pages[i].next) {
+        vfs_page_t *page = &vfs_pages[i];
+        if (page->inode == inode && page->ino == inode->ino && page->index == index) {
+            page->last_used = ++vfs_clock;
+            vfs_counters.page_hits++;
+            return page;
+        }
+    }
+
+    vfs_page_t *victim = &vfs_pages[0];
+    for (uint32_t i = 0; i < VFS_CACHE_PAGES && victim->inode; i++) {
+        if (!vfs_pages[i].inode || vfs_pages[i].last_used < victim->last_used) {
+            victim = &vfs_pages[i];
+        }
+    }
+    if (victim->inode) {
+        page_drop(victim);
+        vfs_counters.page_evictions++;
+    }
+
+    vfs_counters.page_misses++;
+    uint32_t offset = index * VFS_PAGE_SIZE;
+    uint32_t want = inode->size - offset < VFS_PAGE_SIZE ? inode->size - offset : VFS_PAGE_SIZE;
+    int n = vfs_ops->read(inode, offset, page_data(victim), want);
+    if (n != (int)want) {
+        return 0;
+    }
+
+    victim->inode = inode;
+    victim->ino = inode->ino;
+    victim->index = index;
+    victim->bytes = want;
+    victim->last_used = ++vfs_clock;
+    victim->next = vfs_buckets[bucket];
+    vfs_buckets[bucket] = victim - vfs_pages;
+    vfs_counters.pages_cached++;
+    return victim;
+}
+
+// ASCII case-insensitive compare, as FAT and exFAT look names up
+static bool name_equal(const char *a, const char *b) {
+    for (;; a++, b++) {
+        char ca = (*a >= 'a' && *a <= 'z') ? *a - 32 : *a;
+        char cb = (*b >= 'a' && *b <= 'z') ? *b - 32 : *b;
+        if (ca != cb) {
+            return false;
+        }
+        if (ca == '\0') {
+            return true;
+        }
+    }
+}
+
+// A slot for a new inode: a free one, or the least recently used of
+// those no descriptor has open, whose pages go with it
+static vfs_inode_t *inode_alloc(void) {
+    vfs_inode_t *slot = 0;
+    for (uint32_t i = 0; i < VFS_INODES; i++) {
+        vfs_inode_t *inode = &vfs_inodes[i];
+        if (inode->ino == 0) {
+            return inode;
+        }
+        if (inode->refs == 0 && (!slot || inode->last_used < slot->last_used)) {
+            slot = inode;
+        }
+    }
+
+    if (slot) {
+        for (uint32_t i = 0; i < VFS_CACHE_PAGES; i++) {
+            if (vfs_pages[i].inode == slot) {
+                page_drop(&vfs_pages[i]);
+            }
+        }
+        slot->ino = 0;
+    }
+    return slot;
+}
+
+static vfs_file_t *file_get(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_FILES || !vfs_files[fd].inode) {
+        return 0;
+    }
+    return &vfs_files[fd];
+}
+
+/**
+ * vfs_mount - Serve descriptors from a filesystem
+ *
+ * @ops: The filesystem, already initialized, e.g. &fat_vfs_ops
+ *
+ * Forgets every inode, descriptor and cached page of the previous mount.
+ * The page cache memory is allocated by the first call.
+ *
+ * Returns: 0 on success, -1 if the cache cannot be allocated
+ */
+int vfs_mount(const vfs_fs_ops_t *ops) {
+    if (!ops) {
+        return -1;
+    }
+
+    vfs_lock();
+    if (!vfs_page_data) {
+        vfs_page_data = (uint8_t*)kmalloc(VFS_CACHE_PAGES * VFS_PAGE_SIZE);
+    }
+    int ret = -1;
+    if (vfs_page_data) {
+        memset(vfs_inodes, 0, sizeof(vfs_inodes));
+        memset(vfs_files, 0, sizeof(vfs_files));
+        memset(vfs_pages, 0, sizeof(vfs_pages));
+        memset(vfs_buckets, 0xFF, sizeof(vfs_buckets));
+        memset(&vfs_counters, 0, sizeof(vfs_counters));
+        vfs_ops = ops;
+        ret = 0;
+    }
+    vfs_unlock();
+    return ret;
+}
+
+/**
+ * vfs_open - Open a file of the mounted filesystem
+ *
+ * @path: Name of the file, compared without regard to ASCII case
+ *
+ * A path opened before, and still cached, shares its inode and pages
+ * without asking the filesystem again.
+ *
+ * Returns: A descriptor, or -1 if the file does not exist or no
+ *          descriptor or inode slot is free
+ */
+int vfs_open(const char *path) {
+    if (!vfs_ops || !path) {
+        return -1;
+    }
+
+    vfs_lock();
+    int fd = 0;
+    while (fd < VFS_MAX_FILES && vfs_files[fd].inode) {
+        fd++;
+    }
+
+    vfs_inode_t *inode = 0;
+    for (uint32_t i = 0; fd < VFS_MAX_FILES && i < VFS_INODES; i++) {
+        if (vfs_inodes[i].ino != 0 && name_equal(vfs_inodes[i].name, path)) {
+            inode = &vfs_inodes[i];
+            vfs_counters.inode_hits++;
+            break;
+        }
+    }
+
+    if (fd < VFS_MAX_FILES && !inode && (inode = inode_alloc()) != 0) {
+        vfs_counters.inode_lookups++;
+        if (vfs_ops->lookup(path, inode) == 0) {
+            inode->ino = vfs_next_ino++;
+            inode->refs = 0;
+            size_t len = strlen(path);
+            if (len < VFS_NAME_MAX) {
+                memcpy(inode->name, path, len + 1);
+            } else {
+                inode->name[0] = '\0';
+            }
+        } else {
+            inode = 0;
+        }
+    }
+
+    if (!inode) {
+        vfs_unlock();
+        return -1;
+    }
+
+    inode->refs++;
+    inode->last_used = ++vfs_clock;
+    vfs_files[fd].inode = inode;
+    vfs_files[fd].position = 0;
+    vfs_unlock();
+    return fd;
+}
+
+/**
+ * vfs_read - Read from an open descriptor
+ *
+ * Copies out of the page cache, filling pages from the filesystem as
+ * needed, and advances the descriptor's position.
+ *
+ * Returns: Number of bytes read, 0 at end of file, or -1 on error
+ */
+int vfs_read(int fd, void *buffer, uint32_t size) {
+    vfs_lock();
+    vfs_file_t *file = file_get(fd);
+    if (!file || !buffer) {
+        vfs_unlock();
+        return -1;
+    }
+
+    vfs_inode_t *inode = file->inode;
+    if (file->position >= inode->size) {
+        size = 0;
+    } else if (size > inode->size - file->position) {
+        size = inode->size - file->position;
+    }
+
+    uint8_t *out = (uint8_t*)buffer;
+    uint32_t done = 0;
+    while (done < size) {
+        vfs_page_t *page = page_get(inode, file->position / VFS_PAGE_SIZE);
+        if (!page) {
+            vfs_unlock();
+            return -1;
+        }
+
+        uint32_t offset = file->position % VFS_PAGE_SIZE;
+        uint32_t n = page->bytes - offset;
+        if (n > size - done) {
+            n = size - done;
+        }
+        memcpy(out + done, page_data(page) + offset, n);
+        done += n;
+        file->position += n;
+    }
+    inode->last_used = ++vfs_clock;
+    vfs_unlock();
+    return done;
+}
+
+// Offsets past the end of the file are clamped to its size
+int vfs_seek(int fd, uint32_t offset) {
+    vfs_lock();
+    vfs_file_t *file = file_get(fd);
+    if (file) {
+        file->position = offset < file->inode->size ? offset : file->inode->size;
+    }
+    vfs_unlock();
+    return file ? 0 : -1;
+}
+
+// The inode and its pages stay cached for the next vfs_open
+int vfs_close(int fd) {
+    vfs_lock();
+    vfs_file_t *file = file_get(fd);
+    if (file) {
+        file->inode->refs--;
+        file->inode = 0;
+    }
+    vfs_unlock();
+    return file ? 0 : -1;
+}
+
+int vfs_fstat(int fd, vfs_stat_t *st) {
+    vfs_lock();
+    vfs_file_t *file = file_get(fd);
+    if (file && st) {
+        st->ino = file->inode->ino;
+        st->size = file->inode->size;
+    }
+    vfs_unlock();
+    return file && st ? 0 : -1;
+}
+
+void vfs_stats(vfs_stats_t *stats) {
+    vfs_lock();
+    *stats = vfs_counters;
+    vfs_unlock();
+}
@@ -0,0 +1,66 @@
+// vfs.h - File descriptors, shared inodes and a page cache over one filesystem
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef VFS_H
+#define VFS_H
+
+#define VFS_PAGE_SIZE       4096
+#define VFS_CACHE_PAGES     64      // 256 KiB of file data
+#define VFS_HASH_BUCKETS    64      // Power of two
+#define VFS_INODES          32
+#define VFS_MAX_FILES       32
+#define VFS_NAME_MAX        64      // Longer names are opened but not remembered
+#define VFS_FS_DATA         48      // Bytes of per-file filesystem state
+
+struct vfs_inode;
+
+// What a filesystem provides to be mounted, see fat_vfs_ops in fat.c
+typedef struct {
+    const char *name;
+    // Find @path and set @inode's size and fs_data; 0 or -1
+    int (*lookup)(const char *path, struct vfs_inode *inode);
+    // Read up to @size bytes at @offset; short only at the end of the file
+    int (*read)(struct vfs_inode *inode, uint32_t offset, void *buffer, uint32_t size);
+} vfs_fs_ops_t;
+
+// One per file, shared by every descriptor open on it. Inodes stay cached
+// after the last close, with their pages, until the slot is needed.
+typedef struct vfs_inode {
+    uint32_t ino;                   // Page cache key, 0 = free slot
+    uint32_t size;                  // Bytes
+    uint32_t refs;                  // Open descriptors
+    uint32_t last_used;             // LRU clock for reusing the slot
+    char name[VFS_NAME_MAX];        // Path it was opened by, "" if too long
+    uint64_t fs_data[VFS_FS_DATA / sizeof(uint64_t)];
+} vfs_inode_t;
+
+typedef struct {
+    uint32_t ino;
+    uint32_t size;
+} vfs_stat_t;
+
+// Counters since vfs_mount
+typedef struct {
+    uint32_t page_hits;
+    uint32_t page_misses;           // Each one a read from the filesystem
+    uint32_t page_evictions;
+    uint32_t pages_cached;
+    uint32_t inode_hits;            // Opens that skipped the directory lookup
+    uint32_t inode_lookups;
+} vfs_stats_t;
+
+// Provided by the kernel; held across filesystem reads, so not a spinlock
+extern void vfs_lock(void);
+extern void vfs_unlock(void);
+extern void* kmalloc(size_t size);
+
+int vfs_mount(const vfs_fs_ops_t *ops);
+int vfs_open(const char *path);
+int vfs_read(int fd, void *buffer, uint32_t size);
+int vfs_seek(int fd, uint32_t offset);
+int vfs_close(int fd);
+int vfs_fstat(int fd, vfs_stat_t *st);
+void vfs_stats(vfs_stats_t *stats);
+
+#endif // VFS_H
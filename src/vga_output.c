@@ -1,35 +1,18 @@
 // vga_output.c - Simple VGA text mode output
 #include <stdint.h>
 #include <stdarg.h>
-
-// VGA text mode buffer
-#define VGA_WIDTH  80
-#define VGA_HEIGHT 25
-#define VGA_MEMORY 0xB8000
-
-// VGA color codes
-#define VGA_COLOR_BLACK         0
-#define VGA_COLOR_BLUE          1
-#define VGA_COLOR_GREEN         2
-#define VGA_COLOR_CYAN          3
-#define VGA_COLOR_RED           4
-#define VGA_COLOR_MAGENTA       5
-#define VGA_COLOR_BROWN         6
-#define VGA_COLOR_LIGHT_GREY    7
-#define VGA_COLOR_DARK_GREY     8
-#define VGA_COLOR_LIGHT_BLUE    9
-#define VGA_COLOR_LIGHT_GREEN   10
-#define VGA_COLOR_LIGHT_CYAN    11
-#define VGA_COLOR_LIGHT_RED     12
-#define VGA_COLOR_LIGHT_MAGENTA 13
-#define VGA_COLOR_YELLOW        14
-#define VGA_COLOR_WHITE         15
+#include "prof.h"
+#include "serial.h"
+#include "spinlock.h"
+#include "vga_output.h"
 
 // Global state
 static uint16_t* vga_buffer = (uint16_t*)VGA_MEMORY;
 static int cursor_x = 0;
 static int cursor_y = 0;
 static uint8_t current_color = (VGA_COLOR_LIGHT_GREY << 4) | VGA_COLOR_BLACK;
+// Protects the cursor and the screen contents
+static spinlock_t console_lock = SPINLOCK_INIT;
 
 // Helper: Create VGA entry
 static inline uint16_t vga_entry(char c, uint8_t color) {
@@ -55,6 +38,7 @@ static void vga_scroll(void) {
 
 // Clear the screen
 void vga_clear(void) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
     for (int y = 0; y < VGA_HEIGHT; y++) {
         for (int x = 0; x < VGA_WIDTH; x++) {
             vga_buffer[y * VGA_WIDTH + x] = vga_entry(' ', current_color);
@@ -62,6 +46,7 @@ void vga_clear(void) {
     }
     cursor_x = 0;
     cursor_y = 0;
+    spin_unlock_irqrestore(&console_lock, flags);
 }
 
 // Set text color
@@ -76,6 +61,12 @@ void vga_putchar_at(char c, uint8_t color, int x, int y) {
 
 // Put a single character (with cursor advancement)
 void kputchar(char c) {
+    PROF_SCOPE(kputchar);
+    // The cursor is shared by every thread and CPU
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+
+    serial_putchar(c);
+
     // Handle special characters
     if (c == '\n') {
         cursor_x = 0;
@@ -105,6 +96,8 @@ void kputchar(char c) {
     if (cursor_y >= VGA_HEIGHT) {
         vga_scroll();
     }
+
+    spin_unlock_irqrestore(&console_lock, flags);
 }
 
 // Print a string
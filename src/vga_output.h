@@ -0,0 +1,41 @@
+// vga_output.h - VGA text mode console
+#include <stdint.h>
+#ifndef VGA_OUTPUT_H
+#define VGA_OUTPUT_H
+
+// VGA text mode buffer
+#define VGA_WIDTH  80
+#define VGA_HEIGHT 25
+#define VGA_MEMORY 0xB8000
+
+// VGA color codes
+#define VGA_COLOR_BLACK         0
+#define VGA_COLOR_BLUE          1
+#define VGA_COLOR_GREEN         2
+#define VGA_COLOR_CYAN          3
+#define VGA_COLOR_RED           4
+#define VGA_COLOR_MAGENTA       5
+#define VGA_COLOR_BROWN         6
+#define VGA_COLOR_LIGHT_GREY    7
+#define VGA_COLOR_DARK_GREY     8
+#define VGA_COLOR_LIGHT_BLUE    9
+#define VGA_COLOR_LIGHT_GREEN   10
+#define VGA_COLOR_LIGHT_CYAN    11
+#define VGA_COLOR_LIGHT_RED     12
+#define VGA_COLOR_LIGHT_MAGENTA 13
+#define VGA_COLOR_YELLOW        14
+#define VGA_COLOR_WHITE         15
+
+void vga_init(void);
+void vga_clear(void);
+void vga_set_color(uint8_t fg, uint8_t bg);
+void kputchar(char c);
+void kputs(const char* str);
+void print_string(const char* str);
+void print_dec(uint32_t num);
+void print_int(int32_t num);
+void print_hex(uint32_t num);
+void print_hex8(uint8_t num);
+void kprintf(const char* fmt, ...);
+
+#endif // VGA_OUTPUT_H
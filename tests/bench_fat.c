@@ -0,0 +1,175 @@
+// bench_fat.c - Per-operation cost of src/fat.c against a disk image
+//
+// usage: bench_fat <image> [label]
+//
+// Prints one line per measurement:
+//
+//   FATBENCH,<label>,<op>,<param>,<ops>,<cycles_per_op>,<sectors_per_op>
+//
+// Cycles come from the TSC (nanoseconds on hosts without one). Disk cost
+// is reported separately as sectors per op, since the mmap'ed image makes
+// disk_read nearly free here compared to ATA PIO.
+#include <stdio.h>
+#include <stdlib.h>
+#include "host.h"
+#include "../src/fat.c"
+
+#define BENCH_REPEAT    200
+#define BENCH_DIR_FILES 128         // F000.DAT .. F127.DAT, built into the images by "make bench"
+
+static const char *label;
+
+static void report(const char *op, uint32_t param, uint64_t ops, uint64_t cycles, uint64_t sectors) {
+    printf("FATBENCH,%s,%s,%u,%llu,%llu,%llu\n", label, op, param,
+           (unsigned long long)ops,
+           (unsigned long long)(ops ? cycles / ops : 0),
+           (unsigned long long)(ops ? sectors / ops : 0));
+}
+
+static void bench_init(void) {
+    uint64_t cycles = 0;
+    host_disk_sectors = 0;
+
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        free(g_fat_state.fat_table);
+        uint64_t start = host_cycles();
+        fatInit();
+        cycles += host_cycles() - start;
+    }
+    report("fat_init", 0, BENCH_REPEAT, cycles, host_disk_sectors);
+}
+
+static void bench_open(void) {
+    static const uint32_t slots[] = { 0, BENCH_DIR_FILES / 2, BENCH_DIR_FILES - 1, BENCH_DIR_FILES };
+    char name[16];
+
+    for (size_t i = 0; i < sizeof(slots) / sizeof(slots[0]); i++) {
+        snprintf(name, sizeof(name), "F%03u.DAT", slots[i]);
+
+        FAT_FileHandle h;
+        uint64_t cycles = 0;
+        host_disk_sectors = 0;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            uint64_t start = host_cycles();
+            fatOpen(name, &h);
+            cycles += host_cycles() - start;
+        }
+        report(slots[i] < BENCH_DIR_FILES ? "fat_open" : "fat_open_miss", slots[i],
+               BENCH_REPEAT, cycles, host_disk_sectors);
+    }
+}
+
+// The chain walker before it was specialized per FAT type, as a baseline.
+// It needs the whole FAT in memory, which FAT32 no longer has.
+static uint32_t next_cluster_switch(uint32_t cluster) {
+    uint32_t next;
+    switch (g_fat_state.fat_type) {
+    case FAT_TYPE_12:
+        next = *(uint16_t*)&g_fat_state.fat_table[cluster + cluster / 2];
+        next = (cluster & 1) ? next >> 4 : next & 0x0FFF;
+        return next >= 0x0FF8 ? 0xFFFFFFFF : next;
+    case FAT_TYPE_16:
+        next = *(uint16_t*)&g_fat_state.fat_table[cluster * 2];
+        return next >= 0xFFF8 ? 0xFFFFFFFF : next;
+    default:
+        next = *(uint32_t*)&g_fat_state.fat_table[cluster * 4] & 0x0FFFFFFF;
+        return next >= 0x0FFFFFF8 ? 0xFFFFFFFF : next;
+    }
+}
+
+// Cost per link of walking BIG.DAT's chain: one link per call through
+// the old switch and the per-type get_next_cluster, then @batch links
+// per fatChain call
+static void bench_chain(void) {
+    FAT_FileHandle h;
+    if (fatOpen("BIG.DAT", &h) != 0) {
+        return;
+    }
+
+    uint64_t links = 0;
+    uint64_t start = host_cycles();
+    if (g_fat_state.fat_table) {
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (uint32_t c = h.first_cluster; c != 0xFFFFFFFF; c = next_cluster_switch(c)) {
+                links++;
+            }
+        }
+        report("next_cluster_switch", 0, links, host_cycles() - start, 0);
+    }
+
+    links = 0;
+    start = host_cycles();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        for (uint32_t c = h.first_cluster; c != 0xFFFFFFFF; c = get_next_cluster(c)) {
+            links++;
+        }
+    }
+    report("next_cluster", 0, links, host_cycles() - start, 0);
+
+    static const uint32_t batches[] = { 8, 32, 256 };
+    uint32_t chain[256];
+    for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+        links = 0;
+        start = host_cycles();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            uint32_t c = h.first_cluster;
+            int n;
+            links++;
+            while ((n = fatChain(c, chain, batches[i])) == (int)batches[i]) {
+                links += n;
+                c = chain[n - 1];
+            }
+            links += n;
+        }
+        report("chain_batch", batches[i], links, host_cycles() - start, 0);
+    }
+}
+
+static void bench_read(void) {
+    static const uint32_t chunks[] = { 256, 512, 4096, 65536 };
+    uint8_t *buf = malloc(65536);
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        uint64_t ops = 0;
+        uint64_t cycles = 0;
+        host_disk_sectors = 0;
+
+        for (int r = 0; r < BENCH_REPEAT / 10; r++) {
+            FAT_FileHandle h;
+            if (fatOpen("BIG.DAT", &h) != 0) {
+                free(buf);
+                return;
+            }
+
+            uint64_t start = host_cycles();
+            while (fatRead(&h, buf, chunks[i]) > 0) {
+                ops++;
+            }
+            cycles += host_cycles() - start;
+        }
+        report("fat_read", chunks[i], ops, cycles, host_disk_sectors);
+    }
+
+    free(buf);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <image> [label]\n", argv[0]);
+        return 2;
+    }
+    label = argc > 2 ? argv[2] : argv[1];
+
+    if (host_disk_open(argv[1]) != 0 || fatInit() != 0) {
+        fprintf(stderr, "%s: cannot mount\n", argv[1]);
+        return 1;
+    }
+
+    bench_init();
+    bench_open();
+    bench_chain();
+    bench_read();
+
+    host_disk_close();
+    return 0;
+}
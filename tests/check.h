@@ -0,0 +1,46 @@
+// check.h - CHECK() and reference-file loading shared by the host tests
+//
+// Each test is one translation unit, so the counters live here as statics.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef CHECK_H
+#define CHECK_H
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond) do { \
+    checks++; \
+    if (!(cond)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+// Directory holding the files copied onto the image, set by main()
+static const char *data_dir;
+
+// Loads data_dir/name; returns NULL if it does not exist
+static uint8_t *load_reference(const char *name, long *size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", data_dir, name);
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = malloc(*size + 1);
+    if (fread(data, 1, *size, f) != (size_t)*size) {
+        *size = -1;
+    }
+    fclose(f);
+    return data;
+}
+
+#endif // CHECK_H
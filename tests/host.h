@@ -0,0 +1,33 @@
+// host.h - Host-side stand-ins for the kernel services fat.c needs
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#ifndef HOST_H
+#define HOST_H
+
+// Maps a disk image so that disk_read() serves sectors out of it
+int host_disk_open(const char *path);
+void host_disk_close(void);
+
+// When set, disk_map() hands out pointers into the image like a RAM disk;
+// otherwise it returns NULL like the ATA drive
+extern int host_disk_mapped;
+
+// Number of disk_read() calls and sectors served since the last reset
+extern uint64_t host_disk_calls;
+extern uint64_t host_disk_sectors;
+
+// Cycle counter for microbenchmarks; nanoseconds where there is no TSC
+static inline uint64_t host_cycles(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#endif // HOST_H
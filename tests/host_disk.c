@@ -0,0 +1,88 @@
+// host_disk.c - disk_read/kmalloc/kfree for running fat.c as a host program
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "host.h"
+
+static uint8_t *image = 0;
+static size_t image_size = 0;
+
+int host_disk_mapped = 0;
+uint64_t host_disk_calls = 0;
+uint64_t host_disk_sectors = 0;
+
+int host_disk_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    image = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        image = 0;
+        return -1;
+    }
+
+    image_size = st.st_size;
+    return 0;
+}
+
+void host_disk_close(void) {
+    if (image) {
+        munmap(image, image_size);
+        image = 0;
+        image_size = 0;
+    }
+}
+
+// Same contract as the ATA PIO disk_read in kernel_main.c
+int disk_read(uint32_t sector, uint32_t count, void *buffer) {
+    if (count == 0 || count > 256) return -1;
+    if (((uint64_t)sector + count) * 512 > image_size) return -1;
+
+    memcpy(buffer, image + (size_t)sector * 512, (size_t)count * 512);
+    host_disk_calls++;
+    host_disk_sectors += count;
+    return 0;
+}
+
+// Same contract as disk_map in kernel_main.c
+const void *disk_map(uint32_t sector, uint32_t count) {
+    if (!host_disk_mapped || count == 0) return 0;
+    if (((uint64_t)sector + count) * 512 > image_size) return 0;
+
+    return image + (size_t)sector * 512;
+}
+
+void *kmalloc(size_t size) {
+    return malloc(size ? size : 1);
+}
+
+void kfree(void *ptr) {
+    free(ptr);
+}
+
+// The host harness is single-threaded
+void fat_lock(void) {
+}
+
+void fat_unlock(void) {
+}
+
+void vfs_lock(void) {
+}
+
+void vfs_unlock(void) {
+}
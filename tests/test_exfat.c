@@ -0,0 +1,238 @@
+// test_exfat.c - Unit tests for src/exfat.c against an exFAT disk image
+//
+// usage: test_exfat <image> <data dir>
+//
+// The image is made by tools/mkexfat.py from the FAT test data plus a few
+// extra files (see the Makefile): BIG.DAT is fragmented with a FAT chain,
+// CONTIG.DAT is the same data as one NoFatChain extent, TAIL.DAT is
+// SMALL.DAT allocated to TAIL_BYTES, and a long mixed-case name.
+#include <stdio.h>
+#include <stdlib.h>
+#include "host.h"
+#include "check.h"
+#include "../src/exfat.c"
+
+// Allocated size of TAIL.DAT, from the Makefile
+#define TAIL_BYTES 10000
+#define LONG_NAME "Long file name.txt"
+
+// The reference contents of a file on the image, as the driver should
+// return them; TAIL.DAT is SMALL.DAT followed by zeros
+static uint8_t *expected_contents(const char *name, long *size) {
+    if (strcmp(name, "CONTIG.DAT") == 0) {
+        return load_reference("BIG.DAT", size);
+    }
+    if (strcmp(name, LONG_NAME) == 0) {
+        return load_reference("README.TXT", size);
+    }
+    if (strcmp(name, "TAIL.DAT") == 0) {
+        long small;
+        uint8_t *data = load_reference("SMALL.DAT", &small);
+        if (data) {
+            data = realloc(data, TAIL_BYTES);
+            memset(data + small, 0, TAIL_BYTES - small);
+            *size = TAIL_BYTES;
+        }
+        return data;
+    }
+    return load_reference(name, size);
+}
+
+static void test_mount(void) {
+    const EXFAT_BootSector *bs = &g_exfat_state.boot_sector;
+    CHECK(memcmp(bs->fs_name, "EXFAT   ", 8) == 0);
+    CHECK(g_exfat_state.cluster_size == 512u << (bs->bytes_per_sector_shift - 9 + bs->sectors_per_cluster_shift));
+    CHECK(g_exfat_state.bitmap_cluster >= 2);
+    // The up-case table maps ASCII and Latin-1 letters
+    CHECK(upcase('a') == 'A' && upcase('z') == 'Z' && upcase('A') == 'A');
+    CHECK(upcase('0') == '0' && upcase(0xE9) == 0xC9);
+    CHECK(upcase(0xF7) == 0xF7);
+
+    // Remounting gives the same state
+    uint32_t heap = g_exfat_state.heap_start_sector;
+    CHECK(exfatInit() == 0);
+    CHECK(g_exfat_state.heap_start_sector == heap);
+
+    // Rotate right, then add: the checksum of the boot region and up-case table
+    CHECK(boot_checksum(0, (const uint8_t*)"\x01\x02", 2, false) == 0x80000002);
+}
+
+// Free space must match a count of the bitmap done bit by bit
+static void test_volume_info(void) {
+    EXFAT_VolumeInfo info;
+    CHECK(exfatVolumeInfo(&info) == 0);
+    CHECK(info.cluster_size == g_exfat_state.cluster_size);
+    CHECK(info.total_clusters == g_exfat_state.cluster_count);
+    CHECK(info.free_clusters < info.total_clusters);
+
+    EXFAT_FileHandle bitmap;
+    bitmap_open(&bitmap);
+    uint32_t free_clusters = 0;
+    uint8_t byte = 0;
+    for (uint32_t c = 0; c < info.total_clusters; c++) {
+        if ((c & 7) == 0) {
+            CHECK(exfat_read_locked(&bitmap, &byte, 1) == 1);
+        }
+        free_clusters += !(byte & (1 << (c & 7)));
+    }
+    CHECK(info.free_clusters == free_clusters);
+}
+
+static void test_open(void) {
+    EXFAT_FileHandle h;
+
+    CHECK(exfatOpen("README.TXT", &h) == 0);
+    CHECK(h.is_open && h.position == 0);
+    // Names are compared through the up-case table
+    CHECK(exfatOpen("readme.txt", &h) == 0);
+    CHECK(exfatOpen("LONG FILE NAME.TXT", &h) == 0);
+    CHECK(exfatOpen(LONG_NAME, &h) == 0);
+    CHECK(exfatOpen("Long file name.tx", &h) == -1);
+    CHECK(exfatOpen("NOSUCH.TXT", &h) == -1);
+    CHECK(exfatOpen("", &h) == -1);
+    CHECK(exfatOpen("F127.DAT", &h) == 0 && h.file_size == 9);
+    CHECK(exfatOpen(NULL, &h) == -1);
+    CHECK(exfatOpen("README.TXT", NULL) == -1);
+
+    // The two copies of BIG.DAT differ only in how they are laid out
+    CHECK(exfatOpen("BIG.DAT", &h) == 0 && !h.contiguous);
+    CHECK(exfatOpen("CONTIG.DAT", &h) == 0 && h.contiguous);
+    CHECK(exfatOpen("EMPTY.DAT", &h) == 0 && h.file_size == 0 && h.current_cluster == EXFAT_CHAIN_END);
+    CHECK(exfatOpen("TAIL.DAT", &h) == 0 && h.file_size == TAIL_BYTES && h.valid_size < h.file_size);
+}
+
+// Whole-file read in @chunk sized pieces, compared byte for byte
+static void test_read_file(const char *name, uint32_t chunk) {
+    long size;
+    uint8_t *ref = expected_contents(name, &size);
+    CHECK(ref != NULL && size >= 0);
+    if (!ref) {
+        return;
+    }
+
+    EXFAT_FileHandle h;
+    CHECK(exfatOpen(name, &h) == 0);
+    CHECK(h.file_size == (uint32_t)size);
+
+    uint8_t *buf = malloc(size + chunk);
+    memset(buf, 0xAA, size + chunk);
+    uint32_t total = 0;
+    int n;
+    while ((n = exfatRead(&h, buf + total, chunk)) > 0) {
+        total += n;
+    }
+    CHECK(n == 0);
+    CHECK(total == (uint32_t)size);
+    CHECK(memcmp(buf, ref, size) == 0);
+    // Reads at EOF keep returning 0
+    CHECK(exfatRead(&h, buf, chunk) == 0);
+
+    free(buf);
+    free(ref);
+}
+
+static void test_seek(const char *name) {
+    long size;
+    uint8_t *ref = expected_contents(name, &size);
+    if (!ref || size == 0) {
+        free(ref);
+        return;
+    }
+
+    EXFAT_FileHandle h;
+    CHECK(exfatOpen(name, &h) == 0);
+
+    uint8_t buf[9000];
+    srand(1);
+    for (int i = 0; i < 500; i++) {
+        uint32_t off = rand() % size;
+        uint32_t len = rand() % sizeof(buf);
+        uint32_t expect = len < size - off ? len : size - off;
+
+        CHECK(exfatSeek(&h, off) == 0);
+        int n = exfatRead(&h, buf, len);
+        CHECK(n == (int)expect);
+        CHECK(n < 0 || memcmp(buf, ref + off, n) == 0);
+    }
+
+    // Seeking past the end clamps to the file size
+    CHECK(exfatSeek(&h, size + 100) == 0);
+    CHECK(h.position == (uint32_t)size);
+    CHECK(exfatRead(&h, buf, sizeof(buf)) == 0);
+
+    free(ref);
+}
+
+// A NoFatChain file is read without looking at the FAT, in requests as
+// large as disk_read takes; the fragmented copy needs one per cluster
+static void test_extent_reads(void) {
+    long size;
+    uint8_t *ref = load_reference("BIG.DAT", &size);
+    CHECK(ref != NULL);
+    if (!ref) {
+        return;
+    }
+    uint8_t *buf = malloc(size);
+
+    EXFAT_FileHandle h;
+    CHECK(exfatOpen("CONTIG.DAT", &h) == 0);
+    g_exfat_state.fat_window_first = EXFAT_CHAIN_END;
+    g_exfat_state.fat_window_count = 0;
+    host_disk_calls = 0;
+    CHECK(exfatRead(&h, buf, size) == size);
+    CHECK(memcmp(buf, ref, size) == 0);
+    CHECK(g_exfat_state.fat_window_count == 0);
+    uint32_t max_read = EXFAT_MAX_READ_SECTORS * 512;
+    // Whole chunks, plus the partial cluster at the end
+    CHECK(host_disk_calls <= (uint64_t)(size + max_read - 1) / max_read + 1);
+
+    CHECK(exfatOpen("BIG.DAT", &h) == 0);
+    host_disk_calls = 0;
+    CHECK(exfatRead(&h, buf, size) == size);
+    CHECK(memcmp(buf, ref, size) == 0);
+    CHECK(host_disk_calls >= (uint64_t)size / g_exfat_state.cluster_size);
+
+    free(buf);
+    free(ref);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <image> <data dir>\n", argv[0]);
+        return 2;
+    }
+    data_dir = argv[2];
+
+    if (host_disk_open(argv[1]) != 0) {
+        return 2;
+    }
+
+    CHECK(exfatInit() == 0);
+    if (!g_exfat_state.initialized) {
+        fprintf(stderr, "%s: exfatInit failed\n", argv[1]);
+        return 1;
+    }
+
+    test_mount();
+    test_volume_info();
+    test_extent_reads();
+
+    static const char *files[] = {
+        "README.TXT", "SMALL.DAT", "EMPTY.DAT", "BIG.DAT", "CONTIG.DAT", "TAIL.DAT", LONG_NAME
+    };
+    static const uint32_t chunks[] = { 1, 256, 512, 1000, 4096, 65536, 1 << 20 };
+    // Once through disk_read like the ATA drive, once in place like a RAM disk
+    for (host_disk_mapped = 0; host_disk_mapped < 2; host_disk_mapped++) {
+        test_open();
+        for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+            for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+                test_read_file(files[f], chunks[c]);
+            }
+            test_seek(files[f]);
+        }
+    }
+
+    host_disk_close();
+    printf("%s: %d checks, %d failures\n", argv[1], checks, failures);
+    return failures ? 1 : 0;
+}
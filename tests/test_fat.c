@@ -0,0 +1,566 @@
+// test_fat.c - Unit tests for src/fat.c against a FAT disk image
+//
+// usage: test_fat <image> <12|16|32> <data dir>
+//
+// The data directory holds the files that were mcopy'd onto the image;
+// every read is checked against them. fat.c is included directly so the
+// static helpers (determine_fat_type, get_next_cluster) can be tested.
+#include <stdio.h>
+#include <stdlib.h>
+#include "host.h"
+#include "check.h"
+#include "../src/fat.c"
+#include "../src/crc32c.h"
+#include "../src/lz4.h"
+
+static uint32_t cluster_bytes(void) {
+    return g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+}
+
+static void test_fat_type(int bits) {
+    FAT_Type expected = bits == 12 ? FAT_TYPE_12 : bits == 16 ? FAT_TYPE_16 : FAT_TYPE_32;
+    CHECK(determine_fat_type(&g_fat_state.boot_sector) == expected);
+    CHECK(g_fat_state.fat_type == expected);
+}
+
+// Free space must be consistent with the FAT itself
+static void test_volume_info(void) {
+    FAT_VolumeInfo info;
+    CHECK(fatVolumeInfo(&info) == 0);
+    CHECK(info.type == g_fat_state.fat_type);
+    CHECK(info.cluster_size == cluster_bytes());
+    CHECK(info.total_clusters > 0);
+
+    uint32_t free_clusters = 0;
+    for (uint32_t c = 2; c < info.total_clusters + 2; c++) {
+        free_clusters += get_next_cluster(c) == 0;
+    }
+    if (info.type == FAT_TYPE_32) {
+        // FSInfo is only a hint, but the tools that made the image keep it
+        CHECK(info.free_clusters == FAT_UNKNOWN || info.free_clusters == free_clusters);
+        CHECK(g_fat_state.fat_table == NULL);
+    } else {
+        CHECK(info.free_clusters == free_clusters);
+    }
+    CHECK(info.next_free == FAT_UNKNOWN || get_next_cluster(info.next_free) == 0 || info.type == FAT_TYPE_32);
+}
+
+static void test_open(void) {
+    FAT_FileHandle h;
+
+    CHECK(fatOpen("README.TXT", &h) == 0);
+    CHECK(h.is_open && h.position == 0);
+    // Lookup is case-insensitive
+    CHECK(fatOpen("readme.txt", &h) == 0);
+    CHECK(fatOpen("NOSUCH.TXT", &h) == -1);
+    // Last file copied, at the end of the root directory
+    CHECK(fatOpen("F127.DAT", &h) == 0 && h.file_size == 9);
+    CHECK(fatOpen(NULL, &h) == -1);
+    CHECK(fatOpen("README.TXT", NULL) == -1);
+}
+
+// The chain from the directory entry must cover exactly the file size
+static void test_cluster_chain(const char *name, long size) {
+    FAT_FileHandle h;
+    CHECK(fatOpen(name, &h) == 0);
+
+    uint32_t expected = (size + cluster_bytes() - 1) / cluster_bytes();
+    uint32_t links = 0;
+    // Empty files have no chain at all (first cluster 0)
+    for (uint32_t c = h.first_cluster; c != 0 && c != 0xFFFFFFFF && links <= expected; c = get_next_cluster(c)) {
+        CHECK(c >= 2);
+        links++;
+    }
+    CHECK(links == expected);
+    if (expected == 0) {
+        CHECK(fatChain(h.first_cluster, &links, 1) == -1);
+        return;
+    }
+
+    // The batch decoder must agree with get_next_cluster, whatever the
+    // batch size
+    uint32_t *chain = malloc(expected * sizeof(uint32_t));
+    CHECK(fatChain(h.first_cluster, chain, expected) == (int)expected - 1);
+    uint32_t c = h.first_cluster;
+    for (uint32_t i = 0; i + 1 < expected; i++) {
+        c = get_next_cluster(c);
+        CHECK(chain[i] == c);
+    }
+    if (expected > 2) {
+        CHECK(fatChain(h.first_cluster, chain, 2) == 2);
+        CHECK(fatChain(chain[1], chain, expected) == (int)expected - 3);
+    }
+    free(chain);
+}
+
+// Whole-file read in @chunk sized pieces, compared byte for byte
+static void test_read_file(const char *name, uint32_t chunk) {
+    long size;
+    uint8_t *ref = load_reference(name, &size);
+    CHECK(ref != NULL && size >= 0);
+    if (!ref) {
+        return;
+    }
+
+    FAT_FileHandle h;
+    CHECK(fatOpen(name, &h) == 0);
+    CHECK(h.file_size == (uint32_t)size);
+
+    uint8_t *buf = malloc(size + chunk);
+    uint32_t total = 0;
+    int n;
+    while ((n = fatRead(&h, buf + total, chunk)) > 0) {
+        total += n;
+    }
+    CHECK(n == 0);
+    CHECK(total == (uint32_t)size);
+    CHECK(memcmp(buf, ref, size) == 0);
+    // Reads at EOF keep returning 0
+    CHECK(fatRead(&h, buf, chunk) == 0);
+
+    free(buf);
+    free(ref);
+}
+
+static void test_seek(const char *name) {
+    long size;
+    uint8_t *ref = load_reference(name, &size);
+    if (!ref || size == 0) {
+        free(ref);
+        return;
+    }
+
+    FAT_FileHandle h;
+    CHECK(fatOpen(name, &h) == 0);
+
+    uint8_t buf[3000];
+    srand(1);
+    for (int i = 0; i < 500; i++) {
+        uint32_t off = rand() % size;
+        uint32_t len = rand() % sizeof(buf);
+        uint32_t expect = len < size - off ? len : size - off;
+
+        CHECK(fatSeek(&h, off) == 0);
+        int n = fatRead(&h, buf, len);
+        CHECK(n == (int)expect);
+        CHECK(n < 0 || memcmp(buf, ref + off, n) == 0);
+    }
+
+    // Seeking past the end clamps to the file size
+    CHECK(fatSeek(&h, size + 100) == 0);
+    CHECK(h.position == (uint32_t)size);
+    CHECK(fatRead(&h, buf, sizeof(buf)) == 0);
+
+    free(ref);
+}
+
+// Reading the runs fatMap returns must give back the whole file
+static void test_map(const char *name) {
+    long size;
+    uint8_t *ref = load_reference(name, &size);
+    if (!ref) {
+        return;
+    }
+
+    FAT_FileHandle h;
+    CHECK(fatOpen(name, &h) == 0);
+
+    uint8_t *buf = malloc(cluster_bytes());
+    uint32_t sector, count, bytes, total = 0;
+    int ret;
+    while ((ret = fatMap(&h, &sector, &count, &bytes)) == 1) {
+        CHECK(bytes > 0 && bytes <= cluster_bytes());
+        CHECK(count == (bytes + 511) / 512);
+        CHECK(disk_read(sector, count, buf) == 0);
+        CHECK(total + bytes <= (uint32_t)size && memcmp(buf, ref + total, bytes) == 0);
+        total += bytes;
+    }
+    CHECK(ret == 0);
+    CHECK(total == (uint32_t)size);
+
+    // Positions inside a sector cannot be mapped
+    if (size > 1) {
+        CHECK(fatSeek(&h, 1) == 0);
+        CHECK(fatMap(&h, &sector, &count, &bytes) == -1);
+    }
+
+    free(buf);
+    free(ref);
+}
+
+// A batch across many files, with ranges that start and end mid-sector,
+// takes fewer disk reads than it has requests and returns the same data
+// as reading each file on its own
+static void test_batch(void) {
+    static const char *names[] = { "BIG.DAT", "README.TXT", "SMALL.DAT", "EMPTY.DAT", "NOSUCH.DAT" };
+    enum { NAMED = sizeof(names) / sizeof(names[0]), COUNT = NAMED + 128 };
+    FAT_ReadRequest reqs[COUNT];
+    uint8_t *refs[COUNT];
+    long sizes[COUNT];
+    char small_names[128][16];
+
+    for (int i = 0; i < COUNT; i++) {
+        const char *name = names[i < NAMED ? i : 0];
+        if (i >= NAMED) {
+            snprintf(small_names[i - NAMED], sizeof(small_names[0]), "F%03d.DAT", i - NAMED);
+            name = small_names[i - NAMED];
+        }
+        refs[i] = load_reference(name, &sizes[i]);
+        reqs[i].filename = name;
+        reqs[i].offset = 0;
+        reqs[i].length = 1 << 20;
+        reqs[i].buffer = malloc(1 << 20);
+    }
+    // Part of BIG.DAT from the middle of a sector, past the first clusters
+    reqs[0].offset = sizes[0] / 3 + 7;
+    reqs[0].length = sizes[0] / 3;
+
+    host_disk_calls = 0;
+    int reads = fatReadBatch(reqs, COUNT);
+    // Opening the files reads directories as well
+    CHECK(reads >= 0 && (uint64_t)reads <= host_disk_calls);
+    CHECK(host_disk_mapped ? reads == 0 : reads < COUNT / 4);
+
+    for (int i = 0; i < COUNT; i++) {
+        if (!refs[i]) {
+            CHECK(reqs[i].result == -1);
+            continue;
+        }
+        long expect = i == 0 ? sizes[0] / 3 : sizes[i];
+        CHECK(reqs[i].result == expect);
+        CHECK(memcmp(reqs[i].buffer, refs[i] + reqs[i].offset, expect) == 0);
+    }
+
+    // Offsets past the end read nothing; an empty batch reads nothing
+    reqs[1].offset = sizes[1] + 10;
+    CHECK(fatReadBatch(reqs + 1, 1) == 0 && reqs[1].result == 0);
+    CHECK(fatReadBatch(reqs, 0) == 0);
+    CHECK(fatReadBatch(NULL, 1) == -1);
+
+    for (int i = 0; i < COUNT; i++) {
+        free(reqs[i].buffer);
+        free(refs[i]);
+    }
+}
+
+static void test_crc32c_kernel(void) {
+    static const char check[] = "123456789";
+    CHECK(crc32c(0, check, 9) == 0xE3069283);
+    CHECK(crc32c(0, check, 0) == 0);
+
+    // Any split and any alignment give the same result
+    uint8_t buf[1000];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)(i * 7 + 3);
+    }
+    uint32_t whole = crc32c(0, buf + 1, sizeof(buf) - 1);
+    for (size_t split = 0; split < 40; split++) {
+        CHECK(crc32c(crc32c(0, buf + 1, split), buf + 1 + split, sizeof(buf) - 1 - split) == whole);
+    }
+}
+
+static void test_crc32c(void) {
+    crc32c_init(0);
+    test_crc32c_kernel();
+#if defined(__i386__) || defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_init(1);
+        test_crc32c_kernel();
+        crc32c_init(0);
+    }
+#endif
+}
+
+// Reads @h to the end in @chunk sized pieces; returns the last fatRead result
+static int read_to_end(FAT_FileHandle *h, uint32_t chunk) {
+    uint8_t *buf = malloc(chunk);
+    int n;
+    while ((n = fatRead(h, buf, chunk)) > 0) {
+    }
+    free(buf);
+    return n;
+}
+
+// Files read through extents split at every other cluster: the reads
+// and seeks must cross extent boundaries exactly as they cross clusters
+static void test_split_extents(void) {
+    long size;
+    uint8_t *ref = load_reference("BIG.DAT", &size);
+    FAT_FileHandle h;
+    CHECK(ref != NULL && fatOpen("BIG.DAT", &h) == 0);
+    if (!ref) {
+        return;
+    }
+
+    uint32_t clusters = (size + cluster_bytes() - 1) / cluster_bytes();
+    FAT_Extent *ext = calloc(clusters, sizeof(FAT_Extent));
+    uint32_t n = 0;
+    for (uint32_t c = h.first_cluster, i = 0; i < clusters; i++, c = get_next_cluster(c)) {
+        if (i % 2 == 0) {
+            ext[n].cluster = c;
+            ext[n++].count = 0;
+        }
+        ext[n - 1].count++;
+    }
+    h.extents = ext;
+    h.extent_count = n;
+    h.verify = false;
+
+    uint8_t *buf = malloc(size);
+    CHECK(fatRead(&h, buf, size) == size && memcmp(buf, ref, size) == 0);
+    srand(2);
+    for (int i = 0; i < 200; i++) {
+        uint32_t off = rand() % size;
+        uint32_t len = rand() % (3 * cluster_bytes());
+        uint32_t expect = len < size - off ? len : size - off;
+        CHECK(fatSeek(&h, off) == 0);
+        CHECK(fatRead(&h, buf, len) == (int)expect && memcmp(buf, ref + off, expect) == 0);
+    }
+
+    free(buf);
+    free(ext);
+    free(ref);
+}
+
+// The image carries a BOOT.SNP from tools/mksnapshot. Once loaded, opens
+// need no disk I/O and the hot files read the same through their extents;
+// a snapshot that does not match the volume is refused.
+static void test_snapshot(void) {
+    CHECK(fatLoadSnapshot("NOSUCH.SNP") == -1);
+    CHECK(g_fat_state.snapshot == NULL);
+    CHECK(fatLoadSnapshot("BOOT.SNP") > 128);
+
+    FAT_FileHandle h;
+    host_disk_calls = 0;
+    CHECK(fatOpen("readme.txt", &h) == 0 && h.extent_count == 1);
+    CHECK(fatOpen("F127.DAT", &h) == 0 && h.file_size == 9 && h.extents == NULL);
+    CHECK(fatOpen("NOSUCH.TXT", &h) == -1);
+    CHECK(fatOpen("EMPTY.DAT", &h) == 0 && h.file_size == 0 && h.extents == NULL);
+    CHECK(host_disk_calls == 0);
+
+    // BIG.DAT is read to the end without a single FAT lookup
+    CHECK(fatOpen("BIG.DAT", &h) == 0 && h.extents != NULL && h.verify);
+    if (g_fat_state.fat_type == FAT_TYPE_32) {
+        g_fat_state.fat_window_count = 0;
+        g_fat_state.fat_window_first = FAT_UNKNOWN;
+        CHECK(read_to_end(&h, 4096) == 0);
+        CHECK(g_fat_state.fat_window_count == 0);
+    }
+
+    // Every field that ties it to the volume is checked
+    uint32_t size = sizeof(FAT_SnapshotHeader) + g_fat_state.snapshot_count * sizeof(FAT_SnapshotEntry) +
+                    g_fat_state.extent_count * sizeof(FAT_Extent);
+    uint8_t *data = malloc(size);
+    memcpy(data, (const uint8_t*)g_fat_state.snapshot - sizeof(FAT_SnapshotHeader), size);
+    FAT_SnapshotHeader *hdr = (FAT_SnapshotHeader*)data;
+    CHECK(snapshot_valid(data, size));
+    CHECK(!snapshot_valid(data, size - 1));
+    data[size - 1] ^= 1;
+    CHECK(!snapshot_valid(data, size));
+    data[size - 1] ^= 1;
+
+    static const size_t fields[] = {
+        offsetof(FAT_SnapshotHeader, version), offsetof(FAT_SnapshotHeader, volume_id),
+        offsetof(FAT_SnapshotHeader, total_clusters), offsetof(FAT_SnapshotHeader, root_dir_crc),
+        offsetof(FAT_SnapshotHeader, fat_sectors), offsetof(FAT_SnapshotHeader, fat_crc),
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        data[fields[i]] ^= 1;
+        CHECK(!snapshot_valid(data, size));
+        // Still refused with the CRC fixed up
+        uint32_t crc = hdr->crc;
+        hdr->crc = 0;
+        hdr->crc = crc32c(0, data, size);
+        CHECK(!snapshot_valid(data, size));
+        hdr->crc = crc;
+        data[fields[i]] ^= 1;
+    }
+    CHECK(snapshot_valid(data, size));
+    free(data);
+
+    // Remounting forgets it
+    CHECK(fatInit() == 0);
+    CHECK(g_fat_state.snapshot == NULL);
+    CHECK(fatLoadManifest("MANIFEST.CRC") >= 4);
+}
+
+static void test_manifest(void) {
+    // One line per file in the data directory, MANIFEST.CRC excluded
+    CHECK(fatLoadManifest("MANIFEST.CRC") >= 4);
+    CHECK(fatManifestCount() >= 4);
+    CHECK(fatLoadManifest("NOSUCH.CRC") == -1);
+
+    FAT_FileHandle h;
+    CHECK(fatOpen("BIG.DAT", &h) == 0);
+    CHECK(h.verify);
+    CHECK(read_to_end(&h, 1000) == 0);
+
+    // A wrong CRC fails the read that reaches the end, however it is split
+    static const uint32_t chunks[] = { 512, 4096, 1 << 20 };
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        CHECK(fatOpen("BIG.DAT", &h) == 0);
+        CHECK(fatVerify(&h, h.expected_crc ^ 1) == 0);
+        CHECK(read_to_end(&h, chunks[c]) == -1);
+    }
+
+    // Rewinding starts the CRC over; seeking elsewhere stops checking
+    CHECK(fatOpen("BIG.DAT", &h) == 0);
+    uint8_t buf[100];
+    CHECK(fatRead(&h, buf, sizeof(buf)) == sizeof(buf));
+    CHECK(fatSeek(&h, 0) == 0);
+    CHECK(h.verify && read_to_end(&h, 4096) == 0);
+    CHECK(fatOpen("BIG.DAT", &h) == 0);
+    CHECK(fatSeek(&h, 5000) == 0);
+    CHECK(!h.verify);
+    CHECK(fatVerify(&h, 0) == -1);
+
+    // ...until it rewinds to the start, also after a checked read to the end
+    CHECK(fatSeek(&h, 0) == 0);
+    CHECK(h.verify && read_to_end(&h, 4096) == 0);
+    CHECK(!h.verify && fatSeek(&h, 0) == 0 && h.verify);
+
+    // A file whose size differs from the manifest fails, even if empty
+    static const char *const sized[] = { "BIG.DAT", "EMPTY.DAT" };
+    for (size_t f = 0; f < sizeof(sized) / sizeof(sized[0]); f++) {
+        CHECK(fatOpen(sized[f], &h) == 0 && h.verify);
+        char key[11];
+        to_short_name(sized[f], key, key + 8);
+        FAT_ManifestEntry *me = NULL;
+        for (uint32_t m = 0; m < g_fat_state.manifest_count; m++) {
+            if (memcmp(g_fat_state.manifest[m].name, key, 11) == 0) {
+                me = &g_fat_state.manifest[m];
+            }
+        }
+        CHECK(me != NULL);
+        if (!me) {
+            continue;
+        }
+        me->size++;
+        CHECK(fatOpen(sized[f], &h) == 0);
+        CHECK(read_to_end(&h, 4096) == -1);
+        me->size--;
+        CHECK(fatOpen(sized[f], &h) == 0);
+        CHECK(read_to_end(&h, 4096) == 0);
+    }
+}
+
+// Size of ZERO.LZ4 before compression, from the Makefile
+#define ZERO_LZ4_BYTES 200000
+
+// lz4Read must give back @plain (or zeros if NULL) whatever the chunk size
+static void test_lz4_read(const char *name, const char *plain, bool compressed, uint32_t chunk) {
+    long size = ZERO_LZ4_BYTES;
+    uint8_t *ref = plain ? load_reference(plain, &size) : calloc(1, size);
+    CHECK(ref != NULL);
+    if (!ref) {
+        return;
+    }
+
+    LZ4_FileHandle h;
+    CHECK(lz4Open(name, &h) == 0);
+    CHECK(h.compressed == compressed);
+    CHECK(h.size == (uint32_t)size);
+
+    uint8_t *buf = malloc(size + chunk);
+    uint32_t total = 0;
+    int n;
+    while ((n = lz4Read(&h, buf + total, chunk)) > 0) {
+        total += n;
+    }
+    CHECK(n == 0);
+    CHECK(total == (uint32_t)size);
+    CHECK(memcmp(buf, ref, size) == 0);
+    CHECK(lz4Read(&h, buf, chunk) == 0);
+    lz4Close(&h);
+
+    free(buf);
+    free(ref);
+}
+
+static void test_lz4(void) {
+    static const uint32_t chunks[] = { 1, 1000, 65536, 200000 };
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        test_lz4_read("BIG.LZ4", "BIG.DAT", true, chunks[c]);
+        // There is no ZERO.DAT, so lz4Open opens ZERO.LZ4 instead
+        test_lz4_read("ZERO.DAT", NULL, true, chunks[c]);
+    }
+    // Plain files pass through
+    test_lz4_read("BIG.DAT", "BIG.DAT", false, 4096);
+
+    LZ4_FileHandle h;
+    CHECK(lz4Open("NOSUCH.DAT", &h) == -1);
+
+    // Corrupt blocks are rejected rather than overrunning anything
+    uint8_t out[64];
+    static const uint8_t literals[] = { 0x30, 'a', 'b', 'c' };
+    static const uint8_t repeat[] = { 0x1F, 'a', 0x01, 0x00, 0x05, 0x00 };
+    static const uint8_t far_offset[] = { 0x10, 'a', 0x02, 0x00 };
+    static const uint8_t truncated[] = { 0xF0, 0x10 };
+    CHECK(lz4_decompress_block(literals, sizeof(literals), out, sizeof(out)) == 3);
+    CHECK(memcmp(out, "abc", 3) == 0);
+    // One literal, then a 24-byte match at offset 1, then an empty last sequence
+    CHECK(lz4_decompress_block(repeat, sizeof(repeat), out, sizeof(out)) == 25);
+    CHECK(out[0] == 'a' && out[24] == 'a');
+    CHECK(lz4_decompress_block(repeat, sizeof(repeat), out, 10) == -1);
+    CHECK(lz4_decompress_block(far_offset, sizeof(far_offset), out, sizeof(out)) == -1);
+    CHECK(lz4_decompress_block(truncated, sizeof(truncated), out, sizeof(out)) == -1);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <image> <12|16|32> <data dir>\n", argv[0]);
+        return 2;
+    }
+    data_dir = argv[3];
+
+    if (host_disk_open(argv[1]) != 0) {
+        return 2;
+    }
+
+    CHECK(fatInit() == 0);
+    if (!g_fat_state.initialized) {
+        fprintf(stderr, "%s: fatInit failed\n", argv[1]);
+        return 1;
+    }
+
+    test_fat_type(atoi(argv[2]));
+    test_volume_info();
+    test_crc32c();
+    // Every file read below is checked against the manifest as well
+    test_manifest();
+
+    static const char *files[] = { "README.TXT", "SMALL.DAT", "EMPTY.DAT", "BIG.DAT" };
+    static const uint32_t chunks[] = { 1, 256, 512, 1000, 4096, 65536 };
+    test_split_extents();
+    test_snapshot();
+
+    // Once through disk_read like the ATA drive, once in place like a RAM
+    // disk, and both again with the boot snapshot in use
+    for (int pass = 0; pass < 4; pass++) {
+        host_disk_mapped = pass & 1;
+        if (pass == 2) {
+            CHECK(fatLoadSnapshot("BOOT.SNP") > 0);
+        }
+        test_open();
+        for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+            long size;
+            uint8_t *ref = load_reference(files[f], &size);
+            CHECK(ref != NULL);
+            free(ref);
+            if (ref) {
+                test_cluster_chain(files[f], size);
+            }
+            for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+                test_read_file(files[f], chunks[c]);
+            }
+            test_seek(files[f]);
+            test_map(files[f]);
+        }
+        test_lz4();
+        test_batch();
+    }
+
+    host_disk_close();
+    printf("%s: %d checks, %d failures\n", argv[1], checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+// test_vfs.c - Unit tests for src/vfs.c, mounted over src/fat.c
+//
+// usage: test_vfs <image> <data dir>
+//
+// Reads through descriptors are checked against the data directory, and
+// host_disk_calls shows which ones the page cache served.
+#include <stdio.h>
+#include <stdlib.h>
+#include "host.h"
+#include "check.h"
+#include "../src/fat.h"
+#include "../src/vfs.c"
+
+// Whole-file read in @chunk sized pieces, compared byte for byte
+static void test_read_file(const char *name, uint32_t chunk) {
+    long size;
+    uint8_t *ref = load_reference(name, &size);
+    CHECK(ref != NULL && size >= 0);
+    if (!ref) {
+        return;
+    }
+
+    int fd = vfs_open(name);
+    CHECK(fd >= 0);
+    vfs_stat_t st;
+    CHECK(vfs_fstat(fd, &st) == 0 && st.size == (uint32_t)size);
+
+    uint8_t *buf = malloc(size + chunk);
+    uint32_t total = 0;
+    int n;
+    while ((n = vfs_read(fd, buf + total, chunk)) > 0) {
+        total += n;
+    }
+    CHECK(n == 0);
+    CHECK(total == (uint32_t)size);
+    CHECK(memcmp(buf, ref, size) == 0);
+    CHECK(vfs_read(fd, buf, chunk) == 0);
+    CHECK(vfs_close(fd) == 0);
+
+    free(buf);
+    free(ref);
+}
+
+// A second open of a cached file does no disk I/O at all, and shares the
+// inode with descriptors still open on it
+static void test_reopen(void) {
+    long size;
+    uint8_t *ref = load_reference("README.TXT", &size);
+    CHECK(ref != NULL);
+    if (!ref) {
+        return;
+    }
+    uint8_t buf[512];
+
+    int a = vfs_open("README.TXT");
+    CHECK(a >= 0 && vfs_read(a, buf, sizeof(buf)) == size);
+
+    vfs_stats_t before, after;
+    vfs_stats(&before);
+    host_disk_calls = 0;
+    int b = vfs_open("readme.txt");
+    CHECK(b >= 0 && b != a);
+    CHECK(vfs_read(b, buf, sizeof(buf)) == size && memcmp(buf, ref, size) == 0);
+    CHECK(host_disk_calls == 0);
+
+    vfs_stat_t sa, sb;
+    CHECK(vfs_fstat(a, &sa) == 0 && vfs_fstat(b, &sb) == 0 && sa.ino == sb.ino);
+    vfs_stats(&after);
+    CHECK(after.inode_hits == before.inode_hits + 1);
+    CHECK(after.page_hits == before.page_hits + 1 && after.page_misses == before.page_misses);
+
+    // Closed and opened again: still cached
+    CHECK(vfs_close(a) == 0 && vfs_close(b) == 0);
+    CHECK(vfs_close(b) == -1);
+    host_disk_calls = 0;
+    a = vfs_open("README.TXT");
+    CHECK(vfs_read(a, buf, sizeof(buf)) == size);
+    CHECK(host_disk_calls == 0);
+    CHECK(vfs_close(a) == 0);
+
+    free(ref);
+}
+
+static void test_seek(const char *name) {
+    long size;
+    uint8_t *ref = load_reference(name, &size);
+    if (!ref || size == 0) {
+        free(ref);
+        return;
+    }
+
+    int fd = vfs_open(name);
+    CHECK(fd >= 0);
+
+    uint8_t buf[9000];
+    srand(1);
+    for (int i = 0; i < 500; i++) {
+        uint32_t off = rand() % size;
+        uint32_t len = rand() % sizeof(buf);
+        uint32_t expect = len < size - off ? len : size - off;
+
+        CHECK(vfs_seek(fd, off) == 0);
+        int n = vfs_read(fd, buf, len);
+        CHECK(n == (int)expect);
+        CHECK(n < 0 || memcmp(buf, ref + off, n) == 0);
+    }
+
+    CHECK(vfs_seek(fd, size + 100) == 0);
+    CHECK(vfs_read(fd, buf, sizeof(buf)) == 0);
+    CHECK(vfs_close(fd) == 0);
+    free(ref);
+}
+
+// More files than inodes and more data than pages: slots are reused
+static void test_eviction(void) {
+    char name[16];
+    for (int i = 0; i < 128; i++) {
+        snprintf(name, sizeof(name), "F%03d.DAT", i);
+        test_read_file(name, 4096);
+    }
+
+    vfs_stats_t st;
+    test_read_file("BIG.DAT", 65536);
+    vfs_stats(&st);
+    CHECK(st.pages_cached == VFS_CACHE_PAGES);
+    CHECK(st.page_evictions > 0);
+}
+
+// Descriptors run out, and bad ones are refused
+static void test_descriptors(void) {
+    int fds[VFS_MAX_FILES];
+    for (int i = 0; i < VFS_MAX_FILES; i++) {
+        fds[i] = vfs_open("SMALL.DAT");
+        CHECK(fds[i] >= 0);
+    }
+    CHECK(vfs_open("SMALL.DAT") == -1);
+    for (int i = 0; i < VFS_MAX_FILES; i++) {
+        CHECK(vfs_close(fds[i]) == 0);
+    }
+
+    uint8_t buf[16];
+    CHECK(vfs_open("NOSUCH.DAT") == -1);
+    CHECK(vfs_open(NULL) == -1);
+    CHECK(vfs_read(-1, buf, sizeof(buf)) == -1);
+    CHECK(vfs_read(VFS_MAX_FILES, buf, sizeof(buf)) == -1);
+    CHECK(vfs_read(0, buf, sizeof(buf)) == -1);
+    CHECK(vfs_seek(0, 0) == -1);
+    CHECK(vfs_close(0) == -1);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <image> <data dir>\n", argv[0]);
+        return 2;
+    }
+    data_dir = argv[2];
+
+    if (host_disk_open(argv[1]) != 0) {
+        return 2;
+    }
+
+    CHECK(vfs_open("README.TXT") == -1);
+    if (fatInit() != 0 || vfs_mount(&fat_vfs_ops) != 0) {
+        fprintf(stderr, "%s: mount failed\n", argv[1]);
+        return 1;
+    }
+
+    static const char *files[] = { "README.TXT", "SMALL.DAT", "EMPTY.DAT", "BIG.DAT" };
+    static const uint32_t chunks[] = { 1, 1000, 4096, 65536 };
+    for (host_disk_mapped = 0; host_disk_mapped < 2; host_disk_mapped++) {
+        CHECK(vfs_mount(&fat_vfs_ops) == 0);
+        test_reopen();
+        for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+            for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+                test_read_file(files[f], chunks[c]);
+            }
+            test_seek(files[f]);
+        }
+        test_eviction();
+        test_descriptors();
+    }
+
+    host_disk_close();
+    printf("%s: %d checks, %d failures (VFS)\n", argv[1], checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+# mkexfat.py - Build an exFAT image with files in its root directory
+#
+# usage: mkexfat.py OUTPUT SIZE_MIB [--cluster BYTES] [--mbr] [--fragment NAME]... FILE...
+#
+# Each FILE is PATH, NAME=PATH or NAME=PATH:LENGTH. LENGTH allocates the
+# file to that many bytes, with ValidDataLength left at the size of PATH,
+# so the rest reads as zeros. Files are written as one extent with the
+# NoFatChain flag set, except for files named with --fragment, which get
+# a FAT chain with a free cluster between each of their own. The image
+# is checksummed and has an up-case table, so src/exfat.c and fsck.exfat
+# both accept it.
+#
+# mkfs.exfat can make the same volumes, but copying files onto one needs
+# a mount; this runs unprivileged, like mcopy for the FAT images.
+import argparse
+import os
+import struct
+
+SECTOR = 512
+EOC = 0xFFFFFFFF
+
+
+def checksum(data, sum_, skip=()):
+    for i, b in enumerate(data):
+        if i not in skip:
+            sum_ = (((sum_ >> 1) | (sum_ << 31)) + b) & 0xFFFFFFFF
+    return sum_
+
+
+def upcase_table():
+    # Compressed: 0xFFFF, count means count characters that map to themselves
+    def upper(c):
+        ch = chr(c)
+        u = ch.upper()
+        return ord(u) if len(u) == 1 and ord(u) < 0x10000 else c
+
+    out = []
+    c = 0
+    while c < 0x10000:
+        if 0xD800 <= c < 0xE000 or upper(c) == c:
+            run = c
+            while run < 0x10000 and (0xD800 <= run < 0xE000 or upper(run) == run):
+                run += 1
+            if run - c > 2:
+                out += [0xFFFF, run - c]
+            else:
+                out += range(c, run)
+            c = run
+        else:
+            out.append(upper(c))
+            c += 1
+    return struct.pack("<%dH" % len(out), *out)
+
+
+def name_hash(name):
+    h = 0
+    for ch in name.upper():
+        for b in struct.pack("<H", ord(ch)):
+            h = (((h >> 1) | (h << 15)) + b) & 0xFFFF
+    return h
+
+
+class Volume:
+    def __init__(self, size, cluster):
+        self.spc_shift = (cluster // SECTOR).bit_length() - 1
+        self.cluster = cluster
+        total = size // SECTOR
+        self.fat_offset = 32
+        # One FAT; size it for every cluster that could follow it
+        count = (total - self.fat_offset) // (cluster // SECTOR)
+        self.fat_length = ((count + 2) * 4 + SECTOR - 1) // SECTOR
+        align = cluster // SECTOR
+        self.heap_offset = (self.fat_offset + self.fat_length + align - 1) // align * align
+        self.count = (total - self.heap_offset) // align
+        self.total = total
+        self.img = bytearray(total * SECTOR)
+        self.fat = [0] * (self.count + 2)
+        self.fat[0], self.fat[1] = 0xFFFFFFF8, EOC
+        self.used = [False] * (self.count + 2)
+        self.next = 2
+
+    def alloc(self, n, gap=False):
+        clusters = []
+        for _ in range(n):
+            if self.next >= self.count + 2:
+                raise SystemExit("mkexfat: volume full")
+            clusters.append(self.next)
+            self.used[self.next] = True
+            self.next += 2 if gap else 1
+        return clusters
+
+    def chain(self, clusters):
+        for a, b in zip(clusters, clusters[1:]):
+            self.fat[a] = b
+        if clusters:
+            self.fat[clusters[-1]] = EOC
+
+    def write(self, clusters, data):
+        for i, c in enumerate(clusters):
+            off = (self.heap_offset + (c - 2) * (self.cluster // SECTOR)) * SECTOR
+            chunk = data[i * self.cluster:(i + 1) * self.cluster]
+            self.img[off:off + len(chunk)] = chunk
+
+    def clusters_for(self, length):
+        return (length + self.cluster - 1) // self.cluster
+
+
+def entry_set(name, first, length, valid, contiguous):
+    chars = name.encode("utf-16-le")
+    parts = [chars[i:i + 30] for i in range(0, len(chars), 30)]
+    stream = struct.pack("<BBBBHHQIIQ", 0xC0, 0x01 | (0x02 if contiguous else 0), 0,
+                         len(name), name_hash(name), 0, valid, 0, first, length)
+    names = [struct.pack("<BB30s", 0xC1, 0, p) for p in parts]
+    primary = bytearray(struct.pack("<BBHH26s", 0x85, 1 + len(names), 0, 0x20, b""))
+    entries = primary + stream + b"".join(names)
+    s = 0
+    for i, b in enumerate(entries):
+        if i not in (2, 3):
+            s = (((s >> 1) | (s << 15)) + b) & 0xFFFF
+    struct.pack_into("<H", entries, 2, s)
+    return bytes(entries)
+
+
+def build(opts):
+    vol = Volume(opts.size * 1024 * 1024, opts.cluster)
+    upcase = upcase_table()
+
+    bitmap_clusters = vol.alloc(vol.clusters_for((vol.count + 7) // 8))
+    upcase_clusters = vol.alloc(vol.clusters_for(len(upcase)))
+    vol.chain(bitmap_clusters)
+    vol.chain(upcase_clusters)
+    vol.write(upcase_clusters, upcase)
+
+    files = []
+    for spec in opts.files:
+        name, _, path = spec.rpartition("=")
+        path, _, alloc = path.partition(":")
+        name = name or os.path.basename(path)
+        with open(path, "rb") as f:
+            data = f.read()
+        files.append((name, data, max(int(alloc or 0), len(data))))
+
+    # 3 entries per file with a name up to 15 characters, plus bitmap,
+    # up-case table, label and the end marker
+    dir_bytes = 32 * (4 + sum(2 + (len(n) + 14) // 15 for n, _, _ in files))
+    root_clusters = vol.alloc(vol.clusters_for(dir_bytes))
+    vol.chain(root_clusters)
+
+    root = bytearray()
+    label = "NEILOS".encode("utf-16-le")
+    root += struct.pack("<BB22s8s", 0x83, len(label) // 2, label, b"")
+    root += struct.pack("<BB18sIQ", 0x81, 0, b"", bitmap_clusters[0], (vol.count + 7) // 8)
+    root += struct.pack("<BB2sI12sIQ", 0x82, 0, b"", checksum(upcase, 0), b"",
+                        upcase_clusters[0], len(upcase))
+
+    for name, data, length in files:
+        n = vol.clusters_for(length)
+        fragment = name in opts.fragment
+        clusters = vol.alloc(n, gap=fragment)
+        if fragment:
+            vol.chain(clusters)
+        vol.write(clusters, data)
+        root += entry_set(name, clusters[0] if clusters else 0, length, len(data), not fragment)
+    vol.write(root_clusters, bytes(root))
+
+    # The FAT, then the bitmap; the gaps left by fragmented files stay free
+    fat = struct.pack("<%dI" % len(vol.fat), *vol.fat)
+    off = vol.fat_offset * SECTOR
+    vol.img[off:off + len(fat)] = fat
+    bitmap = bytearray((vol.count + 7) // 8)
+    for c in range(2, vol.count + 2):
+        if vol.used[c]:
+            bitmap[(c - 2) // 8] |= 1 << ((c - 2) % 8)
+    vol.write(bitmap_clusters, bytes(bitmap))
+
+    # Boot region, then its backup right after it
+    boot = bytearray(SECTOR)
+    struct.pack_into("<3s8s", boot, 0, b"\xEB\x76\x90", b"EXFAT   ")
+    used = sum(vol.used)
+    struct.pack_into("<QQIIIIIIHHBBBBB", boot, 64, 0, vol.total, vol.fat_offset, vol.fat_length,
+                     vol.heap_offset, vol.count, root_clusters[0], 0x4E45494C, 0x0100, 0,
+                     9, vol.spc_shift, 1, 0x80, used * 100 // vol.count)
+    boot[510:512] = b"\x55\xAA"
+    region = bytearray(boot)
+    for _ in range(8):
+        ext = bytearray(SECTOR)
+        ext[508:512] = b"\x00\x00\x55\xAA"
+        region += ext
+    region += bytearray(2 * SECTOR)
+    s = checksum(region, 0, skip=(106, 107, 112))
+    region += struct.pack("<I", s) * (SECTOR // 4)
+    vol.img[0:len(region)] = region
+    vol.img[len(region):2 * len(region)] = region
+
+    img = vol.img
+    if opts.mbr:
+        mbr = bytearray(2048 * SECTOR)
+        struct.pack_into("<B3sB3sII", mbr, 446, 0, b"", 0x07, b"", 2048, vol.total)
+        mbr[510:512] = b"\x55\xAA"
+        img = mbr + img
+    with open(opts.output, "wb") as f:
+        f.write(img)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build an exFAT image")
+    parser.add_argument("output")
+    parser.add_argument("size", type=int, help="volume size in MiB")
+    parser.add_argument("--cluster", type=int, default=4096, help="cluster size in bytes")
+    parser.add_argument("--mbr", action="store_true", help="put the volume in an MBR partition at 1 MiB")
+    parser.add_argument("--fragment", action="append", default=[], metavar="NAME",
+                        help="give NAME a fragmented FAT chain instead of one extent")
+    parser.add_argument("files", nargs="*")
+    build(parser.parse_intermixed_args())
+
+
+if __name__ == "__main__":
+    main()
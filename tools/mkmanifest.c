@@ -0,0 +1,56 @@
+// mkmanifest.c - Write the checksum manifest for fatLoadManifest
+//
+// usage: mkmanifest [NAME=]file...
+//
+// Prints one "NAME crc32c size" line per file. NAME is the 8.3 name on the
+// volume; without it the upper-cased base name of the file is used.
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/crc32c.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s [NAME=]file...\n", argv[0]);
+        return 2;
+    }
+
+    crc32c_init(0);
+
+    for (int i = 1; i < argc; i++) {
+        char name[64];
+        const char *path = argv[i];
+        const char *eq = strchr(path, '=');
+        if (eq) {
+            snprintf(name, sizeof(name), "%.*s", (int)(eq - path), path);
+            path = eq + 1;
+        } else {
+            const char *base = strrchr(path, '/');
+            snprintf(name, sizeof(name), "%s", base ? base + 1 : path);
+            for (char *c = name; *c; c++) {
+                *c = toupper((unsigned char)*c);
+            }
+        }
+
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            perror(path);
+            return 1;
+        }
+
+        uint8_t buf[65536];
+        uint32_t crc = 0;
+        unsigned long size = 0;
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            crc = crc32c(crc, buf, n);
+            size += n;
+        }
+        fclose(f);
+
+        printf("%s %08x %lu\n", name, crc, size);
+    }
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+// mksnapshot.c - Write the boot snapshot for fatLoadSnapshot into an image
+//
+// usage: mksnapshot IMAGE SNAPSHOT [HOT...]
+//
+// SNAPSHOT is the name of a file already on the volume, large enough for
+// the snapshot; it is overwritten in place, so neither the FAT nor the
+// directory change and the hashes taken of them stay valid. The snapshot
+// indexes every file of the root directory and lists the cluster extents
+// of the HOT files. Built with src/fat.c, so the hashes are computed by
+// the same code that checks them at boot.
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../tests/host.h"
+#include "../src/fat.c"
+
+#define MAX_ENTRIES 4096
+#define MAX_EXTENTS 16384
+
+static FAT_SnapshotEntry entries[MAX_ENTRIES];
+static uint32_t entry_count = 0;
+static FAT_Extent extents[MAX_EXTENTS];
+static uint32_t extent_count = 0;
+
+// Same entries search_dir would find
+static int collect_dir_block(const FAT_DirEntry *dir, uint32_t count, void *ctx) {
+    for (uint32_t i = 0; i < count; i++) {
+        const FAT_DirEntry *entry = &dir[i];
+        if (entry->name[0] == 0x00) return 1;
+        if ((uint8_t)entry->name[0] == 0xE5 || entry->attr == FAT_ATTR_LFN) continue;
+        if (entry->attr & (FAT_ATTR_DIRECTORY | FAT_ATTR_VOLUME_ID)) continue;
+        if (entry_count == MAX_ENTRIES) {
+            fprintf(stderr, "mksnapshot: more than %d files\n", MAX_ENTRIES);
+            exit(1);
+        }
+
+        FAT_SnapshotEntry *se = &entries[entry_count++];
+        memset(se, 0, sizeof(*se));
+        memcpy(se->name, entry->name, 8);
+        memcpy(se->name + 8, entry->ext, 3);
+        se->first_cluster = entry->cluster_low | ((uint32_t)entry->cluster_high << 16);
+        se->size = entry->file_size;
+    }
+    (void)ctx;
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return memcmp(((const FAT_SnapshotEntry*)a)->name, ((const FAT_SnapshotEntry*)b)->name, 11);
+}
+
+// Adds the extents of @se's chain; returns the highest cluster in it
+static uint32_t add_extents(FAT_SnapshotEntry *se, uint32_t cluster_size) {
+    uint32_t clusters = (se->size + cluster_size - 1) / cluster_size;
+    uint32_t cluster = se->first_cluster;
+    uint32_t highest = 0;
+
+    se->extent = extent_count;
+    for (uint32_t n = 0; n < clusters; n++) {
+        if (cluster < 2 || cluster == FAT_CHAIN_END) {
+            fprintf(stderr, "mksnapshot: %.11s: chain ends early\n", se->name);
+            exit(1);
+        }
+        if (se->extent_count > 0 && extents[extent_count - 1].cluster + extents[extent_count - 1].count == cluster) {
+            extents[extent_count - 1].count++;
+        } else {
+            if (extent_count == MAX_EXTENTS) {
+                fprintf(stderr, "mksnapshot: more than %d extents\n", MAX_EXTENTS);
+                exit(1);
+            }
+            extents[extent_count].cluster = cluster;
+            extents[extent_count].count = 1;
+            extent_count++;
+            se->extent_count++;
+        }
+        if (cluster > highest) {
+            highest = cluster;
+        }
+        cluster = get_next_cluster(cluster);
+    }
+    return highest;
+}
+
+// FAT sectors that hold the entries of clusters up to @cluster
+static uint32_t fat_sectors_for(uint32_t cluster) {
+    uint32_t bytes;
+    switch (g_fat_state.fat_type) {
+    case FAT_TYPE_12: bytes = cluster + cluster / 2 + 2; break;
+    case FAT_TYPE_16: bytes = (cluster + 1) * 2; break;
+    default:          bytes = (cluster + 1) * 4; break;
+    }
+    return (bytes + 511) / 512;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s IMAGE SNAPSHOT [HOT...]\n", argv[0]);
+        return 2;
+    }
+
+    crc32c_init(0);
+    if (host_disk_open(argv[1]) != 0 || fatInit() != 0) {
+        fprintf(stderr, "mksnapshot: %s: not a FAT volume\n", argv[1]);
+        return 1;
+    }
+    host_disk_mapped = 1;
+
+    if (root_dir_walk(collect_dir_block, 0) != 0) {
+        return 1;
+    }
+    qsort(entries, entry_count, sizeof(entries[0]), compare_entries);
+
+    uint32_t cluster_size = g_fat_state.boot_sector.sectors_per_cluster * g_fat_state.boot_sector.bytes_per_sector;
+    uint32_t highest = g_fat_state.fat_type == FAT_TYPE_32 ? g_fat_state.root_cluster : 0;
+    for (int i = 3; i < argc; i++) {
+        char name[8], ext[3], key[11];
+        to_short_name(argv[i], name, ext);
+        memcpy(key, name, 8);
+        memcpy(key + 8, ext, 3);
+
+        FAT_SnapshotEntry *se = bsearch(key, entries, entry_count, sizeof(entries[0]), compare_entries);
+        if (!se) {
+            fprintf(stderr, "mksnapshot: %s: no such file\n", argv[i]);
+            return 1;
+        }
+        if (se->extent_count == 0) {
+            uint32_t h = add_extents(se, cluster_size);
+            highest = h > highest ? h : highest;
+        }
+    }
+
+    // The FAT32 root chain is hashed along with the directory it holds
+    if (g_fat_state.fat_type == FAT_TYPE_32) {
+        for (uint32_t c = g_fat_state.root_cluster; c >= 2 && c != FAT_CHAIN_END; c = get_next_cluster(c)) {
+            highest = c > highest ? c : highest;
+        }
+    }
+
+    FAT_SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = FAT_SNAPSHOT_MAGIC;
+    hdr.version = FAT_SNAPSHOT_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.entry_count = entry_count;
+    hdr.extent_count = extent_count;
+    hdr.total_size = sizeof(hdr) + entry_count * sizeof(entries[0]) + extent_count * sizeof(extents[0]);
+    hdr.volume_id = volume_serial();
+    hdr.first_data_sector = g_fat_state.first_data_sector - g_fat_state.partition_lba;
+    hdr.total_clusters = g_fat_state.total_clusters;
+    hdr.cluster_size = cluster_size;
+    hdr.fat_sectors = highest ? fat_sectors_for(highest) : 0;
+    uint32_t fat_hash, dir_hash = 0;
+    if (fat_crc(hdr.fat_sectors, &fat_hash) != 0 || root_dir_walk(crc_dir_block, &dir_hash) != 0) {
+        return 1;
+    }
+    hdr.fat_crc = fat_hash;
+    hdr.root_dir_crc = dir_hash;
+
+    FAT_FileHandle file;
+    if (fatOpen(argv[2], &file) != 0) {
+        fprintf(stderr, "mksnapshot: %s: no such file on the volume\n", argv[2]);
+        return 1;
+    }
+    if (file.file_size < hdr.total_size || file.file_size > FAT_SNAPSHOT_MAX) {
+        fprintf(stderr, "mksnapshot: %s must be %u to %u bytes\n", argv[2], hdr.total_size, FAT_SNAPSHOT_MAX);
+        return 1;
+    }
+
+    // Zero padded to the size of the file
+    uint8_t *data = calloc(1, file.file_size);
+    memcpy(data, &hdr, sizeof(hdr));
+    memcpy(data + sizeof(hdr), entries, entry_count * sizeof(entries[0]));
+    memcpy(data + sizeof(hdr) + entry_count * sizeof(entries[0]), extents, extent_count * sizeof(extents[0]));
+    hdr.crc = crc32c(0, data, hdr.total_size);
+    memcpy(data, &hdr, sizeof(hdr));
+
+    int fd = open(argv[1], O_WRONLY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    uint32_t sector, count, bytes, done = 0;
+    while (fatMap(&file, &sector, &count, &bytes) == 1) {
+        if (pwrite(fd, data + done, bytes, (off_t)sector * 512) != (ssize_t)bytes) {
+            perror(argv[1]);
+            return 1;
+        }
+        done += bytes;
+    }
+    close(fd);
+    host_disk_close();
+
+    printf("%s: %s indexes %u files, %u extents\n", argv[1], argv[2], entry_count, extent_count);
+    free(data);
+    return done == file.file_size ? 0 : 1;
+}
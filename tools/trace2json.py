@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# trace2json.py - Convert the kernel's trace buffer to Chrome trace JSON
+#
+# usage: trace2json.py INPUT [-o OUTPUT]
+#
+# INPUT is either a serial log with the TRACE BEGIN/END hex block written
+# by trace_dump(), or a memory dump that contains trace_buffer, e.g. from
+# "pmemsave 0 0x2000000 mem.bin" or "dump-guest-memory mem.elf" in the
+# QEMU monitor. The layout is trace_buffer_t in src/trace.h.
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"NEILTRCE"
+VERSION = 1
+HEADER = struct.Struct("<8s6I")     # magic, version, record_size, capacity, tsc_khz, head, event_count
+RECORD = struct.Struct("<QHBBIIIII")
+NAME_LEN = 48  # TRACE_NAME_LEN
+
+
+def from_serial(data):
+    text = data.decode("ascii", "replace")
+    start = text.rfind("TRACE BEGIN")
+    if start < 0:
+        return None
+    end = text.find("TRACE END", start)
+    if end < 0:
+        sys.exit("trace2json: TRACE BEGIN without TRACE END; was the log cut short?")
+    lines = text[start:end].splitlines()[1:]
+    return bytes.fromhex("".join(line.strip() for line in lines))
+
+
+def find_header(data):
+    # The magic string also sits in the kernel's .rodata, so check the rest
+    # of the header before trusting a match
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        fields = HEADER.unpack_from(data, pos) if pos + HEADER.size <= len(data) else None
+        if fields and fields[1] == VERSION and fields[2] == RECORD.size and fields[3] > 0:
+            return pos
+        pos = data.find(MAGIC, pos + 1)
+    sys.exit("trace2json: no trace buffer found (was the kernel built with TRACE=1?)")
+
+
+def parse_names(raw):
+    begin, _, end = raw.partition("|")
+    words = begin.split()
+    return words[0], words[1:], end.split()
+
+
+def convert(data):
+    base = find_header(data)
+    _, _, record_size, capacity, tsc_khz, head, event_count = HEADER.unpack_from(data, base)
+    names = []
+    for i in range(event_count):
+        off = base + HEADER.size + i * NAME_LEN
+        raw = data[off:off + NAME_LEN].split(b"\0", 1)[0].decode("ascii")
+        names.append(parse_names(raw))
+
+    first = base + HEADER.size + event_count * NAME_LEN
+    used = min(head, capacity)
+    records = []
+    for i in range(used):
+        off = first + i * record_size
+        if off + record_size > len(data):
+            break
+        records.append(RECORD.unpack_from(data, off))
+    records.sort(key=lambda r: r[0])
+    if head > capacity:
+        print(f"trace2json: {head - capacity} oldest records were overwritten", file=sys.stderr)
+
+    events = []
+    t0 = records[0][0] if records else 0
+    khz = tsc_khz or 1000000
+    cpus = set()
+    for tsc, event, phase, cpu, thread, rid, arg0, arg1, _ in records:
+        if event >= len(names):
+            continue
+        name, begin_args, end_args = names[event]
+        ph = chr(phase)
+        labels = end_args if ph in "Ee" else begin_args
+        args = {label: value for label, value in zip(labels, (arg0, arg1))}
+        ev = {
+            "name": name,
+            "ph": ph,
+            "ts": (tsc - t0) * 1000 / khz,     # Microseconds
+            "pid": cpu,
+            "tid": thread,
+            "args": args,
+        }
+        if ph in "be":
+            ev["cat"] = name
+            ev["id"] = hex(rid)
+        elif ph == "i":
+            ev["s"] = "t"
+        events.append(ev)
+        cpus.add(cpu)
+
+    for cpu in sorted(cpus):
+        events.append({"name": "process_name", "ph": "M", "pid": cpu,
+                       "args": {"name": f"CPU {cpu}"}})
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a kernel trace buffer to Chrome trace JSON")
+    parser.add_argument("input", help="serial log or memory dump")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    opts = parser.parse_args()
+
+    with open(opts.input, "rb") as f:
+        data = f.read()
+    trace = convert(from_serial(data) or data)
+
+    out = open(opts.output, "w") if opts.output else sys.stdout
+    json.dump(trace, out)
+    out.write("\n")
+
+
+if __name__ == "__main__":
+    main()